@@ -0,0 +1,174 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#include "webalizer.h"                        /* main header              */
+#include "chclass.h"                          /* our header               */
+
+/* SSE2 block scanners on x86, same as fmt_logrec() in parser.c */
+#if defined(__GNUC__) && (defined(__x86_64__) || \
+    (defined(__i386__) && defined(__SSE2__)))
+#define CC_SIMD
+#include <emmintrin.h>
+#endif
+
+/* classes the block scanners can handle.  cc_span() skips blocks of
+   [A-Za-z0-9.-], which are in all of the span classes, and cc_find()
+   only looks closer at control chars, '<', '>' and '"', which are the
+   only chars in any of the find classes.                             */
+#define CC_SPANFAST (CC_URL|CC_CGI|CC_HOST)
+#define CC_FINDFAST (CC_CTRL|CC_RBAD|CC_ABAD|CC_IBAD)
+
+unsigned char cc_tab[256];                    /* class bits for each char */
+
+/*********************************************/
+/* CC_INIT - setup character class table     */
+/*********************************************/
+
+/* must be called after setlocale(), since isalnum() depends on it */
+
+void cc_init()
+{
+   int           i;
+   unsigned char c;
+
+   memset(cc_tab, 0, sizeof(cc_tab));
+   for (i=1;i<256;i++)
+   {
+      c=(unsigned char)i;
+      if (isalnum(c))                         /* letters, numbers...      */
+         cc_tab[i]|=CC_ALNUM|CC_HOST|CC_URL|CC_CGI;
+      if (c>127)                              /* extended chars in URLs   */
+         cc_tab[i]|=CC_URL|CC_CGI;
+      if (strchr(":/\\.,' *!-+_@~()[]",c))    /* and some others...       */
+         cc_tab[i]|=CC_URL|CC_CGI;
+      if (strchr(";?&=",c))                   /* cgi vars, if kept        */
+         cc_tab[i]|=CC_URL;
+      if (strchr(".-:",c))                    /* hostnames                */
+         cc_tab[i]|=CC_HOST;
+      if (c<32 || c==127) cc_tab[i]|=CC_CTRL|CC_RBAD|CC_ABAD;
+      if (c=='<')         cc_tab[i]|=CC_RBAD|CC_ABAD;
+      if (c=='>')         cc_tab[i]|=CC_ABAD;
+      if (c<32 || c=='"') cc_tab[i]|=CC_IBAD;
+   }
+   cc_tab[0]=CC_CTRL|CC_RBAD|CC_ABAD|CC_IBAD; /* end of string stops all  */
+}
+
+#ifdef CC_SIMD
+/*********************************************/
+/* CC_RANGE - bytes in range lo..hi (SSE2)   */
+/*********************************************/
+
+static inline __m128i cc_range(__m128i v, int lo, int hi)
+{
+   __m128i t=_mm_sub_epi8(v,_mm_set1_epi8((char)lo));
+   return _mm_cmpeq_epi8(_mm_min_epu8(t,_mm_set1_epi8((char)(hi-lo))),t);
+}
+#endif
+
+/*********************************************/
+/* CC_SPAN - skip chars in a class           */
+/*********************************************/
+
+/* returns pointer to first char in str..end not in any of the cls
+   classes, or end if they all are                                  */
+
+char *cc_span(char *str, char *end, int cls)
+{
+   unsigned char *cp=(unsigned char *)str, *ep=(unsigned char *)end;
+
+#ifdef CC_SIMD
+   if (cls&CC_SPANFAST)
+   {
+      while (ep-cp>=16)
+      {
+         __m128i v=_mm_loadu_si128((__m128i *)cp);
+         __m128i ok=_mm_or_si128(
+            _mm_or_si128(cc_range(_mm_or_si128(v,_mm_set1_epi8(0x20)),'a','z'),
+                         cc_range(v,'0','9')),
+            _mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('.')),
+                         _mm_cmpeq_epi8(v,_mm_set1_epi8('-'))));
+         int m=~_mm_movemask_epi8(ok)&0xffff;
+
+         if (!m) { cp+=16; continue; }        /* whole block is ok        */
+         cp+=__builtin_ctz(m);                /* else check the odd one   */
+         if (!(cc_tab[*cp]&cls)) return (char *)cp;
+         cp++;
+      }
+   }
+#endif
+   while (cp<ep && (cc_tab[*cp]&cls)) cp++;
+   return (char *)cp;
+}
+
+/*********************************************/
+/* CC_FIND - find first char in a class      */
+/*********************************************/
+
+/* returns pointer to first char in str..end in any of the cls
+   classes, or end if none are                                      */
+
+char *cc_find(char *str, char *end, int cls)
+{
+   unsigned char *cp=(unsigned char *)str, *ep=(unsigned char *)end;
+
+#ifdef CC_SIMD
+   if (!(cls&~CC_FINDFAST))
+   {
+      while (ep-cp>=16)
+      {
+         __m128i v=_mm_loadu_si128((__m128i *)cp);
+         __m128i may=_mm_or_si128(
+            _mm_or_si128(cc_range(v,0,31),
+                         _mm_cmpeq_epi8(v,_mm_set1_epi8(127))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('<')),
+                                      _mm_cmpeq_epi8(v,_mm_set1_epi8('>'))),
+                         _mm_cmpeq_epi8(v,_mm_set1_epi8('"'))));
+         int m=_mm_movemask_epi8(may);
+
+         while (m)                            /* check candidates         */
+         {
+            int j=__builtin_ctz(m);
+            if (cc_tab[cp[j]]&cls) return (char *)cp+j;
+            m&=m-1;
+         }
+         cp+=16;
+      }
+   }
+#endif
+   while (cp<ep && !(cc_tab[*cp]&cls)) cp++;
+   return (char *)cp;
+}
@@ -0,0 +1,20 @@
+#ifndef _CHCLASS_H
+#define _CHCLASS_H
+
+/* character classes, bits in cc_tab[] */
+#define CC_URL    0x01                     /* URL char (keep cgi vars)     */
+#define CC_CGI    0x02                     /* URL char (strip cgi vars)    */
+#define CC_ALNUM  0x04                     /* letter or digit (locale)     */
+#define CC_HOST   0x08                     /* hostname char (alnum . - :)  */
+#define CC_CTRL   0x10                     /* control char (<32 or 127)    */
+#define CC_RBAD   0x20                     /* ends referrer (ctrl <)       */
+#define CC_ABAD   0x40                     /* ends user agent (ctrl < >)   */
+#define CC_IBAD   0x80                     /* ends username (<32 ")        */
+
+extern unsigned char cc_tab[256];          /* class bits for each char     */
+
+extern void  cc_init();                    /* setup table (after locale)   */
+extern char  *cc_span(char *, char *, int);   /* skip chars in class       */
+extern char  *cc_find(char *, char *, int);   /* find first char in class  */
+
+#endif  /* _CHCLASS_H */
@@ -0,0 +1,194 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+/* Need socket header? */
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include "webalizer.h"                        /* main header              */
+#include "linklist.h"                         /* linked list stuff        */
+#include "hashtab.h"                          /* hash()                   */
+#include "dcache.h"                           /* our header               */
+
+/* Per string decision cache.  Hostnames, URLs, referrers and agents
+   repeat a lot, and the Include/Ignore, Group and SearchEngine lists
+   (and agent mangling) always give the same answer for the same
+   string, so remember the answers.  Each cache is a fixed size table
+   of DC_WAYS slot sets, a key lives in the set picked by its hash and
+   a slot not used since the CLOCK hand last passed is replaced when
+   the set is full.  Slots are never emptied, so a lookup can stop at
+   the first empty one.  Answers are only worked out when asked for.
+   Keys come with their hash(), which the record already has.       */
+
+struct dcache dc_host  = { NULL };            /* hostnames                */
+struct dcache dc_url   = { NULL };            /* URLs                     */
+struct dcache dc_ref   = { NULL };            /* referrers                */
+struct dcache dc_agent = { NULL };            /* user agents              */
+struct dcache dc_user  = { NULL };            /* usernames                */
+struct dcache dc_raw   = { NULL };            /* user agents (unmangled)  */
+
+/*********************************************/
+/* DC_GET - find (or add) cache entry        */
+/*********************************************/
+
+static struct dc_ent *dc_get(struct dcache *dc, char *str, int len,
+                             u_int64_t h)
+{
+   struct dc_ent *ep;
+   u_int64_t     *tp;
+   int           i, set;
+   char          *cp;
+
+   if (len>=DC_MAXKEY) return NULL;
+
+   /* same string as last time? (filter, then group, for one record)  */
+   if ((ep=dc->last)!=NULL && ep->len==len && !memcmp(ep->key,str,len))
+      return ep;
+
+   if (dc->ent==NULL)
+   {
+      dc->tag=calloc(DC_SIZE,sizeof(u_int64_t));
+      dc->ref=calloc(DC_SIZE/DC_WAYS,1);
+      dc->ent=calloc(DC_SIZE,sizeof(struct dc_ent));
+      if (!dc->tag || !dc->ref || !dc->ent)
+      {
+         free(dc->tag); free(dc->ref); free(dc->ent);
+         dc->tag=NULL; dc->ref=NULL; dc->ent=NULL;
+         return NULL;
+      }
+   }
+
+   /* the tags of a set share a cache line, only matches touch entries */
+   h|=1;
+   set=(int)(h>>32)&(DC_SIZE/DC_WAYS-1);
+   tp=&dc->tag[set*DC_WAYS];
+   for (i=0;i<DC_WAYS;i++)
+   {
+      if (tp[i]==0) break;
+      ep=&dc->ent[set*DC_WAYS+i];
+      if (tp[i]==h && ep->len==len && !memcmp(ep->key,str,len))
+         { dc->ref[set]|=1<<i; return dc->last=ep; }
+   }
+
+   if (i==DC_WAYS)                            /* set full, pick a victim  */
+   {
+      for (i=dc->hand;dc->ref[set]&(1<<i);i=(i+1)%DC_WAYS)
+         dc->ref[set]&=~(1<<i);
+      dc->hand=(i+1)%DC_WAYS;
+   }
+   ep=&dc->ent[set*DC_WAYS+i];
+
+   /* key buffer also holds a value of the same size (mangled agent) */
+   if (ep->size<2*len+2)
+   {
+      if ((cp=realloc(ep->key,2*len+2))==NULL) return NULL;
+      ep->key=cp; ep->size=2*len+2;
+   }
+   memcpy(ep->key,str,len); ep->key[len]='\0';
+   ep->len=len; ep->vlen=0; ep->flags=0;
+   tp[i]=h; dc->ref[set]&=~(1<<i);
+   return dc->last=ep;
+}
+
+/*********************************************/
+/* DC_FILTER - cached Include/Ignore check   */
+/*********************************************/
+
+int dc_filter(struct dcache *dc, char *str, int len, u_int64_t h,
+              NLISTPTR inc, NLISTPTR ign)
+{
+   struct dc_ent *ep;
+   int           f=0;
+
+   if (inc==NULL && ign==NULL) return 0;
+
+   if ((ep=dc_get(dc,str,len,h))!=NULL && (ep->flags&DC_FILT))
+      return ep->flags&(DC_INC|DC_IGN);
+
+   if (isinlist(inc,str,len)!=NULL) f|=DC_INC;
+   if (isinlist(ign,str,len)!=NULL) f|=DC_IGN;
+   if (ep!=NULL) ep->flags|=DC_FILT|f;
+   return f;
+}
+
+/*********************************************/
+/* DC_GROUP - cached isinglist()             */
+/*********************************************/
+
+char *dc_group(struct dcache *dc, int n, GLISTPTR list, char *str, int *len,
+               u_int64_t h)
+{
+   struct dc_ent *ep;
+   char          *cp;
+
+   if (list==NULL) return NULL;
+
+   if ((ep=dc_get(dc,str,*len,h))==NULL) return isinglist(list,str,len);
+   if (!(ep->flags&(DC_GRP<<n)))
+   {
+      ep->grp[n]=isinglist(list,str,len);
+      ep->glen[n]=*len;
+      ep->flags|=DC_GRP<<n;
+      return ep->grp[n];
+   }
+   if ((cp=ep->grp[n])!=NULL) *len=ep->glen[n];
+   return cp;
+}
+
+/*********************************************/
+/* DC_MANGLE - cached agent_mangle()         */
+/*********************************************/
+
+int dc_mangle(char *agent, int len)
+{
+   struct dc_ent *ep;
+
+   if ((ep=dc_get(&dc_raw,agent,len,hash(agent,len)))!=NULL && (ep->flags&DC_MANGLE))
+   {
+      memcpy(agent,ep->key+ep->len+1,ep->vlen+1);
+      return ep->vlen;
+   }
+
+   agent_mangle(agent);
+   len=strlen(agent);
+   if (ep!=NULL && len<=ep->len)              /* never grows, but be sure */
+   {
+      memcpy(ep->key+ep->len+1,agent,len+1);
+      ep->vlen=len; ep->flags|=DC_MANGLE;
+   }
+   return len;
+}
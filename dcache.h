@@ -0,0 +1,45 @@
+#ifndef _DCACHE_H
+#define _DCACHE_H
+
+#define DC_SIZE    4096                    /* slots in a cache (power of 2)*/
+#define DC_WAYS    8                       /* slots in a set (a key lives  */
+                                           /* in one set, by hash)         */
+#define DC_MAXKEY  1024                    /* longer strings aren't cached */
+
+/* cached decisions, bits in dc_ent.flags */
+#define DC_INC     0x01                    /* matches an Include* entry    */
+#define DC_IGN     0x02                    /* matches an Ignore* entry     */
+#define DC_FILT    0x04                    /* DC_INC/DC_IGN are known      */
+#define DC_GRP     0x08                    /* grp[] known (1 bit per slot) */
+#define DC_MANGLE  0x20                    /* mangled agent known          */
+
+/* group lookups that can be cached for one string */
+#define DC_GROUP   0                       /* Group* list                  */
+#define DC_SEARCH  1                       /* SearchEngine list            */
+
+struct dc_ent { char      *key;            /* key, then value              */
+                int       len;             /* key length                   */
+                int       size;            /* size of key buffer           */
+                int       vlen;            /* value length (mangled agent) */
+                int       flags;           /* DC_xxx bits                  */
+                char      *grp[2];         /* group names (NULL=none)      */
+                int       glen[2]; };      /* group name lengths           */
+
+struct dcache { u_int64_t     *tag;        /* key hashes (0=empty slot)    */
+                unsigned char *ref;        /* CLOCK bits, one byte per set */
+                struct dc_ent *ent;        /* slots (NULL=not setup yet)   */
+                struct dc_ent *last;       /* last entry looked up         */
+                int           hand; };     /* CLOCK hand                   */
+
+/* one cache per record field, used by the main thread only.  The agent */
+/* mangle cache is used by whoever runs fix_record() (main or parser).  */
+extern struct dcache dc_host, dc_url, dc_ref, dc_agent, dc_user, dc_raw;
+
+/* keys are passed with their length and hash() */
+extern int   dc_filter(struct dcache *, char *, int, u_int64_t,
+                       NLISTPTR, NLISTPTR);
+extern char  *dc_group(struct dcache *, int, GLISTPTR, char *, int *,
+                       u_int64_t);
+extern int   dc_mangle(char *, int);       /* cached agent_mangle()        */
+
+#endif  /* _DCACHE_H */
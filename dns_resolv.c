@@ -66,10 +66,9 @@
 #include "lang.h"                              /* language declares        */
 #include "hashtab.h"                           /* hash table functions     */
 #include "parser.h"                            /* log parser functions     */
+#include "logfile.h"                           /* log file input           */
 #include "dns_resolv.h"                        /* our header               */
 
-extern void *our_fp;
-
 /* local data */
 
 DB       *dns_db   = NULL;                     /* DNS cache database       */
@@ -129,6 +128,7 @@ void resolve_dns(struct log_struct *log_rec)
                ((struct dnsRecord *)response.data)->hostName,
                MAXHOST);
       log_rec->hostname[MAXHOST-1]=0;
+      log_rec->hnamelen=strlen(log_rec->hostname);
       if (debug_mode)
          fprintf(stderr," found: %s (%ld)\n",
            log_rec->hostname, alignedRecord.timeStamp);
@@ -147,13 +147,14 @@ void resolve_dns(struct log_struct *log_rec)
 /* DNS_RESOLVER - read log and lookup IP's   */
 /*********************************************/
 
-int dns_resolver(void *log_fp)
+int dns_resolver()
 {
    DNODEPTR  h_entries;
    DNODEPTR  l_list = NULL;
 
-   int       i;
+   int       i, len, lf;
    int       save_verbose=verbose;
+   char      *rec_buf;
 
    u_int64_t listEntries = 0;
 
@@ -229,23 +230,22 @@ int dns_resolver(void *log_fp)
    /* disable warnings/errors for this run... */
    verbose=0;
 
-   /* Main loop to read log records (either regular or zipped) */
-   while ( ourget(buffer,BUFSIZE,our_fp) != NULL)
+   /* Main loop to read log records (each log file in turn) */
+   for (lf=0;lf<log_nfiles;lf++)
+   while ( (rec_buf=lf_gets(log_files[lf],&len)) != NULL)
    {
-	  int len = strlen(buffer);
       if (len == (BUFSIZE-1))
       {
          /* get the rest of the record */
-         while ( ourget(buffer,BUFSIZE,our_fp) != NULL)
+         while ( (rec_buf=lf_gets(log_files[lf],&len)) != NULL)
          {
-		 	len = strlen(buffer);
             if (len < BUFSIZE-1) break;
          }
          continue;                        /* go get next record if any    */
       }
 
-      strcpy(tmp_buf, buffer);            /* save buffer in case of error */
-      if(parse_record(buffer, len))       /* parse the record             */
+      strcpy(tmp_buf, rec_buf);           /* save buffer in case of error */
+      if(parse_record(rec_buf,len,&log_rec)) /* parse the record           */
       {
          struct addrinfo hints, *ares;
          memset(&hints, 0, sizeof(hints));
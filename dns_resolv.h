@@ -19,7 +19,7 @@ struct dns_child             /* Defines the communication with a DNS child */
 extern void resolve_dns(struct log_struct *);
 extern DB   *dns_db;
 extern int  dns_fd;
-extern int  dns_resolver(void *);
+extern int  dns_resolver();
 extern int  open_cache();
 extern int  close_cache();
 
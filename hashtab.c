@@ -57,50 +57,555 @@
 #include "lang.h"
 #include "linklist.h"
 #include "hashtab.h"
+#include "shard.h"
+
+/* SSE2 group probing on x86, same as fmt_logrec() in parser.c */
+#if defined(__GNUC__) && (defined(__x86_64__) || \
+    (defined(__i386__) && defined(__SSE2__)))
+#define HT_SIMD
+#include <emmintrin.h>
+#endif
 
 /* internal function prototypes */
 
-HNODEPTR new_hnode(char *,int);               /* new host node            */
-UNODEPTR new_unode(char *,int);               /* new url node             */
-RNODEPTR new_rnode(char *,int);               /* new referrer node        */
-ANODEPTR new_anode(char *,int);               /* new user agent node      */
-SNODEPTR new_snode(char *,int);               /* new search string..      */
-INODEPTR new_inode(char *,int);               /* new ident node           */
+/* new nodes, from the arena of the table (and hash) they go in */
+struct spnode;                                /* string pool entry        */
+HNODEPTR new_hnode(char *,int,struct htab *,u_int64_t,   /* host node     */
+                   struct spnode **);
+UNODEPTR new_unode(char *,int,struct htab *,u_int64_t,   /* url node      */
+                   struct spnode **);
+RNODEPTR new_rnode(char *,int,struct htab *,u_int64_t,   /* referrer node */
+                   struct spnode **);
+ANODEPTR new_anode(char *,int,struct htab *,u_int64_t);  /* agent node    */
+SNODEPTR new_snode(char *,int,struct htab *,u_int64_t);  /* search string */
+INODEPTR new_inode(char *,int,struct htab *,u_int64_t);  /* ident node    */
 #ifdef USE_DNS
 DNODEPTR new_dnode(char *,int);               /* new DNS node             */
 #endif  /* USE_DNS */
 
-void     update_entry(char *,int);            /* update entry/exit        */
-void     update_exit(char *,int);             /* page totals              */
+void     update_entry(char *,int,u_int64_t);  /* update entry/exit        */
+void     update_exit(char *,int,int);         /* page totals              */
+
+static int  rec_ispage();                     /* current record info for  */
+static char *rec_lasturl(int *);              /* host/ident nodes, from   */
+static void rec_entry();                      /* log_rec or shard thread  */
+static void rec_exit(char *,int);
 
-unsigned int hash(char *,int len);            /* hash function            */
 
 /* local data */
 
-HNODEPTR sm_htab[MAXHASH];                    /* hash tables              */
-HNODEPTR sd_htab[MAXHASH];
-UNODEPTR um_htab[MAXHASH];                    /* for hits, sites,         */
-RNODEPTR rm_htab[MAXHASH];                    /* referrers and agents...  */
-ANODEPTR am_htab[MAXHASH];
-SNODEPTR sr_htab[MAXHASH];                    /* search string table      */
-INODEPTR im_htab[MAXHASH];                    /* ident table (username)   */
+struct htab sm_htab;                          /* hash tables              */
+struct htab sd_htab;
+struct htab um_htab;                          /* for hits, sites,         */
+struct htab rm_htab;                          /* referrers and agents...  */
+struct htab am_htab;
+struct htab sr_htab;                          /* search string table      */
+struct htab im_htab;                          /* ident table (username)   */
 #ifdef USE_DNS
 DNODEPTR host_table[MAXHASH];                 /* DNS hash table           */
 #endif  /* USE_DNS */
 
+#ifdef USE_THREADS
+__thread struct sh_url *sh_cur=NULL;          /* shard thread record info */
+#endif
+
+/* control bytes, a used slot has the top 7 bits of its hash */
+#define HT_EMPTY   0x80                       /* slot never used          */
+#define HT_MOVED   0xfe                       /* moved to new slot arrays */
+#define HT_TAG(h)  ((unsigned char)((h)>>57)) /* control byte for hash    */
+
+/* every node type starts with its string and length */
+struct ht_key { char *string;
+                int  slen; };
+
+/* string pool entry, the string follows it */
+struct spnode { char         *string;
+                int          slen;
+                unsigned int id; };           /* segment, then index      */
+
+#define SP_IDX   (1U<<(32-HT_SEGBITS))        /* max entries per segment  */
+
+/* table key for pool ID, the ID itself is the low 32 bits */
+#define SP_KEY(id) ((((u_int64_t)(id)*0x9e3779b97f4a7c15ULL)& \
+                    ~(u_int64_t)0xffffffff)|(id))
+
+static struct htab sp_htab;                   /* string pool              */
+static int         sp_gen=0;                  /* bumped when pool cleared */
+
+/* a record's URL, referrer and hostname are each looked up in the pool
+   several times in a row, so remember the last few found (per thread) */
+#define SP_MEMO    64                         /* entries (power of 2)     */
+
+struct sp_memo { struct spnode *sp;
+                 u_int64_t     h;
+                 int           gen; };
+
+#ifdef USE_THREADS
+static __thread struct sp_memo sp_memo[SP_MEMO];
+#else
+static struct sp_memo sp_memo[SP_MEMO];
+#endif
+
+/*********************************************/
+/* HT_MATCH - group control bytes equal to c */
+/*********************************************/
+
+static inline unsigned int ht_match(unsigned char *ctrl, unsigned char c)
+{
+#ifdef HT_SIMD
+   __m128i g=_mm_loadu_si128((__m128i *)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(g,_mm_set1_epi8((char)c)));
+#else
+   unsigned int m=0;
+   int          i;
+
+   for (i=0;i<HT_GROUP;i++) if (ctrl[i]==c) m|=1<<i;
+   return m;
+#endif
+}
+
+/*********************************************/
+/* HT_ALLOC - allocate empty slot arrays     */
+/*********************************************/
+
+static int ht_alloc(struct ht_arr *a, u_int64_t size)
+{
+   a->ctrl=malloc(size);
+   a->hv=malloc(size*sizeof(unsigned int));
+   a->node=malloc(size*sizeof(void *));
+   if (a->ctrl==NULL || a->hv==NULL || a->node==NULL)
+   {
+      free(a->ctrl); free(a->hv); free(a->node);
+      memset(a,0,sizeof(struct ht_arr));
+      return 1;
+   }
+   memset(a->ctrl,HT_EMPTY,size);
+   a->size=size;
+   return 0;
+}
+
+static void ht_free(struct ht_arr *a)
+{
+   free(a->ctrl); free(a->hv); free(a->node);
+   memset(a,0,sizeof(struct ht_arr));
+}
+
+/*********************************************/
+/* HT_PUT - put node in first free slot      */
+/*********************************************/
+
+/* A group and a regular node can have the same key.  Reports list
+   the newer one first (ties in the sorts keep table order), so the
+   two are swapped if needed.  Both have the same hash value, so
+   either slot is fine for either one.                               */
+
+static void ht_put(struct ht_arr *a, u_int64_t h, void *np, int newer)
+{
+   u_int64_t     g, n, j, t=0, mask=a->size/HT_GROUP-1;
+   unsigned int  m, e;
+   struct ht_key k1, k2;
+   void          *tp;
+
+   /* caller makes sure there is a free slot */
+   memcpy(&k1,np,sizeof(k1));
+   g=(h>>HT_SEGBITS)&mask;
+   for (n=1;;n++)
+   {
+      for (m=ht_match(a->ctrl+g*HT_GROUP,HT_TAG(h));m;m&=m-1)
+      {
+         j=g*HT_GROUP+__builtin_ctz(m);
+         if (a->hv[j]!=(unsigned int)h) continue;
+         memcpy(&k2,a->node[j],sizeof(k2));
+         if (k1.slen==k2.slen && strcmp(k1.string,k2.string)==0) t=j+1;
+      }
+      if ((e=ht_match(a->ctrl+g*HT_GROUP,HT_EMPTY))!=0) break;
+      g=(g+n)&mask;
+   }
+
+   j=g*HT_GROUP+__builtin_ctz(e);
+   a->ctrl[j]=HT_TAG(h);
+   a->hv[j]=h;
+   a->node[j]=np;
+
+   if (t-- && (newer?(t<j):(t>j)))            /* keep newer one first     */
+      { tp=a->node[t]; a->node[t]=np; a->node[j]=tp; }
+}
+
+/*********************************************/
+/* HT_MOVE - move some old groups over       */
+/*********************************************/
+
+static void ht_move(struct ht_seg *s, u_int64_t n)
+{
+   struct ht_arr *o=&s->old;
+   u_int64_t     i, j;
+
+   while (n-- && s->move<o->size/HT_GROUP)
+   {
+      /* the control byte and low 32 bits are all of the hash that */
+      /* ht_put() uses.  Leave a marker, so lookups still go past. */
+      for (i=0,j=s->move++*HT_GROUP;i<HT_GROUP;i++,j++)
+      {
+         if (o->ctrl[j]&HT_EMPTY) continue;
+         ht_put(&s->cur,(u_int64_t)o->ctrl[j]<<57|o->hv[j],o->node[j],0);
+         o->ctrl[j]=HT_MOVED;
+      }
+   }
+
+   if (s->move==o->size/HT_GROUP)             /* all done                 */
+   {
+      ht_free(o);
+      s->move=0;
+   }
+}
+
+/*********************************************/
+/* HT_GROW - double segment slot arrays      */
+/*********************************************/
+
+static int ht_grow(struct ht_seg *s)
+{
+   struct ht_arr a;
+
+   if (s->old.size) ht_move(s,s->old.size);   /* finish last one first    */
+   if (s->cur.size>=HT_MAXSIZE || ht_alloc(&a,s->cur.size*2)) return 1;
+   s->old=s->cur; s->cur=a;
+   s->move=0;
+   return 0;
+}
+
+/*********************************************/
+/* HT_LOOK - next node matching probe key    */
+/*********************************************/
+
+static void ht_group(struct ht_probe *p)
+{
+   unsigned char *cp=p->a->ctrl+p->g*HT_GROUP;
+
+   p->m=ht_match(cp,HT_TAG(p->h));
+   p->end=(ht_match(cp,HT_EMPTY)!=0);
+}
+
+static void ht_start(struct ht_probe *p, struct ht_arr *a)
+{
+   p->a=a;
+   p->g=(p->h>>HT_SEGBITS)&(a->size/HT_GROUP-1);
+   p->n=0;
+   ht_group(p);
+}
+
+static void *ht_look(struct ht_probe *p)
+{
+   struct ht_arr *a;
+   struct ht_key k;
+   u_int64_t     j;
+
+   while (1)
+   {
+      a=p->a;
+      while (p->m)
+      {
+         j=p->g*HT_GROUP+__builtin_ctz(p->m);
+         p->m&=p->m-1;
+         if (a->hv[j]!=(unsigned int)p->h) continue; /* tag only         */
+         if (p->str==NULL) return a->node[j];        /* hv is the ID     */
+         memcpy(&k,a->node[j],sizeof(k));
+         if (k.slen==p->len && strcmp(k.string,p->str)==0) return a->node[j];
+      }
+
+      /* an empty slot ends the probe, try old slots if still moving */
+      if (p->end || ++p->n>a->size/HT_GROUP-1)
+      {
+         if (a==&p->s->cur && p->s->old.size) { ht_start(p,&p->s->old); continue; }
+         return NULL;
+      }
+      p->g=(p->g+p->n)&(a->size/HT_GROUP-1);
+      ht_group(p);
+   }
+}
+
+/*********************************************/
+/* HT_NODE - node memory from segment arena  */
+/*********************************************/
+
+/* Nodes (with their strings) are carved out of blocks owned by the
+   segment they go in, so only the thread changing a segment uses its
+   arena.  Nothing is freed until the table is cleared, which just
+   rewinds the arenas and keeps the blocks for next time.            */
+
+static void *ht_node(struct htab *t, u_int64_t h, int size)
+{
+   struct ht_seg *s=&t->seg[HT_SEG(h)];
+   struct ht_blk *b, *nb;
+   u_int64_t     n;
+   char          *np;
+
+   size=(size+7)&~7;                          /* keep nodes aligned       */
+   if (s->ap==NULL || s->aend-s->ap<size)
+   {
+      b=s->ablk;
+      if (b!=NULL && b->next!=NULL && b->next->size>=(u_int64_t)size)
+         b=b->next;                           /* kept from last time      */
+      else
+      {
+         n=(b==NULL)?HT_BLKMIN:(b->size<HT_BLKMAX)?b->size*2:HT_BLKMAX;
+         if (n<(u_int64_t)size) n=size;
+         if ((nb=malloc(sizeof(struct ht_blk)+n))==NULL) return NULL;
+         nb->size=n;
+         if (b==NULL) { nb->next=s->blk; s->blk=nb; }
+         else { nb->next=b->next; b->next=nb; }
+         b=nb;
+      }
+      s->ablk=b;
+      s->ap=(char *)(b+1);
+      s->aend=s->ap+b->size;
+   }
+   np=s->ap;
+   s->ap+=size;
+   return np;
+}
+
+/*********************************************/
+/* HT_FIND - find first node with key        */
+/*********************************************/
+
+/* More than one node can have the same key (a group and a regular
+   node with the same name), ht_again() gives the next one.  Tables
+   keyed on pool IDs pass a NULL string and SP_KEY() as the hash.    */
+
+void *ht_find(struct htab *t, u_int64_t h, char *str, int len,
+              struct ht_probe *p)
+{
+   p->s=&t->seg[HT_SEG(h)];
+   if (p->s->cur.size==0) return NULL;
+   p->str=str; p->len=len; p->h=h;
+   ht_start(p,&p->s->cur);
+   return ht_look(p);
+}
+
+/*********************************************/
+/* HT_AGAIN - find next node with same key   */
+/*********************************************/
+
+void *ht_again(struct ht_probe *p)
+{
+   return ht_look(p);
+}
+
+/*********************************************/
+/* HT_ADD - add node to table                */
+/*********************************************/
+
+int ht_add(struct htab *t, u_int64_t h, void *np)
+{
+   struct ht_seg *s=&t->seg[HT_SEG(h)];
+
+   if (s->cur.size==0 && ht_alloc(&s->cur,HT_MINSIZE)) return 1;
+
+   if (s->old.size) ht_move(s,HT_MOVE);
+   else if ((s->used+1)*8>s->cur.size*7 && ht_grow(s))
+   {
+      /* can't grow, so fill it up (but always leave an empty slot) */
+      if (s->used+1>=s->cur.size) return 1;
+   }
+
+   ht_put(&s->cur,h,np,1);
+   s->used++;
+   return 0;
+}
+
+/*********************************************/
+/* HT_FIRST - start walking a table          */
+/*********************************************/
+
+void *ht_first(struct htab *t, struct ht_pos *p)
+{
+   p->seg=0; p->old=0; p->i=0;
+   return ht_next(t,p);
+}
+
+/*********************************************/
+/* HT_NEXT - next node in table (NULL=done)  */
+/*********************************************/
+
+void *ht_next(struct htab *t, struct ht_pos *p)
+{
+   struct ht_arr *a;
+   u_int64_t     j;
+
+   while (p->seg<HT_SEGS)
+   {
+      a=(p->old)?&t->seg[p->seg].old:&t->seg[p->seg].cur;
+      while (p->i<a->size)
+      {
+         j=p->i++;
+         if (!(a->ctrl[j]&HT_EMPTY)) return a->node[j];
+      }
+      p->i=0;
+      if (p->old) p->seg++;
+      p->old=!p->old;
+   }
+   return NULL;
+}
+
+/*********************************************/
+/* HT_CLEAR - free all nodes in a table      */
+/*********************************************/
+
+void ht_clear(struct htab *t)
+{
+   struct ht_seg *s;
+   int    i;
+
+   /* keep the slots and arena blocks, next time will need as many */
+   for (i=0;i<HT_SEGS;i++)
+   {
+      s=&t->seg[i];
+      if (s->cur.size) memset(s->cur.ctrl,HT_EMPTY,s->cur.size);
+      ht_free(&s->old);
+      s->used=s->move=0;
+      s->ablk=s->blk;                         /* free all nodes           */
+      s->ap=(s->blk)?(char *)(s->blk+1):NULL;
+      s->aend=(s->blk)?s->ap+s->blk->size:NULL;
+   }
+}
+
+/*********************************************/
+/* HT_SIZE - pre-size (empty) table slots    */
+/*********************************************/
+
+void ht_size(struct htab *t, u_int64_t n)
+{
+   struct ht_seg *s;
+   struct ht_arr a;
+   u_int64_t     size;
+   int           i;
+
+   for (size=HT_MINSIZE;size*HT_SEGS<n && size<HT_MAXSIZE;size*=2);
+
+   for (i=0;i<HT_SEGS;i++)
+   {
+      s=&t->seg[i];
+      if (s->used || s->cur.size>=size) continue;
+      if (ht_alloc(&a,size)) return;
+      ht_free(&s->cur);
+      s->cur=a;
+   }
+}
+
+/*********************************************/
+/* HT_SLOTS - total slots in a table         */
+/*********************************************/
+
+u_int64_t ht_slots(struct htab *t)
+{
+   u_int64_t n=0;
+   int       i;
+
+   for (i=0;i<HT_SEGS;i++) n+=t->seg[i].cur.size+t->seg[i].old.size;
+   return n;
+}
+
+/*********************************************/
+/* SP_FIND - find string in pool             */
+/*********************************************/
+
+/* The URL, referrer and site tables don't keep their own copy of a
+   key, each distinct string is stored once in the pool and gets a 32
+   bit ID.  The tables are keyed on the ID (kept in the slot hv array
+   in place of the hash bits), so only the pool ever compares strings,
+   and host lasturl, daily and monthly sites and referrers that are
+   also URLs all share one copy.  The ID starts with the segment of
+   the string's hash, so a string and all of the nodes keyed on it
+   live in segments changed by the same shard thread.                */
+
+static struct spnode *sp_find(char *str, int len, u_int64_t h)
+{
+   struct spnode   *sp;
+   struct sp_memo  *m=&sp_memo[(h>>HT_SEGBITS)&(SP_MEMO-1)];
+   struct ht_probe hp;
+
+   if (m->sp!=NULL && m->h==h && m->gen==sp_gen && m->sp->slen==len &&
+       strcmp(m->sp->string,str)==0) return m->sp;
+
+   if ( (sp=ht_find(&sp_htab,h,str,len,&hp))!=NULL )
+      { m->sp=sp; m->h=h; m->gen=sp_gen; }
+   return sp;
+}
+
+/*********************************************/
+/* SP_NODE - new node (and pool string)      */
+/*********************************************/
+
+/* A string new to the pool is stored right after the first node that
+   uses it, so it is still next to its node.  That is in the arena of
+   the node's table, which is never cleared before the pool, except
+   for the daily site table, whose strings go in the monthly one.    */
+
+static void *sp_node(struct htab *t, int size, char *str, int len,
+                     u_int64_t h, struct spnode **spp)
+{
+   struct spnode *sp=*spp;
+   struct sp_memo *m;
+   u_int64_t     n;
+   void          *np;
+
+   size=(size+7)&~7;                          /* keep string aligned      */
+   if (sp!=NULL) return ht_node(t,h,size);    /* already pooled           */
+
+   n=sp_htab.seg[HT_SEG(h)].used+1;           /* index 0 is never used    */
+   if (n>=SP_IDX) return NULL;                /* out of IDs               */
+   if (t==&sd_htab)
+   {
+      if ( (np=ht_node(t,h,size))==NULL ||
+           (sp=ht_node(&sm_htab,h,sizeof(struct spnode)+len+1))==NULL )
+         return NULL;
+   }
+   else
+   {
+      if ( (np=ht_node(t,h,size+sizeof(struct spnode)+len+1))==NULL )
+         return NULL;
+      sp=(struct spnode *)((char *)np+size);
+   }
+   sp->string=(char *)(sp+1);
+   sp->slen  =len;
+   sp->id    =(unsigned int)(n<<HT_SEGBITS|HT_SEG(h));
+   memcpy(sp->string,str,len); sp->string[len]='\0';
+   if (ht_add(&sp_htab,h,sp)) return NULL;
+
+   m=&sp_memo[(h>>HT_SEGBITS)&(SP_MEMO-1)];
+   m->sp=sp; m->h=h; m->gen=sp_gen;
+   *spp=sp;
+   return np;
+}
+
+/*********************************************/
+/* SP_LASTURL - pool entry for host lasturl  */
+/*********************************************/
+
+/* lasturl is the pool copy of a URL, or blank_str if there was none
+   (no URL node is ever empty, fix_record() makes those "/").        */
+
+static struct spnode *sp_lasturl(char *str)
+{
+   return (str==blank_str)?NULL:(struct spnode *)str-1;
+}
+
 /*********************************************/
 /* DEL_HTABS - clear out our hash tables     */
 /*********************************************/
 
 void del_htabs()
 {
-   del_hlist(sd_htab);                        /* Clear out our various    */
-   del_ulist(um_htab);                        /* hash tables here by      */
-   del_hlist(sm_htab);                        /* calling the appropriate  */
-   del_rlist(rm_htab);                        /* del_* fuction for each   */
-   del_alist(am_htab);
-   del_slist(sr_htab);
-   del_ilist(im_htab);
+   del_hlist(&sd_htab);                       /* Clear out our various    */
+   del_ulist(&um_htab);                       /* hash tables here by      */
+   del_hlist(&sm_htab);                       /* calling the appropriate  */
+   del_rlist(&rm_htab);                       /* del_* fuction for each   */
+   del_alist(&am_htab);
+   del_slist(&sr_htab);
+   del_ilist(&im_htab);
+   ht_clear(&sp_htab);                        /* string pool, after tables*/
+   sp_gen++;                                  /* forget memo entries      */
 #ifdef USE_DNS
 /* del_dlist(host_table);  */                    /* delete DNS hash table    */
 #endif  /* USE_DNS */
@@ -110,32 +615,22 @@ void del_htabs()
 /* NEW_HNODE - create host node              */
 /*********************************************/
 
-HNODEPTR new_hnode(char *str, int len)
+HNODEPTR new_hnode(char *str, int len, struct htab *htab, u_int64_t hval,
+                  struct spnode **spp)
 {
    HNODEPTR newptr;
+   struct spnode *sp;
 
-   if (len >= MAXHOST)
+   if (( newptr = sp_node(htab,sizeof(struct hnode),str,len,hval,
+                          spp)) != NULL)
    {
-      if (verbose)
-      {
-         fprintf(stderr,"[new_hnode] %s (%d)",msg_big_one,len);
-         if (debug_mode)
-            fprintf(stderr,":\n--> %s",str);
-         fprintf(stderr,"\n");
-      }
-      str[MAXHOST-1]=0;
-	  len=MAXHOST-1;
-   }
-
-   if (( newptr = malloc(sizeof(struct hnode)+len+1)) != NULL)
-   {
-      newptr->string    =(char *)(newptr+1);
+      sp=*spp;
+      newptr->string    =sp->string;
 	  newptr->slen      =len;
       newptr->visit     =0;
       newptr->tstamp    =0;
       newptr->lasturl   =blank_str;
       newptr->llen      =0;
-	  strcpy(newptr->string,str);
    }
    return newptr;
 }
@@ -146,6 +641,7 @@ HNODEPTR new_hnode(char *str, int len)
 
 int put_hnode( char      *str,  /* Hostname  */
                int       len,   /* name len  */
+               u_int64_t hval,  /* name hash */
                int       type,  /* obj type  */
                u_int64_t count, /* hit count */
                u_int64_t file,  /* File flag */
@@ -155,109 +651,81 @@ int put_hnode( char      *str,  /* Hostname  */
                u_int64_t tstamp,/* timestamp */
                char      *lasturl, /* lasturl */
                int       llen,   /* lasturl len  */
-               HNODEPTR  *htab)  /* ptr>next  */
+               struct htab *htab)  /* ptr>next  */
 {
    HNODEPTR cptr,nptr;
-   unsigned int hval;
+   struct spnode *sp;
+   struct ht_probe hp;
 
-   /* check if hashed */
-   hval=hash(str,len);
-   if ( (cptr = htab[hval]) == NULL)
+   if (len >= MAXHOST)
    {
-      /* not hashed */
-      if ( (nptr=new_hnode(str,len)) != NULL)
+      if (verbose)
       {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->files = file;
-         nptr->xfer  = xfer;
-         nptr->next  = NULL;
-         htab[hval] = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
-
-         if (visit)
-         {
-            nptr->visit=(visit-1);
-			nptr->llen = llen;
-            nptr->lasturl=find_url(lasturl, &nptr->llen);
-            nptr->tstamp=tstamp;
-            return 0;
-         }
-         else
-         {
-            if (ispage(log_rec.url,log_rec.urllen))
-            {
-               if (htab==sm_htab) update_entry(log_rec.url,log_rec.urllen);
-			   nptr->llen = log_rec.urllen;
-               nptr->lasturl=find_url(log_rec.url,&nptr->llen);
-               nptr->tstamp=tstamp;
-               nptr->visit=1;
-            }
-         }
+         fprintf(stderr,"[put_hnode] %s (%d)",msg_big_one,len);
+         if (debug_mode)
+            fprintf(stderr,":\n--> %s",str);
+         fprintf(stderr,"\n");
       }
+      str[MAXHOST-1]=0;
+	  len=MAXHOST-1;
    }
-   else
+
+   /* check if hashed */
+   sp=sp_find(str,len,hval);
+   for (cptr=(sp)?ht_find(htab,SP_KEY(sp->id),NULL,0,&hp):NULL;cptr!=NULL;
+        cptr=ht_again(&hp))
    {
-      while (cptr != NULL)
+      if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
       {
-         if (cptr->slen == len && strcmp(cptr->string,str)==0)
+         /* found... bump counter */
+         cptr->count+=count;
+         cptr->files+=file;
+         cptr->xfer +=xfer;
+
+         if (rec_ispage())
          {
-            if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
+            if ((tstamp-cptr->tstamp)>=visit_timeout)
             {
-               /* found... bump counter */
-               cptr->count+=count;
-               cptr->files+=file;
-               cptr->xfer +=xfer;
-
-               if (ispage(log_rec.url,log_rec.urllen))
+               cptr->visit++;
+               if (htab==&sm_htab)
                {
-                  if ((tstamp-cptr->tstamp)>=visit_timeout)
-                  {
-                     cptr->visit++;
-                     if (htab==sm_htab)
-                     {
-                        update_exit(cptr->lasturl,cptr->llen);
-                        update_entry(log_rec.url,log_rec.urllen);
-                     }
-                  }
-				  cptr->llen = log_rec.urllen;
-                  cptr->lasturl=find_url(log_rec.url,&cptr->llen);
-                  cptr->tstamp=tstamp;
+                  rec_exit(cptr->lasturl,cptr->llen);
+                  rec_entry();
                }
-               return 0;
             }
+            cptr->lasturl=rec_lasturl(&cptr->llen);
+            cptr->tstamp=tstamp;
          }
-         cptr = cptr->next;
+         return 0;
       }
-      /* not found... */
-      if ( (nptr = new_hnode(str,len)) != NULL)
-      {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->files = file;
-         nptr->xfer  = xfer;
-         nptr->next  = htab[hval];
-         htab[hval]=nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+   }
 
-         if (visit)
+   /* not found... */
+   if ( (nptr = new_hnode(str,len,htab,hval,&sp)) != NULL)
+   {
+      nptr->flag  = type;
+      nptr->count = count;
+      nptr->files = file;
+      nptr->xfer  = xfer;
+      if (ht_add(htab,SP_KEY(sp->id),nptr)) return 1;
+      if (type!=OBJ_GRP) (*ctr)++;
+
+      if (visit)
+      {
+         nptr->visit = (visit-1);
+         nptr->llen = llen;
+         nptr->lasturl=find_url(lasturl,&nptr->llen,hash(lasturl,llen));
+         nptr->tstamp= tstamp;
+         return 0;
+      }
+      else
+      {
+         if (rec_ispage())
          {
-            nptr->visit = (visit-1);
-			nptr->llen = llen;
-            nptr->lasturl=find_url(lasturl,&nptr->llen);
+            if (htab==&sm_htab) rec_entry();
+            nptr->lasturl=rec_lasturl(&nptr->llen);
             nptr->tstamp= tstamp;
-            return 0;
-         }
-         else
-         {
-            if (ispage(log_rec.url,log_rec.urllen))
-            {
-               if (htab==sm_htab) update_entry(log_rec.url,log_rec.urllen);
-			   nptr->llen = log_rec.urllen;
-               nptr->lasturl=find_url(log_rec.url,&nptr->llen);
-               nptr->tstamp= tstamp;
-               nptr->visit=1;
-            }
+            nptr->visit=1;
          }
       }
    }
@@ -280,55 +748,28 @@ int put_hnode( char      *str,  /* Hostname  */
 /* DEL_HLIST - delete host hash table        */
 /*********************************************/
 
-void	del_hlist(HNODEPTR *htab)
+void	del_hlist(struct htab *htab)
 {
-   /* free memory used by hash table */
-   HNODEPTR aptr,temp;
-   int i;
-
-   for (i=0;i<MAXHASH;i++)
-   {
-      if (htab[i] != NULL)
-      {
-         aptr = htab[i];
-         while (aptr != NULL)
-         {
-            temp = aptr->next;
-            free (aptr);            /* free hostname structure    */
-            aptr = temp;
-         }
-         htab[i]=NULL;
-      }
-   }
+   ht_clear(htab);                            /* free all the nodes       */
 }
 
 /*********************************************/
 /* NEW_UNODE - URL node creation             */
 /*********************************************/
 
-UNODEPTR new_unode(char *str, int len)
+UNODEPTR new_unode(char *str, int len, struct htab *htab, u_int64_t hval,
+                  struct spnode **spp)
 {
    UNODEPTR newptr;
+   struct spnode *sp;
 
-   if (len >= MAXURLH)
+   if (( newptr = sp_node(htab,sizeof(struct unode),str,len,hval,
+                          spp)) != NULL)
    {
-      if (verbose)
-      {
-         fprintf(stderr,"[new_unode] %s (%d)",msg_big_one,len);
-         if (debug_mode)
-            fprintf(stderr,":\n--> %s",str);
-         fprintf(stderr,"\n");
-      }
-      str[MAXURLH-1]=0;
-	  len=MAXURLH-1;
-   }
-
-   if (( newptr = malloc(sizeof(struct unode)+len+1)) != NULL)
-   {
-      newptr->string=(char *)(newptr+1);
+      sp=*spp;
+      newptr->string=sp->string;
 	  newptr->slen = len;
       newptr->files = 0;
-	  strcpy(newptr->string,str);
    }
    return newptr;
 }
@@ -337,61 +778,54 @@ UNODEPTR new_unode(char *str, int len)
 /* PUT_UNODE - insert/update URL node        */
 /*********************************************/
 
-int put_unode(char *str, int len, int type, u_int64_t count, double xfer,
-              u_int64_t *ctr, u_int64_t entry, u_int64_t exit, UNODEPTR *htab)
+int put_unode(char *str, int len, u_int64_t hval, int type, u_int64_t count,
+              double xfer, u_int64_t *ctr, u_int64_t entry, u_int64_t exit,
+              struct htab *htab)
 {
    UNODEPTR cptr,nptr;
-   unsigned int hval;
+   struct spnode *sp;
+   struct ht_probe hp;
 
    if (str[0]=='-') return 0;
 
-   hval = hash(str,len);
-   /* check if hashed */
-   if ( (cptr = htab[hval]) == NULL)
+   if (len >= MAXURLH)
    {
-      /* not hashed */
-      if ( (nptr=new_unode(str,len)) != NULL)
+      if (verbose)
       {
-         nptr->flag = type;
-         nptr->count= count;
-         nptr->xfer = xfer;
-         nptr->next = NULL;
-         nptr->entry= entry;
-         nptr->exit = exit;
-         htab[hval] = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+         fprintf(stderr,"[put_unode] %s (%d)",msg_big_one,len);
+         if (debug_mode)
+            fprintf(stderr,":\n--> %s",str);
+         fprintf(stderr,"\n");
       }
+      str[MAXURLH-1]=0;
+	  len=MAXURLH-1;
    }
-   else
-   {
-      /* hashed */
-      while (cptr != NULL)
-      {
-         if (cptr->slen == len && strcmp(cptr->string,str)==0)
-         {
-            if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
-            {
-               /* found... bump counter */
-               cptr->count+=count;
-               cptr->xfer += xfer;
-               return 0;
-            }
-         }
-         cptr = cptr->next;
-      }
-      /* not found... */
-      if ( (nptr = new_unode(str,len)) != NULL)
+
+   /* check if hashed */
+   sp=sp_find(str,len,hval);
+   for (cptr=(sp)?ht_find(htab,SP_KEY(sp->id),NULL,0,&hp):NULL;cptr!=NULL;
+        cptr=ht_again(&hp))
+   {
+      if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
       {
-         nptr->flag = type;
-         nptr->count= count;
-         nptr->xfer = xfer;
-         nptr->next = htab[hval];
-         nptr->entry= entry;
-         nptr->exit = exit;
-         htab[hval] = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+         /* found... bump counter */
+         cptr->count+=count;
+         cptr->xfer += xfer;
+         return 0;
       }
    }
+
+   /* not found... */
+   if ( (nptr = new_unode(str,len,htab,hval,&sp)) != NULL)
+   {
+      nptr->flag = type;
+      nptr->count= count;
+      nptr->xfer = xfer;
+      nptr->entry= entry;
+      nptr->exit = exit;
+      if (ht_add(htab,SP_KEY(sp->id),nptr)) return 1;
+      if (type!=OBJ_GRP) (*ctr)++;
+   }
    if (nptr!=NULL)
    {
       if (type==OBJ_GRP) nptr->flag=OBJ_GRP;
@@ -405,56 +839,29 @@ int put_unode(char *str, int len, int type, u_int64_t count, double xfer,
 /* DEL_ULIST - delete URL hash table         */
 /*********************************************/
 
-void	del_ulist(UNODEPTR *htab)
+void	del_ulist(struct htab *htab)
 {
-   /* free memory used by hash table */
-   UNODEPTR aptr,temp;
-   int i;
-
-   for (i=0;i<MAXHASH;i++)
-   {
-      if (htab[i] != NULL)
-      {
-         aptr = htab[i];
-         while (aptr != NULL)
-         {
-            temp = aptr->next;
-            free (aptr);          /* free up URL struct node   */
-            aptr = temp;
-         }
-         htab[i]=NULL;
-      }
-   }
+   ht_clear(htab);                            /* free all the nodes       */
 }
 
 /*********************************************/
 /* NEW_RNODE - Referrer node creation        */
 /*********************************************/
 
-RNODEPTR new_rnode(char *str,int len)
+RNODEPTR new_rnode(char *str, int len, struct htab *htab, u_int64_t hval,
+                  struct spnode **spp)
 {
    RNODEPTR newptr;
+   struct spnode *sp;
 
-   if (len >= MAXREFH)
-   {
-      if (verbose)
-      {
-         fprintf(stderr,"[new_rnode] %s (%d)",msg_big_one,len);
-         if (debug_mode)
-            fprintf(stderr,":\n--> %s",str);
-         fprintf(stderr,"\n");
-      }
-      str[MAXREFH-1]=0;
-	  len=MAXREFH-1;
-   }
-
-   if (( newptr = malloc(sizeof(struct rnode)+len+1)) != NULL)
+   if (( newptr = sp_node(htab,sizeof(struct rnode),str,len,hval,
+                          spp)) != NULL)
    {
-      newptr->string= (char *)(newptr+1);;
+      sp=*spp;
+      newptr->string= sp->string;
 	  newptr->slen  = len;
       newptr->count = 1;
       newptr->flag  = OBJ_REG;
-	  strcpy(newptr->string,str);
    }
    return newptr;
 }
@@ -463,56 +870,53 @@ RNODEPTR new_rnode(char *str,int len)
 /* PUT_RNODE - insert/update referrer node   */
 /*********************************************/
 
-int put_rnode(char *str, int len, int type, u_int64_t count,
-              u_int64_t *ctr, RNODEPTR *htab)
+int put_rnode(char *str, int len, u_int64_t hval, int type, u_int64_t count,
+              u_int64_t *ctr, struct htab *htab)
 {
    RNODEPTR cptr,nptr;
-   unsigned int hval;
+   struct spnode *sp;
+   struct ht_probe hp;
 
    if (str[0]=='-') {
      strcpy(str,"- (Direct Request)");
 	 len=sizeof("- (Direct Request)")-1;
+	 hval=hash(str,len);                     /* new key, new hash */
    }
 
-   hval = hash(str,len);
-   /* check if hashed */
-   if ( (cptr = htab[hval]) == NULL)
+   if (len >= MAXREFH)
    {
-      /* not hashed */
-      if ( (nptr=new_rnode(str,len)) != NULL)
+      if (verbose)
       {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->next  = NULL;
-         htab[hval]  = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+         fprintf(stderr,"[put_rnode] %s (%d)",msg_big_one,len);
+         if (debug_mode)
+            fprintf(stderr,":\n--> %s",str);
+         fprintf(stderr,"\n");
       }
+      str[MAXREFH-1]=0;
+	  len=MAXREFH-1;
    }
-   else
+
+   /* check if hashed */
+   sp=sp_find(str,len,hval);
+   for (cptr=(sp)?ht_find(htab,SP_KEY(sp->id),NULL,0,&hp):NULL;cptr!=NULL;
+        cptr=ht_again(&hp))
    {
-      while (cptr != NULL)
+      if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
       {
-         if (cptr->slen == len && strcmp(cptr->string,str)==0)
-         {
-            if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
-            {
-               /* found... bump counter */
-               cptr->count+=count;
-               return 0;
-            }
-         }
-         cptr = cptr->next;
-      }
-      /* not found... */
-      if ( (nptr = new_rnode(str,len)) != NULL)
-      {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->next  = htab[hval];
-         htab[hval]  = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+         /* found... bump counter */
+         cptr->count+=count;
+         return 0;
       }
    }
+
+   /* not found... */
+   if ( (nptr = new_rnode(str,len,htab,hval,&sp)) != NULL)
+   {
+      nptr->flag  = type;
+      nptr->count = count;
+      if (ht_add(htab,SP_KEY(sp->id),nptr)) return 1;
+      if (type!=OBJ_GRP) (*ctr)++;
+   }
    if (nptr!=NULL)
    {
       if (type==OBJ_GRP) nptr->flag=OBJ_GRP;
@@ -526,33 +930,16 @@ int put_rnode(char *str, int len, int type, u_int64_t count,
 /* DEL_RLIST - delete referrer hash table    */
 /*********************************************/
 
-void	del_rlist(RNODEPTR *htab)
+void	del_rlist(struct htab *htab)
 {
-   /* free memory used by hash table */
-   RNODEPTR aptr,temp;
-   int i;
-
-   for (i=0;i<MAXHASH;i++)
-   {
-      if (htab[i] != NULL)
-      {
-         aptr = htab[i];
-         while (aptr != NULL)
-         {
-            temp = aptr->next;
-            free (aptr);
-            aptr = temp;
-         }
-         htab[i]=NULL;
-      }
-   }
+   ht_clear(htab);                            /* free all the nodes       */
 }
 
 /*********************************************/
 /* NEW_ANODE - User Agent node creation      */
 /*********************************************/
 
-ANODEPTR new_anode(char *str,int len)
+ANODEPTR new_anode(char *str, int len, struct htab *htab, u_int64_t hval)
 {
    ANODEPTR newptr;
 
@@ -569,7 +956,7 @@ ANODEPTR new_anode(char *str,int len)
 	  len=MAXAGENT-1;
    }
 
-   if (( newptr = malloc(sizeof(struct anode)+len+1)) != NULL)
+   if (( newptr = ht_node(htab,hval,sizeof(struct anode)+len+1)) != NULL)
    {
       newptr->string= (char *)(newptr+1);;
 	  newptr->slen  = len;
@@ -584,53 +971,32 @@ ANODEPTR new_anode(char *str,int len)
 /* PUT_ANODE - insert/update user agent node */
 /*********************************************/
 
-int put_anode(char *str, int len, int type, u_int64_t count,
-              u_int64_t *ctr, ANODEPTR *htab)
+int put_anode(char *str, int len, u_int64_t hval, int type, u_int64_t count,
+              u_int64_t *ctr, struct htab *htab)
 {
    ANODEPTR cptr,nptr;
-   unsigned int hval;
+   struct ht_probe hp;
 
    if (str[0]=='-') return 0;     /* skip bad user agents */
 
-   hval = hash(str,len);
    /* check if hashed */
-   if ( (cptr = htab[hval]) == NULL)
+   for (cptr=ht_find(htab,hval,str,len,&hp);cptr!=NULL;cptr=ht_again(&hp))
    {
-      /* not hashed */
-      if ( (nptr=new_anode(str,len)) != NULL)
+      if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
       {
-         nptr->flag = type;
-         nptr->count= count;
-         nptr->next = NULL;
-         htab[hval] = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+         /* found... bump counter */
+         cptr->count+=count;
+         return 0;
       }
    }
-   else
+
+   /* not found... */
+   if ( (nptr = new_anode(str,len,htab,hval)) != NULL)
    {
-      /* hashed */
-      while (cptr != NULL)
-      {
-         if (cptr->slen == len && strcmp(cptr->string,str)==0)
-         {
-            if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
-            {
-               /* found... bump counter */
-               cptr->count+=count;
-               return 0;
-            }
-         }
-         cptr = cptr->next;
-      }
-      /* not found... */
-      if ( (nptr = new_anode(str,len)) != NULL)
-      {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->next  = htab[hval];
-         htab[hval]  = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
-      }
+      nptr->flag  = type;
+      nptr->count = count;
+      if (ht_add(htab,hval,nptr)) return 1;
+      if (type!=OBJ_GRP) (*ctr)++;
    }
    if (type==OBJ_GRP) nptr->flag=OBJ_GRP;
    else if (isinlist(hidden_agents,nptr->string,nptr->slen)!=NULL)
@@ -642,33 +1008,16 @@ int put_anode(char *str, int len, int type, u_int64_t count,
 /* DEL_ALIST - delete user agent hash table  */
 /*********************************************/
 
-void	del_alist(ANODEPTR *htab)
+void	del_alist(struct htab *htab)
 {
-   /* free memory used by hash table */
-   ANODEPTR aptr,temp;
-   int i;
-
-   for (i=0;i<MAXHASH;i++)
-   {
-      if (htab[i] != NULL)
-      {
-         aptr = htab[i];
-         while (aptr != NULL)
-         {
-            temp = aptr->next;
-            free (aptr);
-            aptr = temp;
-         }
-         htab[i]=NULL;
-      }
-   }
+   ht_clear(htab);                            /* free all the nodes       */
 }
 
 /*********************************************/
 /* NEW_SNODE - Search str node creation      */
 /*********************************************/
 
-SNODEPTR new_snode(char *str,int len)
+SNODEPTR new_snode(char *str, int len, struct htab *htab, u_int64_t hval)
 {
    SNODEPTR newptr;
 
@@ -685,7 +1034,7 @@ SNODEPTR new_snode(char *str,int len)
 	  len=MAXSRCHH-1;
    }
 
-   if (( newptr = malloc(sizeof(struct snode)+len+1)) != NULL)
+   if (( newptr = ht_node(htab,hval,sizeof(struct snode)+len+1)) != NULL)
    {
       newptr->string= (char *)(newptr+1);;
 	  newptr->slen  = len;
@@ -699,45 +1048,27 @@ SNODEPTR new_snode(char *str,int len)
 /* PUT_SNODE - insert/update search str node */
 /*********************************************/
 
-int put_snode(char *str, int len, u_int64_t count, SNODEPTR *htab)
+int put_snode(char *str, int len, u_int64_t hval, u_int64_t count,
+              struct htab *htab)
 {
    SNODEPTR cptr,nptr;
-   unsigned int hval;
+   struct ht_probe hp;
 
    if (str[0]==0 || str[0]==' ') return 0;     /* skip bad search strs */
 
-   hval=hash(str,len);
    /* check if hashed */
-   if ( (cptr = htab[hval]) == NULL)
+   for (cptr=ht_find(htab,hval,str,len,&hp);cptr!=NULL;cptr=ht_again(&hp))
    {
-      /* not hashed */
-      if ( (nptr=new_snode(str,len)) != NULL)
-      {
-         nptr->count = count;
-         nptr->next = NULL;
-         htab[hval] = nptr;
-      }
+      /* found... bump counter */
+      cptr->count+=count;
+      return 0;
    }
-   else
+
+   /* not found... */
+   if ( (nptr = new_snode(str,len,htab,hval)) != NULL)
    {
-      /* hashed */
-      while (cptr != NULL)
-      {
-         if (cptr->slen==len && strcmp(cptr->string,str)==0)
-         {
-            /* found... bump counter */
-            cptr->count+=count;
-            return 0;
-         }
-         cptr = cptr->next;
-      }
-      /* not found... */
-      if ( (nptr = new_snode(str,len)) != NULL)
-      {
-         nptr->count = count;
-         nptr->next  = htab[hval];
-         htab[hval]  = nptr;
-      }
+      nptr->count = count;
+      if (ht_add(htab,hval,nptr)) return 1;
    }
    return nptr==NULL;
 }
@@ -746,33 +1077,16 @@ int put_snode(char *str, int len, u_int64_t count, SNODEPTR *htab)
 /* DEL_SLIST - delete search str hash table  */
 /*********************************************/
 
-void	del_slist(SNODEPTR *htab)
+void	del_slist(struct htab *htab)
 {
-   /* free memory used by hash table */
-   SNODEPTR aptr,temp;
-   int i;
-
-   for (i=0;i<MAXHASH;i++)
-   {
-      if (htab[i] != NULL)
-      {
-         aptr = htab[i];
-         while (aptr != NULL)
-         {
-            temp = aptr->next;
-            free (aptr);
-            aptr = temp;
-         }
-         htab[i]=NULL;
-      }
-   }
+   ht_clear(htab);                            /* free all the nodes       */
 }
 
 /*********************************************/
 /* NEW_INODE - create ident (username) node  */
 /*********************************************/
 
-INODEPTR new_inode(char *str,int len)
+INODEPTR new_inode(char *str, int len, struct htab *htab, u_int64_t hval)
 {
    INODEPTR newptr;
 
@@ -789,7 +1103,7 @@ INODEPTR new_inode(char *str,int len)
 	  len=MAXIDENT-1;
    }
 
-   if (( newptr = malloc(sizeof(struct inode)+len+1)) != NULL)
+   if (( newptr = ht_node(htab,hval,sizeof(struct inode)+len+1)) != NULL)
    {
       newptr->string    =(char *)(newptr+1);;
 	  newptr->slen      =len;
@@ -806,6 +1120,7 @@ INODEPTR new_inode(char *str,int len)
 
 int put_inode( char      *str,  /* ident str */
                int       len,   /* str len   */
+               u_int64_t hval,  /* str hash  */
                int       type,  /* obj type  */
                u_int64_t count, /* hit count */
                u_int64_t file,  /* File flag */
@@ -813,86 +1128,52 @@ int put_inode( char      *str,  /* ident str */
                u_int64_t *ctr,  /* counter   */
                u_int64_t visit, /* visits    */
                u_int64_t tstamp,/* timestamp */
-               INODEPTR  *htab) /* hashtable */
+               struct htab *htab) /* hashtable */
 {
    INODEPTR cptr,nptr;
-   unsigned int hval;
+   struct ht_probe hp;
 
    if ((str[0]=='-') || (str[0]==0)) return 0;  /* skip if no username */
 
-   hval = hash(str,len);
    /* check if hashed */
-   if ( (cptr = htab[hval]) == NULL)
+   for (cptr=ht_find(htab,hval,str,len,&hp);cptr!=NULL;cptr=ht_again(&hp))
    {
-      /* not hashed */
-      if ( (nptr=new_inode(str,len)) != NULL)
+      if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
       {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->files = file;
-         nptr->xfer  = xfer;
-         nptr->next  = NULL;
-         htab[hval] = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
+         /* found... bump counter */
+         cptr->count+=count;
+         cptr->files+=file;
+         cptr->xfer +=xfer;
 
-         if (visit)
-         {
-            nptr->visit=(visit-1);
-            nptr->tstamp=tstamp;
-            return 0;
-         }
-         else
+         if (rec_ispage())
          {
-            if (ispage(log_rec.url,log_rec.urllen)) nptr->tstamp=tstamp;
+            if ((tstamp-cptr->tstamp)>=visit_timeout)
+               cptr->visit++;
+            cptr->tstamp=tstamp;
          }
+         return 0;
       }
    }
-   else
+
+   /* not found... */
+   if ( (nptr = new_inode(str,len,htab,hval)) != NULL)
    {
-      /* hashed */
-      while (cptr != NULL)
+      nptr->flag  = type;
+      nptr->count = count;
+      nptr->files = file;
+      nptr->xfer  = xfer;
+      if (ht_add(htab,hval,nptr)) return 1;
+      if (type!=OBJ_GRP) (*ctr)++;
+
+      if (visit)
       {
-         if (cptr->slen==len && strcmp(cptr->string,str)==0)
-         {
-            if ((type==cptr->flag)||((type!=OBJ_GRP)&&(cptr->flag!=OBJ_GRP)))
-            {
-               /* found... bump counter */
-               cptr->count+=count;
-               cptr->files+=file;
-               cptr->xfer +=xfer;
-
-               if (ispage(log_rec.url,log_rec.urllen))
-               {
-                  if ((tstamp-cptr->tstamp)>=visit_timeout)
-                     cptr->visit++;
-                  cptr->tstamp=tstamp;
-               }
-               return 0;
-            }
-         }
-         cptr = cptr->next;
+         nptr->visit = (visit-1);
+         nptr->tstamp= tstamp;
+         return 0;
       }
-      /* not found... */
-      if ( (nptr = new_inode(str,len)) != NULL)
+      else
       {
-         nptr->flag  = type;
-         nptr->count = count;
-         nptr->files = file;
-         nptr->xfer  = xfer;
-         nptr->next  = htab[hval];
-         htab[hval]  = nptr;
-         if (type!=OBJ_GRP) (*ctr)++;
-
-         if (visit)
-         {
-            nptr->visit = (visit-1);
-            nptr->tstamp= tstamp;
-            return 0;
-         }
-         else
-         {
-            if (ispage(log_rec.url,log_rec.urllen)) nptr->tstamp= tstamp;
-         }
+         if (rec_ispage()) nptr->tstamp= tstamp;
       }
    }
 
@@ -914,26 +1195,9 @@ int put_inode( char      *str,  /* ident str */
 /* DEL_ILIST - delete ident hash table       */
 /*********************************************/
 
-void	del_ilist(INODEPTR *htab)
+void	del_ilist(struct htab *htab)
 {
-   /* free memory used by hash table */
-   INODEPTR aptr,temp;
-   int i;
-
-   for (i=0;i<MAXHASH;i++)
-   {
-      if (htab[i] != NULL)
-      {
-         aptr = htab[i];
-         while (aptr != NULL)
-         {
-            temp = aptr->next;
-            free (aptr);            /* free ident structure    */
-            aptr = temp;
-         }
-         htab[i]=NULL;
-      }
-   }
+   ht_clear(htab);                            /* free all the nodes       */
 }
 
 #ifdef USE_DNS   /* only add these for DNS   */
@@ -979,7 +1243,7 @@ int put_dnode(char *str, int slen, void *addr, int len, DNODEPTR *htab)
 
    if (str[0]==0 || str[0]==' ') return 0;     /* skip bad hostnames */
 
-   hval = hash(str,slen);
+   hval = hash(str,slen)%MAXHASH;
    /* check if hashed */
    if ( (cptr = htab[hval]) == NULL)
    {
@@ -1046,21 +1310,15 @@ void	del_dlist(DNODEPTR *htab)
 /* FIND_URL - Find URL in hash table         */
 /*********************************************/
 
-char *find_url(char *str,int *len)
+char *find_url(char *str,int *len,u_int64_t hval)
 {
    UNODEPTR cptr;
+   struct spnode *sp;
+   struct ht_probe hp;
 
-   if ( (cptr=um_htab[hash(str,*len)]) != NULL)
-   {
-      while (cptr != NULL)
-      {
-         if (cptr->slen== *len && strcmp(cptr->string,str)==0) {
-		    *len = cptr->slen;
-            return cptr->string;
-		 }
-         cptr = cptr->next;
-      }
-   }
+   if ( (sp=sp_find(str,*len,hval)) != NULL &&
+        (cptr=ht_find(&um_htab,SP_KEY(sp->id),NULL,0,&hp)) != NULL)
+      return cptr->string;
    *len = 0;
    return blank_str;   /* shouldn't get here */
 }
@@ -1069,25 +1327,20 @@ char *find_url(char *str,int *len)
 /* UPDATE_ENTRY - update entry page total    */
 /*********************************************/
 
-void update_entry(char *str,int len)
+void update_entry(char *str,int len,u_int64_t hval)
 {
    UNODEPTR uptr;
+   struct spnode *sp;
+   struct ht_probe hp;
 
-   if (str==NULL) return;
-   if ( (uptr = um_htab[hash(str,len)]) == NULL) return;
-   else
+   if (str==NULL || (sp=sp_find(str,len,hval))==NULL) return;
+   for (uptr=ht_find(&um_htab,SP_KEY(sp->id),NULL,0,&hp);uptr!=NULL;
+        uptr=ht_again(&hp))
    {
-      while (uptr != NULL)
+      if (uptr->flag!=OBJ_GRP)
       {
-         if (uptr->slen==len && strcmp(uptr->string,str)==0)
-         {
-            if (uptr->flag!=OBJ_GRP)
-            {
-               uptr->entry++;
-               return;
-            }
-         }
-         uptr=uptr->next;
+         uptr->entry++;
+         return;
       }
    }
 }
@@ -1096,49 +1349,142 @@ void update_entry(char *str,int len)
 /* UPDATE_EXIT  - update exit page total     */
 /*********************************************/
 
-void update_exit(char *str,int len)
+void update_exit(char *str,int len,int n)
 {
    UNODEPTR uptr;
+   struct spnode *sp;
+   struct ht_probe hp;
 
-   if (str==NULL) return;
-   if ( (uptr = um_htab[hash(str,len)]) == NULL) return;
-   else
+   if (str==NULL || (sp=sp_lasturl(str))==NULL) return;
+
+   for (uptr=ht_find(&um_htab,SP_KEY(sp->id),NULL,0,&hp);uptr!=NULL;
+        uptr=ht_again(&hp))
    {
-      while (uptr != NULL)
+      if (uptr->flag!=OBJ_GRP)
       {
-         if (uptr->slen == len && strcmp(uptr->string,str)==0)
+         uptr->exit+=n;
+         return;
+      }
+   }
+}
+
+/*********************************************/
+/* REC_ISPAGE - is current record a page?    */
+/*********************************************/
+
+static int rec_ispage()
+{
+#ifdef USE_THREADS
+   if (sh_cur) return sh_cur->page;
+#endif
+   return log_page;                      /* set by put_record()      */
+}
+
+/*********************************************/
+/* REC_LASTURL - URL string for host lasturl */
+/*********************************************/
+
+static char *rec_lasturl(int *len)
+{
+#ifdef USE_THREADS
+   if (sh_cur) { *len=sh_cur->llen; return sh_cur->lasturl; }
+#endif
+   *len=log_rec.urllen;
+   return find_url(log_rec.url,len,log_rec.urlhash);
+}
+
+/*********************************************/
+/* REC_ENTRY - current record is entry page  */
+/*********************************************/
+
+static void rec_entry()
+{
+#ifdef USE_THREADS
+   /* other shard threads may bump the same URL */
+   if (sh_cur)
+   {
+      if (sh_cur->entry!=NULL)
+         __atomic_fetch_add(&sh_cur->entry->entry,1,__ATOMIC_RELAXED);
+      return;
+   }
+#endif
+   update_entry(log_rec.url,log_rec.urllen,log_rec.urlhash);
+}
+
+/*********************************************/
+/* REC_EXIT - host lasturl was an exit page  */
+/*********************************************/
+
+static void rec_exit(char *str, int len)
+{
+#ifdef USE_THREADS
+   UNODEPTR uptr, nptr;
+   struct spnode *sp;
+   struct ht_probe hp;
+   int    grp=0;
+
+   if (sh_cur)
+   {
+      /* There is only ever one non-group node per URL.  It can only */
+      /* be newer than lasturl if lasturl came from a group node with*/
+      /* the same name, so only then look for a later record.        */
+      uptr=NULL;
+      if ( (sp=sp_lasturl(str))!=NULL )
+         for (nptr=ht_find(&um_htab,SP_KEY(sp->id),NULL,0,&hp);nptr!=NULL;
+              nptr=ht_again(&hp))
          {
-            if (uptr->flag!=OBJ_GRP)
-            {
-               uptr->exit++;
-               return;
-            }
+            if (nptr->flag==OBJ_GRP) grp=1;
+            else if (uptr==NULL) uptr=nptr;
          }
-         uptr=uptr->next;
-      }
+      if (uptr!=NULL && grp && sh_newer(uptr,sh_cur->idx)) uptr=NULL;
+      if (uptr!=NULL)
+         __atomic_fetch_add(&uptr->exit,1,__ATOMIC_RELAXED);
+      return;
+   }
+#endif
+   update_exit(str,len,1);
+}
+
+#ifdef USE_THREADS
+/*********************************************/
+/* URL_INFO - save URL info for shard thread */
+/*********************************************/
+
+void url_info(char *str, int len, u_int64_t hval, struct sh_url *u)
+{
+   UNODEPTR cptr;
+   struct spnode *sp;
+   struct ht_probe hp;
+
+   /* same answers find_url() and update_entry() would give now */
+   u->lasturl=NULL; u->entry=NULL;
+   sp=sp_find(str,len,hval);
+   for (cptr=(sp)?ht_find(&um_htab,SP_KEY(sp->id),NULL,0,&hp):NULL;
+        cptr!=NULL;cptr=ht_again(&hp))
+   {
+      if (u->lasturl==NULL) u->lasturl=cptr->string;
+      if (cptr->flag!=OBJ_GRP) { u->entry=cptr; break; }
    }
+   if (u->lasturl==NULL) { u->lasturl=blank_str; u->llen=0; }
+   else u->llen=len;
 }
+#endif  /* USE_THREADS */
 
 /*********************************************/
 /* MONTH_UPDATE_EXIT  - eom exit page update */
 /*********************************************/
 
-void month_update_exit(u_int64_t tstamp)
+void month_update_exit(u_int64_t tstamp, int n)
 {
    HNODEPTR nptr;
-   int i;
+   struct ht_pos hp;
 
-   for (i=0;i<MAXHASH;i++)
+   for (nptr=ht_first(&sm_htab,&hp);nptr!=NULL;nptr=ht_next(&sm_htab,&hp))
    {
-      nptr=sm_htab[i];
-      while (nptr!=NULL)
+      if (nptr->flag!=OBJ_GRP)
       {
-         if (nptr->flag!=OBJ_GRP)
-         {
-            if ((tstamp-nptr->tstamp)>=visit_timeout)
-               update_exit(nptr->lasturl,nptr->llen);
-         }
-         nptr=nptr->next;
+         if ((tstamp-nptr->tstamp)>=visit_timeout)
+            update_exit(nptr->lasturl,nptr->llen,n);
       }
    }
 }
@@ -1147,21 +1493,14 @@ void month_update_exit(u_int64_t tstamp)
 /* TOT_VISIT - calculate total visits        */
 /*********************************************/
 
-u_int64_t tot_visit(HNODEPTR *list)
+u_int64_t tot_visit(struct htab *list)
 {
    HNODEPTR   hptr;
+   struct ht_pos hp;
    u_int64_t  tot=0;
-   int        i;
 
-   for (i=0;i<MAXHASH;i++)
-   {
-      hptr=list[i];
-      while (hptr!=NULL)
-      {
-         if (hptr->flag!=OBJ_GRP) tot+=hptr->visit;
-         hptr=hptr->next;
-      }
-   }
+   for (hptr=ht_first(list,&hp);hptr!=NULL;hptr=ht_next(list,&hp))
+      if (hptr->flag!=OBJ_GRP) tot+=hptr->visit;
    return tot;
 }
 
@@ -1170,77 +1509,42 @@ u_int64_t tot_visit(HNODEPTR *list)
 /* HASH - return hash value for string       */
 /*********************************************/
 
-unsigned int hash(char *str)
+u_int64_t hash(char *str,int len)
 {
-   uint32_t  hashval=0;
+   u_int64_t hashval=0;
 
-   for (hashval = 0; *str != '\0'; str++)
+   for (;len>0;len--,str++)
       hashval = *str + (hashval << 5) - hashval;
 
-   return hashval % MAXHASH;
+   return hashval;
 }
 
 #else /* USE_OLDHASH */
 /*********************************************/
-/* HASH (SuperFastHash by Paul Hsieh)        */
+/* HASH - 64 bit hash, 8 bytes at a time     */
 /*********************************************/
 
-#undef get16bits
-#if (defined(__GNUC__) && defined(__i386__)) || defined(__WATCOMC__) \
-  || defined(_MSC_VER) || defined (__BORLANDC__) || defined (__TURBOC__)
-#define get16bits(d) (*((const uint16_t *) (d)))
-#endif
-
-#if !defined (get16bits)
-#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8)\
-                       +(uint32_t)(((const uint8_t *)(d))[0]) )
-#endif
+/* A record's keys are hashed once (see log_rec) and the value used
+   for every table and cache the key goes in.  Tables use the low
+   bits for the segment and slot group and the top 7 bits for the
+   control byte, so all of them need to be good.                     */
 
-unsigned int hash(char *str,int len)
+u_int64_t hash(char *str,int len)
 {
-   uint32_t hash = len, tmp;
-   int rem;
+   u_int64_t h=(u_int64_t)len*0x9e3779b97f4a7c15ULL, v;
 
    if (len <= 0 || str == NULL) return 0;
 
-   rem = len & 3;
-   len >>= 2;
-
-   /* Main loop */
-   for (;len > 0; len--)
-   {
-      hash  += get16bits (str);
-      tmp    = (get16bits (str+2) << 11) ^ hash;
-      hash   = (hash << 16) ^ tmp;
-      str   += 2*sizeof (uint16_t);
-      hash  += hash >> 11;
-   }
-
-   /* Handle end cases */
-   switch (rem)
+   while (len>=8)
    {
-      case 3: hash += get16bits (str);
-              hash ^= hash << 16;
-              hash ^= str[sizeof (uint16_t)] << 18;
-              hash += hash >> 11;
-              break;
-      case 2: hash += get16bits (str);
-              hash ^= hash << 11;
-              hash += hash >> 17;
-              break;
-      case 1: hash += *str;
-              hash ^= hash << 10;
-              hash += hash >> 1;
+      memcpy(&v,str,8);
+      h=(h^v)*0xff51afd7ed558ccdULL; h^=h>>32;
+      str+=8; len-=8;
    }
-
-   /* Force "avalanching" of final 127 bits */
-   hash ^= hash << 3;
-   hash += hash >> 5;
-   hash ^= hash << 4;
-   hash += hash >> 17;
-   hash ^= hash << 25;
-   hash += hash >> 6;
-
-   return hash % MAXHASH;
+   v=0;
+   while (len--) v=(v<<8)|(unsigned char)*str++;
+   h=(h^v)*0xff51afd7ed558ccdULL;
+   h^=h>>33; h*=0xc4ceb9fe1a85ec53ULL; h^=h>>33;
+   return h;
 }
 #endif /* USE_OLDHASH */
@@ -36,8 +36,7 @@ struct hnode {  char *string;              /* host hash table structure    */
                  int llen;
 				 int pad;
               double xfer;
-		   u_int64_t pad2[2];
-              struct hnode *next; };
+		   u_int64_t pad2[2]; };
 
 struct unode {  char *string;              /* url hash table structure     */
                  int slen;
@@ -46,26 +45,22 @@ struct unode {  char *string;              /* url hash table structure     */
            u_int64_t files;                /* files counter                */
            u_int64_t entry;                /* entry page counter           */
            u_int64_t exit;                 /* exit page counter            */
-              double xfer;                 /* xfer size in bytes           */
-              struct unode *next; };       /* pointer to next node         */
+              double xfer; };              /* xfer size in bytes           */
 
 struct rnode {  char *string;              /* referrer hash table struct   */
                  int slen;
                  int flag;
-           u_int64_t count;
-              struct rnode *next; };
+           u_int64_t count; };
 
 struct anode {  char *string;
                  int slen;
                  int flag;
-           u_int64_t count;
-              struct anode *next; };
+           u_int64_t count; };
 
 struct snode {  char *string;                 /* search string struct      */
                  int slen;
 				 int pad;
-           u_int64_t count;
-              struct snode *next; };
+           u_int64_t count; };
 
 struct inode {  char *string;                 /* host hash table struct    */
                  int slen;
@@ -74,29 +69,92 @@ struct inode {  char *string;                 /* host hash table struct    */
            u_int64_t files;
            u_int64_t visit;
            u_int64_t tstamp;
-              double xfer;
-              struct inode *next; };
-
-extern HNODEPTR sm_htab[MAXHASH];             /* hash tables               */
-extern HNODEPTR sd_htab[MAXHASH];
-extern UNODEPTR um_htab[MAXHASH];             /* for hits, sites,          */
-extern RNODEPTR rm_htab[MAXHASH];             /* referrers and agents...   */
-extern ANODEPTR am_htab[MAXHASH];
-extern SNODEPTR sr_htab[MAXHASH];             /* search string table       */
-extern INODEPTR im_htab[MAXHASH];             /* ident table (username)    */
+              double xfer; };
+
+/* Hash tables are open addressed, in the style of the "Swiss" tables.
+   Each slot has a control byte (top 7 bits of the hash, or empty),
+   the low 32 bits of the hash and the node pointer, and a lookup
+   checks the control bytes of a group of 16 slots at once, so a miss
+   hardly ever has to look at a node.  A table is split into HT_SEGS
+   segments by the low bits of the hash, and each segment doubles its
+   slot arrays when it gets 7/8 full.  Slots are moved over to the new
+   arrays a group at a time by later inserts, so no insert has to
+   rehash a whole table.  A segment is only changed by one thread.
+   Nodes are allocated from an arena per segment and are only freed
+   all at once, when the table is cleared.  The URL, referrer and site
+   tables point at strings kept in a pool and are keyed on the pool's
+   32 bit ID, which takes the place of the hash bits in the slot.    */
+
+#define HT_SEGBITS 6                       /* log2 of segments per table   */
+#define HT_SEGS    (1<<HT_SEGBITS)         /* segments per table           */
+#define HT_GROUP   16                      /* slots checked at once        */
+#define HT_MINSIZE 64                      /* min slots per segment        */
+#define HT_MAXSIZE (1<<30)                 /* max slots per segment        */
+#define HT_MOVE    2                       /* old groups moved per insert  */
+#define HT_BLKMIN  1024                    /* first arena block size       */
+#define HT_BLKMAX  65536                   /* max arena block size         */
+
+#define HT_SEG(h)  ((h)&(HT_SEGS-1))       /* segment for hash value       */
+
+struct ht_arr { unsigned char *ctrl;       /* control bytes (tag or empty) */
+                unsigned int  *hv;         /* low 32 hash bits of each slot*/
+                void          **node;      /* node in each slot            */
+                u_int64_t     size; };     /* slots (power of 2, 0=none)   */
+
+struct ht_blk { struct ht_blk *next;       /* arena block (nodes follow)   */
+                u_int64_t     size; };     /* bytes for nodes              */
+
+struct ht_seg { struct ht_arr cur;         /* slots                        */
+                struct ht_arr old;         /* slots still being moved      */
+                u_int64_t     used;        /* nodes in segment             */
+                u_int64_t     move;        /* next old group to move       */
+                struct ht_blk *blk;        /* arena blocks, oldest first   */
+                struct ht_blk *ablk;       /* block in use                 */
+                char          *ap;         /* next free byte in ablk       */
+                char          *aend;       /* end of ablk                  */
+                u_int64_t     pad[2]; };   /* keep threads off each other  */
+
+struct htab { struct ht_seg seg[HT_SEGS]; };
+
+struct ht_probe { struct ht_seg *s;        /* lookup state, for finding    */
+                  struct ht_arr *a;        /* all nodes with a key using   */
+                  char          *str;      /* ht_find() and ht_again()     */
+                  int           len;
+                  int           end;       /* group has an empty slot      */
+                  unsigned int  m;         /* matching slots left in group */
+                  u_int64_t     h;         /* hash value                   */
+                  u_int64_t     g;         /* group                        */
+                  u_int64_t     n; };      /* groups looked at             */
+
+struct ht_pos { int       seg;             /* table position, for walking  */
+                int       old;             /* a table with ht_first() and  */
+                u_int64_t i; };            /* ht_next()                    */
+
+extern struct htab sm_htab;                   /* hash tables               */
+extern struct htab sd_htab;
+extern struct htab um_htab;                   /* for hits, sites,          */
+extern struct htab rm_htab;                   /* referrers and agents...   */
+extern struct htab am_htab;
+extern struct htab sr_htab;                   /* search string table       */
+extern struct htab im_htab;                   /* ident table (username)    */
 #ifdef USE_DNS
 extern DNODEPTR host_table[MAXHASH];          /* DNS resolver table        */
 #endif
 
-extern int    put_hnode(char *, int, int, u_int64_t, u_int64_t, double,
-                        u_int64_t *, u_int64_t, u_int64_t, char *, int, HNODEPTR *);
-extern int    put_unode(char *, int, int, u_int64_t, double, u_int64_t *,
-                        u_int64_t, u_int64_t, UNODEPTR *);
-extern int    put_inode(char *, int, int, u_int64_t, u_int64_t, double,
-                        u_int64_t *, u_int64_t, u_int64_t, INODEPTR *);
-extern int    put_rnode(char *, int, int, u_int64_t, u_int64_t *, RNODEPTR *);
-extern int    put_anode(char *, int, int, u_int64_t, u_int64_t *, ANODEPTR *);
-extern int    put_snode(char *, int, u_int64_t, SNODEPTR *);
+/* the put_xnode() functions take the key, its length and hash(key) */
+extern int    put_hnode(char *, int, u_int64_t, int, u_int64_t, u_int64_t,
+                        double, u_int64_t *, u_int64_t, u_int64_t, char *,
+                        int, struct htab *);
+extern int    put_unode(char *, int, u_int64_t, int, u_int64_t, double,
+                        u_int64_t *, u_int64_t, u_int64_t, struct htab *);
+extern int    put_inode(char *, int, u_int64_t, int, u_int64_t, u_int64_t,
+                        double, u_int64_t *, u_int64_t, u_int64_t,
+                        struct htab *);
+extern int    put_rnode(char *, int, u_int64_t, int, u_int64_t, u_int64_t *,
+                        struct htab *);
+extern int    put_anode(char *, int, u_int64_t, int, u_int64_t, u_int64_t *,
+                        struct htab *);
+extern int    put_snode(char *, int, u_int64_t, u_int64_t, struct htab *);
 
 #ifdef USE_DNS
 extern int    put_dnode(char *, int, void *, int, DNODEPTR *);
@@ -104,15 +162,38 @@ extern void   del_dlist(DNODEPTR *);
 #endif
 
 extern void   del_htabs();                    /* delete hash tables        */
-extern void   del_hlist(HNODEPTR *);          /* delete host htab          */
-extern void   del_ulist(UNODEPTR *);          /* delete url htab           */
-extern void   del_rlist(RNODEPTR *);          /* delete referrer htab      */
-extern void   del_alist(ANODEPTR *);          /* delete host htab          */
-extern void   del_slist(SNODEPTR *);          /* delete host htab          */
-extern void   del_ilist(INODEPTR *);          /* delete host htab          */
-
-extern void      month_update_exit(u_int64_t);
-extern u_int64_t tot_visit(HNODEPTR *);
-extern char     *find_url(char *,int *);
+extern void   del_hlist(struct htab *);       /* delete host htab          */
+extern void   del_ulist(struct htab *);       /* delete url htab           */
+extern void   del_rlist(struct htab *);       /* delete referrer htab      */
+extern void   del_alist(struct htab *);       /* delete host htab          */
+extern void   del_slist(struct htab *);       /* delete host htab          */
+extern void   del_ilist(struct htab *);       /* delete host htab          */
+
+#ifdef USE_THREADS
+/* record info for host/ident updates done by a shard thread */
+struct sh_url { int      page;             /* record is a page             */
+                char     *lasturl;         /* URL string (see find_url)    */
+                int      llen;             /* URL string length            */
+                UNODEPTR entry;            /* URL node for entry count     */
+                int      idx; };           /* record index in batch        */
+
+extern __thread struct sh_url *sh_cur;     /* set by shard thread only     */
+extern void   url_info(char *, int, u_int64_t, struct sh_url *);
+#endif  /* USE_THREADS */
+
+extern void      *ht_find(struct htab *, u_int64_t, char *, int,
+                          struct ht_probe *);  /* first node with key */
+extern void      *ht_again(struct ht_probe *); /* next node with key  */
+extern int       ht_add(struct htab *, u_int64_t, void *);
+extern void      *ht_first(struct htab *, struct ht_pos *);
+extern void      *ht_next(struct htab *, struct ht_pos *);
+extern void      ht_clear(struct htab *);    /* free all nodes            */
+extern void      ht_size(struct htab *, u_int64_t); /* pre-size slots     */
+extern u_int64_t ht_slots(struct htab *);    /* total slots               */
+
+extern void      month_update_exit(u_int64_t,int);
+extern u_int64_t tot_visit(struct htab *);
+extern char     *find_url(char *,int *,u_int64_t);
+extern u_int64_t hash(char *,int);            /* 64 bit string hash     */
 
 #endif  /* _HASHTAB_H */
@@ -0,0 +1,316 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+/* Need socket header? */
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "webalizer.h"                        /* main header              */
+#include "ipset.h"                            /* our header               */
+
+/* Host sets loaded from IgnoreSiteFile/IncludeSiteFile lists.  Plain
+   addresses and hostnames go in a hash set (one lookup per record),
+   address ranges (CIDR) in a path compressed radix tree over 128 bit
+   keys, with IPv4 mapped into ::ffff:0:0/96, so a lookup only looks
+   at as many bits as the longest range.                              */
+
+#define IS_MINSIZE 1024                       /* initial hash slots       */
+
+struct is_ent { u_int64_t hash;               /* full hash of key         */
+                char      *key;               /* key (NULL=empty slot)    */
+                int       len; };             /* key length               */
+
+struct is_node { u_int64_t key[2];            /* prefix (rest is zero)    */
+                 int       bits;              /* prefix length            */
+                 int       term;              /* a range ends here        */
+                 struct is_node *child[2]; }; /* next bit 0/1             */
+
+struct ipset { struct is_ent  *tab;           /* exact entries            */
+               u_int64_t      size;           /* slots (power of 2)       */
+               u_int64_t      used;           /* slots in use             */
+               struct is_node *root; };       /* address ranges           */
+
+struct ipset *ignored_siteset = NULL;         /* IgnoreSiteFile entries   */
+struct ipset *include_siteset = NULL;         /* IncludeSiteFile entries  */
+
+/*********************************************/
+/* IS_HASH - hash a key (FNV-1a)             */
+/*********************************************/
+
+static u_int64_t is_hash(char *str, int len)
+{
+   u_int64_t h=0xcbf29ce484222325ULL;
+
+   while (len--) { h^=(unsigned char)*str++; h*=0x100000001b3ULL; }
+   return h;
+}
+
+/*********************************************/
+/* IS_ADDR - address text to 128 bit key     */
+/*********************************************/
+
+static int is_addr(char *str, u_int64_t *k)
+{
+   unsigned char b[16];
+   int           i;
+
+   memset(b, 0, sizeof(b));
+   if (inet_pton(AF_INET, str, b+12)==1) b[10]=b[11]=0xff;
+   else if (inet_pton(AF_INET6, str, b)!=1) return 0;
+
+   k[0]=k[1]=0;
+   for (i=0;i<8;i++) { k[0]=(k[0]<<8)|b[i]; k[1]=(k[1]<<8)|b[i+8]; }
+   return 1;
+}
+
+/* hash set key for an address, 0x01 is never in a hostname */
+
+static void is_bkey(u_int64_t *k, unsigned char *bkey)
+{
+   int i;
+
+   bkey[0]=1;
+   for (i=0;i<8;i++)
+   {
+      bkey[1+i]=(unsigned char)(k[0]>>(56-8*i));
+      bkey[9+i]=(unsigned char)(k[1]>>(56-8*i));
+   }
+}
+
+/* bit n (0=top) of a key */
+#define IS_BIT(k,n) (int)(((k)[(n)>>6]>>(63-((n)&63)))&1)
+
+/*********************************************/
+/* IS_COMMON - common prefix bits of 2 keys  */
+/*********************************************/
+
+static int is_common(u_int64_t *a, u_int64_t *b, int max)
+{
+   u_int64_t x;
+   int       n;
+
+   if ((x=a[0]^b[0])!=0) n=__builtin_clzll(x);
+   else if ((x=a[1]^b[1])!=0) n=64+__builtin_clzll(x);
+   else n=128;
+   return (n<max)?n:max;
+}
+
+/*********************************************/
+/* IS_PUT - add key to the hash set          */
+/*********************************************/
+
+static int is_put(struct ipset *s, char *key, int len)
+{
+   struct is_ent *tab, *ep;
+   u_int64_t     h, i, j;
+
+   if (s->used*2>=s->size)                    /* keep it half empty       */
+   {
+      if ((tab=calloc(s->size*2,sizeof(struct is_ent)))==NULL) return 0;
+      for (i=0;i<s->size;i++)
+      {
+         if (s->tab[i].key==NULL) continue;
+         for (j=s->tab[i].hash&(s->size*2-1);tab[j].key;j=(j+1)&(s->size*2-1));
+         tab[j]=s->tab[i];
+      }
+      free(s->tab); s->tab=tab; s->size*=2;
+   }
+
+   h=is_hash(key,len);
+   for (i=h&(s->size-1);(ep=&s->tab[i])->key!=NULL;i=(i+1)&(s->size-1))
+      if (ep->hash==h && ep->len==len && !memcmp(ep->key,key,len)) return 1;
+   if ((ep->key=malloc(len))==NULL) return 0;
+   memcpy(ep->key,key,len);
+   ep->hash=h; ep->len=len;
+   s->used++;
+   return 1;
+}
+
+/*********************************************/
+/* IS_GET - look up key in the hash set      */
+/*********************************************/
+
+static int is_get(struct ipset *s, char *key, int len)
+{
+   struct is_ent *ep;
+   u_int64_t     h, i;
+
+   if (!s->used) return 0;
+   h=is_hash(key,len);
+   for (i=h&(s->size-1);(ep=&s->tab[i])->key!=NULL;i=(i+1)&(s->size-1))
+      if (ep->hash==h && ep->len==len && !memcmp(ep->key,key,len)) return 1;
+   return 0;
+}
+
+/*********************************************/
+/* IS_RANGE - add range to the radix tree    */
+/*********************************************/
+
+static int is_range(struct ipset *s, u_int64_t *key, int bits)
+{
+   struct is_node **np=&s->root, *n, *nn, *in;
+   int            c=0;
+
+   /* clear host part of the range */
+   if (bits<64)  { key[0]&=(bits)?~0ULL<<(64-bits):0; key[1]=0; }
+   else if (bits<128) key[1]&=(bits>64)?~0ULL<<(128-bits):0;
+
+   while ((n=*np)!=NULL)
+   {
+      c=is_common(n->key,key,(n->bits<bits)?n->bits:bits);
+      if (c<n->bits) break;                   /* split this node          */
+      if (n->bits==bits) { n->term=1; return 1; }
+      if (n->term) return 1;                  /* already covered          */
+      np=&n->child[IS_BIT(key,n->bits)];
+   }
+
+   if ((nn=calloc(1,sizeof(struct is_node)))==NULL) return 0;
+   nn->key[0]=key[0]; nn->key[1]=key[1]; nn->bits=bits; nn->term=1;
+   if (n==NULL) { *np=nn; return 1; }
+
+   if (c==bits)                               /* new range holds node     */
+   {
+      nn->child[IS_BIT(n->key,bits)]=n;
+      *np=nn;
+      return 1;
+   }
+
+   /* else both hang off a new inner node at the common prefix */
+   if ((in=calloc(1,sizeof(struct is_node)))==NULL) { free(nn); return 0; }
+   in->key[0]=key[0]; in->key[1]=key[1]; in->bits=c;
+   if (c<64) { in->key[0]&=(c)?~0ULL<<(64-c):0; in->key[1]=0; }
+   else in->key[1]&=(c>64)?~0ULL<<(128-c):0;
+   in->child[IS_BIT(key,c)]=nn;
+   in->child[IS_BIT(n->key,c)]=n;
+   *np=in;
+   return 1;
+}
+
+/*********************************************/
+/* IPS_LOAD - add entries from file to set   */
+/*********************************************/
+
+/* One entry per line: an address, hostname or CIDR range (IPv4 or
+   IPv6).  Blank lines and '#' comments are skipped.  Returns the
+   number of entries added, or -1 if the file can't be read.         */
+
+int ips_load(char *fname, struct ipset **set)
+{
+   FILE          *fp;
+   struct ipset  *s;
+   char          buffer[BUFSIZE], *cp1, *cp2, *ep;
+   u_int64_t     key[2];
+   unsigned char bkey[17];
+   int           bits, n=0, bad=0;
+
+   if ((fp=fopen(fname,"r"))==NULL) return -1;
+
+   if ((s=*set)==NULL)
+   {
+      if ((s=calloc(1,sizeof(struct ipset)))==NULL ||
+          (s->tab=calloc(IS_MINSIZE,sizeof(struct is_ent)))==NULL)
+         { if (s) free(s); fclose(fp); return -1; }
+      s->size=IS_MINSIZE;
+      *set=s;
+   }
+
+   while (fgets(buffer,BUFSIZE,fp)!=NULL)
+   {
+      if ((cp1=strchr(buffer,'#'))!=NULL) *cp1='\0';
+      for (cp1=buffer;isspace((unsigned char)*cp1);cp1++);
+      for (cp2=cp1;*cp2 && !isspace((unsigned char)*cp2);cp2++)
+         if (*cp2>='A' && *cp2<='Z') *cp2+='a'-'A';
+      *cp2='\0';
+      if (*cp1=='\0') continue;
+
+      if ((cp2=strchr(cp1,'/'))!=NULL)        /* address range            */
+      {
+         *cp2++='\0';
+         bits=strtol(cp2,&ep,10);
+         if (ep==cp2 || *ep!='\0' || !is_addr(cp1,key)) { bad++; continue; }
+         if (strchr(cp1,':')==NULL) bits+=96; /* IPv4, mapped             */
+         if (bits<0 || bits>128 || (bits<96 && strchr(cp1,':')==NULL))
+            { bad++; continue; }
+         if (!is_range(s,key,bits)) break;
+      }
+      else if (is_addr(cp1,key))              /* address                  */
+      {
+         is_bkey(key,bkey);
+         if (!is_put(s,(char *)bkey,sizeof(bkey))) break;
+      }
+      else if (!is_put(s,cp1,strlen(cp1))) break; /* hostname             */
+      n++;
+   }
+   fclose(fp);
+
+   if (bad && verbose)
+      fprintf(stderr,"Warning: %d bad entries in %s\n",bad,fname);
+   return n;
+}
+
+/*********************************************/
+/* IPS_FIND - check if host is in a set      */
+/*********************************************/
+
+/* host is the (lowercase) hostname, addr the address from the log,
+   which is the same unless DNS lookups are done.                    */
+
+int ips_find(struct ipset *s, char *host, char *addr)
+{
+   struct is_node *n;
+   u_int64_t      key[2];
+   unsigned char  bkey[17];
+
+   if (s==NULL) return 0;
+
+   if (is_addr(addr,key))
+   {
+      is_bkey(key,bkey);
+      if (is_get(s,(char *)bkey,sizeof(bkey))) return 1;
+      for (n=s->root;n!=NULL;n=n->child[IS_BIT(key,n->bits)])
+      {
+         if (is_common(n->key,key,n->bits)<n->bits) break;
+         if (n->term) return 1;
+         if (n->bits==128) break;
+      }
+   }
+   return is_get(s,host,strlen(host));
+}
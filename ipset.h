@@ -0,0 +1,12 @@
+#ifndef _IPSET_H
+#define _IPSET_H
+
+struct ipset;                              /* exact/CIDR host set          */
+
+extern struct ipset *ignored_siteset;      /* IgnoreSiteFile entries       */
+extern struct ipset *include_siteset;      /* IncludeSiteFile entries      */
+
+extern int   ips_load(char *, struct ipset **);    /* add file to a set    */
+extern int   ips_find(struct ipset *, char *, char *); /* host in set?     */
+
+#endif  /* _IPSET_H */
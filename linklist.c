@@ -62,6 +62,38 @@ void     del_glist(GLISTPTR *);                     /* del group list      */
 
 int      isinstr(char *, int, char *, int);
 
+static struct lmatch *pm_comp(void **, char **, int *, int);
+static int      pm_match(struct lmatch *, char *, int);
+static void     pm_free(struct lmatch *);
+
+/* lists shorter than this are just scanned with isinstr() */
+#define PM_MINLIST 8
+
+#define PM_NONE    0x7fffffff                 /* no entry matched         */
+
+/* trie node, used for all three kinds of pattern */
+struct pm_node { int child;                   /* first child (0=none)     */
+                 int next;                    /* next sibling             */
+                 int fail;                    /* failure link (substring) */
+                 int out;                     /* first entry ending here  */
+                 int out2;                    /* same, for '*x*abc' types */
+                 unsigned char c; };          /* char on edge to here     */
+
+struct pm_trie { struct pm_node *node;        /* node 0 is the root       */
+                 int  nnode;                  /* nodes used               */
+                 int  anode;                  /* nodes allocated          */
+                 int  root[256]; };           /* root edges, by char      */
+
+/* compiled pattern list.  Every entry is one of: plain substring
+   (Aho-Corasick), 'abc*' prefix (anchored trie) or '*abc' suffix
+   (anchored trie of reversed strings), tagged with its list index
+   so the first matching entry in list order can still be found.   */
+struct lmatch { struct pm_trie sub;           /* substrings (strstr)      */
+                struct pm_trie pre;           /* prefixes (abc*)          */
+                struct pm_trie sfx;           /* suffixes (*abc) reversed */
+                int  submin;                  /* first substring entry    */
+                void **ent; };                /* list entries, by index   */
+
 /* Linkded list pointers */
 GLISTPTR group_sites   = NULL;                /* "group" lists            */
 GLISTPTR group_urls    = NULL;
@@ -112,6 +144,7 @@ NLISTPTR new_nlist(char *str)
    if (( newptr = malloc(sizeof(struct nlist))) != NULL) {
     strncpy(newptr->string, str, sizeof(newptr->string));
 	newptr->next=NULL;
+	newptr->pm=NULL;
 	newptr->len = len;
    }
    return newptr;
@@ -130,6 +163,7 @@ int add_nlist(char *str, NLISTPTR *list)
       if (*list==NULL) *list=newptr;
       else
       {
+         if ((*list)->pm) { pm_free((*list)->pm); (*list)->pm=NULL; }
          cptr=pptr=*list;
          while(cptr!=NULL) { pptr=cptr; cptr=cptr->next; };
          pptr->next = newptr;
@@ -147,6 +181,7 @@ void del_nlist(NLISTPTR *list)
    NLISTPTR cptr,nptr;
 
    cptr=*list;
+   if (cptr!=NULL && cptr->pm) pm_free(cptr->pm);
    while (cptr!=NULL)
    {
       nptr=cptr->next;
@@ -177,7 +212,9 @@ GLISTPTR new_glist(char *str, char *name)
        strncpy(newptr->string, str, sizeof(newptr->string));
        strncpy(newptr->name, name, sizeof(newptr->name));
        newptr->next=NULL;
+       newptr->len  = slen;
 	   newptr->nlen = nlen;
+       newptr->pm   = NULL;
      }
    return newptr;
 }
@@ -216,6 +253,7 @@ int add_glist(char *str, GLISTPTR *list)
       if (*list==NULL) *list=newptr;
       else
       {
+         if ((*list)->pm) { pm_free((*list)->pm); (*list)->pm=NULL; }
          cptr=pptr=*list;
          while(cptr!=NULL) { pptr=cptr; cptr=cptr->next; };
          pptr->next = newptr;
@@ -233,6 +271,7 @@ void del_glist(GLISTPTR *list)
    GLISTPTR cptr,nptr;
 
    cptr=*list;
+   if (cptr!=NULL && cptr->pm) pm_free(cptr->pm);
    while (cptr!=NULL)
    {
       nptr=cptr->next;
@@ -248,6 +287,13 @@ void del_glist(GLISTPTR *list)
 char *isinlist(NLISTPTR list, char *str, int slen)
 {
    NLISTPTR lptr;
+   int      i;
+
+   if (list!=NULL && list->pm!=NULL)
+   {
+      if ((i=pm_match(list->pm,str,slen))==PM_NONE) return NULL;
+      return ((NLISTPTR)list->pm->ent[i])->string;
+   }
 
    lptr=list;
    while (lptr!=NULL)
@@ -265,6 +311,15 @@ char *isinlist(NLISTPTR list, char *str, int slen)
 char *isinglist(GLISTPTR list, char *str, int *len)
 {
    GLISTPTR lptr;
+   int      i;
+
+   if (list!=NULL && list->pm!=NULL)
+   {
+      if ((i=pm_match(list->pm,str,*len))==PM_NONE) return NULL;
+      lptr=(GLISTPTR)list->pm->ent[i];
+      *len = lptr->nlen;
+      return lptr->name;
+   }
 
    lptr=list;
    while (lptr!=NULL)
@@ -314,3 +369,255 @@ int isinstr(char *str, int slen, char *cp, int clen)
          else return 0;
    }
 }
+
+/*********************************************/
+/* COMP_NLIST - compile list for isinlist()  */
+/*********************************************/
+
+/* Long lists are compiled into tries, so checking a string takes time
+   in proportion to its length instead of the number of entries.  The
+   list must not change afterwards (add_nlist() drops the compiled
+   copy, and isinlist() goes back to scanning it).                    */
+
+void comp_nlist(NLISTPTR list)
+{
+   NLISTPTR lptr;
+   void     **ent;
+   char     **pat;
+   int      *len, n=0;
+
+   for (lptr=list;lptr!=NULL;lptr=lptr->next) n++;
+   if (n<PM_MINLIST || list->pm!=NULL) return;
+
+   ent=malloc(n*sizeof(void *)); pat=malloc(n*sizeof(char *));
+   len=malloc(n*sizeof(int));
+   if (ent && pat && len)
+   {
+      for (lptr=list,n=0;lptr!=NULL;lptr=lptr->next,n++)
+         { ent[n]=lptr; pat[n]=lptr->string; len[n]=lptr->len; }
+      if ((list->pm=pm_comp(ent,pat,len,n))!=NULL) ent=NULL;
+   }
+   if (ent) free(ent);
+   if (pat) free(pat);
+   if (len) free(len);
+}
+
+/*********************************************/
+/* COMP_GLIST - compile list for isinglist() */
+/*********************************************/
+
+void comp_glist(GLISTPTR list)
+{
+   GLISTPTR lptr;
+   void     **ent;
+   char     **pat;
+   int      *len, n=0;
+
+   for (lptr=list;lptr!=NULL;lptr=lptr->next) n++;
+   if (n<PM_MINLIST || list->pm!=NULL) return;
+
+   ent=malloc(n*sizeof(void *)); pat=malloc(n*sizeof(char *));
+   len=malloc(n*sizeof(int));
+   if (ent && pat && len)
+   {
+      for (lptr=list,n=0;lptr!=NULL;lptr=lptr->next,n++)
+         { ent[n]=lptr; pat[n]=lptr->string; len[n]=lptr->len; }
+      if ((list->pm=pm_comp(ent,pat,len,n))!=NULL) ent=NULL;
+   }
+   if (ent) free(ent);
+   if (pat) free(pat);
+   if (len) free(len);
+}
+
+/*********************************************/
+/* PM_ADD - add string to a pattern trie     */
+/*********************************************/
+
+/* adds str (backwards if rev) and returns its end node, or -1 */
+
+static int pm_add(struct pm_trie *t, char *str, int len, int rev)
+{
+   struct pm_node *np;
+   unsigned char  c;
+   int            i, s=0, n;
+
+   for (i=0;i<len;i++)
+   {
+      c=(unsigned char)str[(rev)?len-1-i:i];
+      if (s==0) n=t->root[c];
+      else for (n=t->node[s].child;n && t->node[n].c!=c;n=t->node[n].next);
+      if (!n)
+      {
+         if (t->nnode==t->anode)
+         {
+            np=realloc(t->node,(t->anode*2)*sizeof(struct pm_node));
+            if (np==NULL) return -1;
+            t->node=np; t->anode*=2;
+         }
+         n=t->nnode++;
+         t->node[n].child=t->node[n].fail=0;
+         t->node[n].out=t->node[n].out2=PM_NONE;
+         t->node[n].c=c;
+         if (s==0) { t->node[n].next=0; t->root[c]=n; }
+         else { t->node[n].next=t->node[s].child; t->node[s].child=n; }
+      }
+      s=n;
+   }
+   return s;
+}
+
+/*********************************************/
+/* PM_NEXT - follow edge of a pattern trie   */
+/*********************************************/
+
+static inline int pm_next(struct pm_trie *t, int s, unsigned char c)
+{
+   int n;
+
+   if (s==0) return t->root[c];
+   for (n=t->node[s].child;n && t->node[n].c!=c;n=t->node[n].next);
+   return n;
+}
+
+/*********************************************/
+/* PM_COMP - compile list of patterns        */
+/*********************************************/
+
+/* Entries are sorted the same way isinstr() handles them: '*abc'
+   (leading wildcard) matches backwards from the end of the string up
+   to the last '*', 'abc*' (trailing wildcard) matches forwards up to
+   the first '*', and anything else is a plain substring.            */
+
+static struct lmatch *pm_comp(void **ent, char **pat, int *len, int n)
+{
+   struct lmatch  *pm;
+   struct pm_trie *t[3];
+   struct pm_node *np;
+   int            i, j, s, f, u, v, *q, qh, qt;
+   char           *cp;
+
+   for (i=0;i<n;i++)                   /* leave odd ones to isinstr()  */
+      if (len[i]<1 || len[i]>=MAXKVAL) return NULL;
+
+   if ((pm=calloc(1,sizeof(struct lmatch)))==NULL) return NULL;
+   t[0]=&pm->sub; t[1]=&pm->pre; t[2]=&pm->sfx;
+   for (i=0;i<3;i++)
+   {
+      t[i]->anode=64; t[i]->nnode=1;
+      if ((t[i]->node=calloc(t[i]->anode,sizeof(struct pm_node)))==NULL)
+         { pm_free(pm); return NULL; }
+      t[i]->node[0].out=t[i]->node[0].out2=PM_NONE;
+   }
+   pm->submin=PM_NONE;
+
+   for (i=n-1;i>=0;i--)              /* last to first, so lowest wins  */
+   {
+      cp=pat[i];
+      if (cp[0]=='*')                             /* '*abc' suffix     */
+      {
+         for (j=len[i]-1;cp[j]!='*';j--);
+         if ((s=pm_add(&pm->sfx,cp+j+1,len[i]-j-1,1))<0)
+            { pm_free(pm); return NULL; }
+         if (j==0) pm->sfx.node[s].out=i;         /* just one '*'      */
+         else      pm->sfx.node[s].out2=i;
+      }
+      else if (cp[len[i]-1]=='*')                 /* 'abc*' prefix     */
+      {
+         for (j=0;cp[j]!='*';j++);
+         if ((s=pm_add(&pm->pre,cp,j,0))<0) { pm_free(pm); return NULL; }
+         pm->pre.node[s].out=i;
+      }
+      else                                        /* plain substring   */
+      {
+         if ((s=pm_add(&pm->sub,cp,len[i],0))<0) { pm_free(pm); return NULL; }
+         pm->sub.node[s].out=i;
+         pm->submin=i;
+      }
+   }
+
+   /* failure links for substrings, breadth first from the root */
+   np=pm->sub.node;
+   if ((q=malloc(pm->sub.nnode*sizeof(int)))==NULL)
+      { pm_free(pm); return NULL; }
+   qh=qt=0;
+   for (i=0;i<256;i++) if ((v=pm->sub.root[i])) { np[v].fail=0; q[qt++]=v; }
+   while (qh<qt)
+   {
+      u=q[qh++];
+      for (v=np[u].child;v;v=np[v].next)
+      {
+         for (f=np[u].fail;f && !pm_next(&pm->sub,f,np[v].c);f=np[f].fail);
+         np[v].fail=pm_next(&pm->sub,f,np[v].c);
+         if (np[np[v].fail].out<np[v].out) np[v].out=np[np[v].fail].out;
+         q[qt++]=v;
+      }
+   }
+   free(q);
+   pm->ent=ent;
+   return pm;
+}
+
+/*********************************************/
+/* PM_MATCH - first list entry matching str  */
+/*********************************************/
+
+/* returns the lowest index of a matching entry, or PM_NONE.  Same
+   results as calling isinstr() for each entry in order.            */
+
+static int pm_match(struct lmatch *pm, char *str, int slen)
+{
+   struct pm_node *np;
+   unsigned char  *cp;
+   int            best=PM_NONE, s, d, n;
+
+   /* 'abc*' - str starts with abc */
+   np=pm->pre.node;
+   for (cp=(unsigned char *)str,s=0;*cp;cp++)
+   {
+      if ((s=pm_next(&pm->pre,s,*cp))==0) break;
+      if (np[s].out<best) best=np[s].out;
+   }
+
+   /* '*abc' - str ends with abc, isinstr() never compares str[0], and
+      entries with a '*' inside need one more char before the abc    */
+   np=pm->sfx.node;
+   if (slen<=0)
+   {
+      if (np[0].out<best) best=np[0].out;
+      if (np[0].out2<best) best=np[0].out2;
+   }
+   else for (s=0,d=0;;)
+   {
+      if (np[s].out<best) best=np[s].out;
+      if (slen>=d+2 && np[s].out2<best) best=np[s].out2;
+      if (++d>slen-1) break;
+      if ((s=pm_next(&pm->sfx,s,(unsigned char)str[slen-d]))==0) break;
+   }
+
+   /* substrings (Aho-Corasick) */
+   if (pm->submin<best)
+   {
+      np=pm->sub.node;
+      for (cp=(unsigned char *)str,s=0;*cp;cp++)
+      {
+         while (s && (n=pm_next(&pm->sub,s,*cp))==0) s=np[s].fail;
+         s=(s)?n:pm->sub.root[*cp];
+         if (np[s].out<best)
+            { best=np[s].out; if (best<=pm->submin) break; }
+      }
+   }
+   return best;
+}
+
+/*********************************************/
+/* PM_FREE - free a compiled list            */
+/*********************************************/
+
+static void pm_free(struct lmatch *pm)
+{
+   if (pm->sub.node) free(pm->sub.node);
+   if (pm->pre.node) free(pm->pre.node);
+   if (pm->sfx.node) free(pm->sfx.node);
+   if (pm->ent) free(pm->ent);
+   free(pm);
+}
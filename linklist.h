@@ -1,8 +1,11 @@
 #ifndef _LINKLIST_H
 #define _LINKLIST_H
 
+struct lmatch;                            /* compiled list (linklist.c)   */
+
 struct nlist {  char string[MAXKVAL];     /* list struct for HIDE items   */
 			  int len;
+              struct lmatch *pm;          /* compiled list (head only)    */
               struct nlist *next; };
 typedef struct nlist *NLISTPTR;
 
@@ -10,6 +13,7 @@ struct glist {  char string[MAXKVAL];     /* list struct for GROUP items  */
                 char name[MAXKVAL];
 				int len;
 				int nlen;
+              struct lmatch *pm;          /* compiled list (head only)    */
               struct glist *next; };
 typedef struct glist *GLISTPTR;
 
@@ -49,5 +53,7 @@ extern char     *isinlist(NLISTPTR, char *,int len);        /* scan list for str
 extern char     *isinglist(GLISTPTR, char *,int *len);       /* scan glist for str  */
 extern int      add_nlist(char *, NLISTPTR *);      /* add list item       */
 extern int      add_glist(char *, GLISTPTR *);      /* add group list item */
+extern void     comp_nlist(NLISTPTR);               /* compile list        */
+extern void     comp_glist(GLISTPTR);               /* compile group list  */
 
 #endif  /* _LINKLIST_H */
@@ -0,0 +1,1107 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+/* Fix broken Zlib 64 bitness */
+#if _FILE_OFFSET_BITS == 64
+#ifndef _LARGEFILE64_SOURCE
+#define _LARGEFILE64_SOURCE 1
+#endif
+#endif
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>                           /* normal stuff             */
+#include <ctype.h>
+#include <zlib.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef USE_BZIP
+#include <bzlib.h>
+#endif
+
+#ifdef USE_XZ
+#include <lzma.h>
+#endif
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "webalizer.h"                        /* main header              */
+#include "lang.h"
+#include "parser.h"
+#include "logfile.h"
+#include "zthread.h"
+
+/* internal function prototypes */
+
+static int  mm_open(LFILEPTR);                /* map plain logfile        */
+static int  mm_map(LFILEPTR, off_t);          /* map logfile window       */
+static char *mm_gets(LFILEPTR, int *);        /* next mapped record       */
+static char *z_gets(LFILEPTR, int *);         /* next compressed record   */
+static int  z_fill(LFILEPTR);                /* refill decompress buffer */
+#if defined(USE_XZ) || defined(USE_ZSTD)
+static void *x_open(LFILEPTR);               /* open xz/zstd log file    */
+static void *x_init(int);                    /* create xz/zstd decoder   */
+static void x_end(LFILEPTR);                 /* free xz/zstd decoder     */
+static int  x_read(LFILEPTR);                /* decompress xz/zstd data  */
+#endif
+static char *lf_follow(LFILEPTR, int *);    /* next record (follow)     */
+static char *fl_gets(LFILEPTR, int *);       /* get complete record      */
+static int  fl_check(LFILEPTR);              /* check rotate/truncate    */
+static void fl_signal(int);                  /* stop following           */
+static int  lf_next(LFILEPTR);               /* read ahead for merge     */
+static void lf_ckid(LFILEPTR);               /* identify file (ckpt)     */
+static int  lf_ckhash(int, u_int64_t, u_int64_t *); /* hash start of file*/
+static int  lf_time(LFILEPTR);               /* get record timestamp     */
+static void heap_push(LFILEPTR);             /* merge heap functions     */
+static LFILEPTR heap_pop();
+
+/* local data */
+
+LFILEPTR *log_files  = NULL;                  /* log files to process     */
+int      log_nfiles  = 0;                     /* number of log files      */
+
+static LFILEPTR *lf_heap = NULL;              /* merge heap (by tstamp)   */
+static int      lf_hcnt  = 0;                 /* entries in merge heap    */
+static LFILEPTR lf_cur   = NULL;              /* file of last record      */
+static LFILEPTR w3c_own  = NULL;              /* file of parser's #Fields */
+
+static volatile sig_atomic_t fl_stop = 0;     /* stop following (signal)  */
+static time_t   fl_time  = 0;                 /* last report update       */
+static int      fl_nrec  = 0;                 /* records since update     */
+
+static struct lf_ckpt *ck_old = NULL;         /* restart points (state)   */
+static int      ck_nold  = 0;
+static struct lf_ckpt *ck_new = NULL;         /* closed files, to save    */
+static int      ck_nnew  = 0;
+
+/* field separators for timestamp scan */
+#define LF_SEP(c) ((c)==' '||(c)=='\t'||(c)=='\r'||(c)=='\n'||(c)=='\0')
+
+static char *lf_month="janfebmaraprmayjunjulaugsepoctnovdec";
+
+/*********************************************/
+/* LF_OPEN - open a log file for reading     */
+/*********************************************/
+
+int lf_open(char *fname, LFILEPTR *lfp)
+{
+   LFILEPTR    lf;
+   struct stat log_stat;
+   int         len;
+
+   if ( (lf=calloc(1,sizeof(struct logfile))) == NULL)
+   {
+      fprintf(stderr,"%s %s\n",msg_log_err,fname?fname:"STDIN");
+      return 1;
+   }
+   lf->fname=fname;
+   lf->comp=COMP_NONE;
+
+   if (fname==NULL)
+   {
+      lf->fp=stdin;                           /* STDIN, nothing to do     */
+      *lfp=lf;
+      return 0;
+   }
+
+   /* check for compressed file - .gz/.bz2/.xz/.zst */
+   len=strlen(fname);
+   if (len>3 && !strcmp(fname+len-3,".gz"))  lf->comp=COMP_GZIP;
+#ifdef USE_BZIP
+   if (len>4 && !strcmp(fname+len-4,".bz2")) lf->comp=COMP_BZIP;
+#endif
+#ifdef USE_XZ
+   if (len>3 && !strcmp(fname+len-3,".xz"))  lf->comp=COMP_XZ;
+#endif
+#ifdef USE_ZSTD
+   if (len>4 && !strcmp(fname+len-4,".zst")) lf->comp=COMP_ZSTD;
+#endif
+
+   /* stat the file */
+   if ( !(lstat(fname, &log_stat)) )
+   {
+      /* check if the file a symlink */
+      if ( S_ISLNK(log_stat.st_mode) )
+      {
+         if (verbose)
+         fprintf(stderr,"%s %s (symlink)\n",msg_log_err,fname);
+         free(lf);
+         return EBADF;
+      }
+   }
+
+   if (lf->comp)
+   {
+#ifdef USE_THREADS
+      /* decompress in other threads if we can */
+      if ( dz_threads && (lf->dz=dz_open(fname,lf->comp))!=NULL )
+      {
+         *lfp=lf;
+         return 0;
+      }
+#endif
+      /* open compressed file */
+      switch (lf->comp)
+      {
+#ifdef USE_BZIP
+         case COMP_BZIP: lf->zfp = BZ2_bzopen(fname,"rb"); break;
+#endif
+#if defined(USE_XZ) || defined(USE_ZSTD)
+         case COMP_XZ:
+         case COMP_ZSTD: lf->zfp = x_open(lf);              break;
+#endif
+         default:        lf->zfp = gzopen(fname, "rb");    break;
+      }
+      if ( (lf->zfp==Z_NULL) || ((lf->f_buf=malloc(LF_BUFSIZE))==NULL) )
+      {
+         /* Error: Can't open log file ... */
+         fprintf(stderr, "%s %s (%d)\n",msg_log_err,fname,ENOENT);
+         free(lf);
+         return ENOENT;
+      }
+      lf->f_cp=lf->f_ep=lf->f_buf;
+   }
+   else
+   {
+      /* open regular file */
+      if ( (lf->fp=fopen(fname,"r")) == NULL)
+      {
+         /* Error: Can't open log file ... */
+         fprintf(stderr, "%s %s\n",msg_log_err,fname);
+         free(lf);
+         return 1;
+      }
+
+      if (follow)
+      {
+         /* we reopen by name after rotation, and after chdir(out_dir) */
+         if (fname[0]=='/') lf->fl_path=strdup(fname);
+         else if (getcwd(lf->buf,BUFSIZE)!=NULL &&
+                  (lf->fl_path=malloc(strlen(lf->buf)+len+2))!=NULL)
+            sprintf(lf->fl_path,"%s/%s",lf->buf,fname);
+         if (lf->fl_path==NULL)
+         {
+            fprintf(stderr, "%s %s\n",msg_log_err,fname);
+            fclose(lf->fp); free(lf);
+            return 1;
+         }
+      }
+      lf_ckid(lf);                            /* for incremental restart  */
+      if (!follow) mm_open(lf);               /* use mmap if we can       */
+   }
+   *lfp=lf;
+   return 0;
+}
+
+/*********************************************/
+/* LF_GETS - get next record from log file   */
+/*********************************************/
+
+char *lf_gets(LFILEPTR lf, int *len)
+{
+   if (lf->mm_base!=NULL) return mm_gets(lf,len);
+   if (lf->comp)          return z_gets(lf,len);
+
+   if (fgets(lf->buf,BUFSIZE,lf->fp)==NULL) return NULL;
+   *len=strlen(lf->buf);
+   lf->rd_pos+=*len;
+   if (lf->buf[*len-1]=='\n') lf->ck.pos=lf->rd_pos;
+   return lf->buf;
+}
+
+/*********************************************/
+/* LF_REWIND - rewind log file (DNS pass)    */
+/*********************************************/
+
+int lf_rewind(LFILEPTR lf)
+{
+   if (lf->fname==NULL) return -1;            /* can't rewind STDIN       */
+   lf->ck.pos=lf->rd_pos=0;
+
+   if (lf->mm_base!=NULL)
+   {
+      if (lf->mm_term!=NULL) { *lf->mm_term=lf->mm_save; lf->mm_term=NULL; }
+      lf->mm_pos=0;
+      return (lf->mm_woff==0)?0:(mm_map(lf,0)?0:-1);
+   }
+
+#ifdef USE_THREADS
+   if (lf->dz!=NULL)
+   {
+      /* just start over */
+      dz_close(lf->dz);
+      lf->f_cp=lf->f_ep=NULL;
+      return ( (lf->dz=dz_open(lf->fname,lf->comp))==NULL )?-1:0;
+   }
+#endif
+
+   lf->f_cp=lf->f_ep=lf->f_buf;
+   switch (lf->comp)
+   {
+#ifdef USE_BZIP
+      case COMP_BZIP:
+         /* no bz2 rewind, so re-open */
+         BZ2_bzclose(lf->zfp);
+         lf->zfp=BZ2_bzopen(lf->fname,"rb");
+         return (lf->zfp==Z_NULL)?-1:0;
+#endif
+#if defined(USE_XZ) || defined(USE_ZSTD)
+      case COMP_XZ:
+      case COMP_ZSTD:
+         /* new decoder, back to start of file */
+         x_end(lf);
+         rewind(lf->fp);
+         lf->z_inlen=lf->z_inpos=0; lf->z_eof=0;
+         return ( (lf->zfp=x_init(lf->comp))==NULL )?-1:0;
+#endif
+      case COMP_GZIP: return gzrewind(lf->zfp);
+      default:        rewind(lf->fp); return 0;
+   }
+}
+
+/*********************************************/
+/* LF_CLOSE - close log file                 */
+/*********************************************/
+
+void lf_close(LFILEPTR lf)
+{
+   struct lf_ckpt *ck;
+
+   /* keep restart point for save_state() */
+   if (lf->ck_ok && (ck=realloc(ck_new,(ck_nnew+1)*sizeof(struct lf_ckpt))))
+      { ck_new=ck; ck_new[ck_nnew++]=lf->ck; }
+
+   if (lf->mm_base!=NULL) munmap(lf->mm_base, lf->mm_wlen);
+#ifdef USE_THREADS
+   if (lf->dz!=NULL) dz_close(lf->dz);
+   else
+#endif
+   switch (lf->comp)
+   {
+#ifdef USE_BZIP
+      case COMP_BZIP: BZ2_bzclose(lf->zfp); break;
+#endif
+#if defined(USE_XZ) || defined(USE_ZSTD)
+      case COMP_XZ:
+      case COMP_ZSTD: x_end(lf); fclose(lf->fp); break;
+#endif
+      case COMP_GZIP: gzclose(lf->zfp);     break;
+      default: if (lf->fname) fclose(lf->fp); break;
+   }
+   if (lf->z_in)       free(lf->z_in);
+   if (lf->f_buf)      free(lf->f_buf);
+   if (lf->w3c_fields) free(lf->w3c_fields);
+   if (lf->fl_path)    free(lf->fl_path);
+   free(lf);
+}
+
+/*********************************************/
+/* Z_GETS - get record from compressed file  */
+/*********************************************/
+
+static char *z_gets(LFILEPTR lf, int *len)
+{
+   char *out_cp=lf->buf, *eol=NULL;
+   int  size=BUFSIZE-1, n;            /* same chunking as fgets */
+
+   while (size && eol==NULL)
+   {
+      if (lf->f_cp>=lf->f_ep)         /* load? */
+      {
+         if (z_fill(lf)<=0)
+         {
+            if (out_cp==lf->buf) return NULL;
+            break;
+         }
+      }
+
+      /* copy up to end of line, buffer or record space */
+      n=lf->f_ep-lf->f_cp;
+      if (n>size) n=size;
+      if ( (eol=memchr(lf->f_cp,'\n',n)) != NULL) n=eol-lf->f_cp+1;
+      memcpy(out_cp,lf->f_cp,n);
+      out_cp+=n; lf->f_cp+=n; size-=n;
+   }
+   *out_cp='\0';
+   *len=strlen(lf->buf);
+   return lf->buf;
+}
+
+/*********************************************/
+/* Z_FILL - get more decompressed data       */
+/*********************************************/
+
+static int z_fill(LFILEPTR lf)
+{
+   int n;
+
+#ifdef USE_THREADS
+   if (lf->dz!=NULL) n=dz_read(lf->dz,&lf->f_cp);
+   else
+#endif
+   {
+      switch (lf->comp)
+      {
+#ifdef USE_BZIP
+         case COMP_BZIP: n=BZ2_bzread(lf->zfp, lf->f_buf, LF_BUFSIZE); break;
+#endif
+#if defined(USE_XZ) || defined(USE_ZSTD)
+         case COMP_XZ:
+         case COMP_ZSTD: n=x_read(lf);                                break;
+#endif
+         default:        n=gzread(lf->zfp, lf->f_buf, LF_BUFSIZE);   break;
+      }
+      lf->f_cp=lf->f_buf;
+   }
+   lf->f_ep=(n>0)?lf->f_cp+n:lf->f_cp;
+   return n;
+}
+
+#if defined(USE_XZ) || defined(USE_ZSTD)
+
+/*********************************************/
+/* X_OPEN - open xz/zstd compressed log file */
+/*********************************************/
+
+static void *x_open(LFILEPTR lf)
+{
+   void *zfp=NULL;
+
+   if ( (lf->fp=fopen(lf->fname,"rb")) == NULL) return NULL;
+   if ( (lf->z_in=malloc(LF_BUFSIZE)) != NULL) zfp=x_init(lf->comp);
+   if (zfp==NULL)
+   {
+      fclose(lf->fp);
+      if (lf->z_in) free(lf->z_in);
+      lf->fp=NULL; lf->z_in=NULL;
+   }
+   lf->z_inlen=lf->z_inpos=0; lf->z_eof=0;
+   return zfp;
+}
+
+/*********************************************/
+/* X_INIT - create xz/zstd stream decoder    */
+/*********************************************/
+
+static void *x_init(int comp)
+{
+#ifdef USE_XZ
+   lzma_stream xs_init=LZMA_STREAM_INIT;
+   lzma_stream *xs;
+
+   if (comp==COMP_XZ)
+   {
+      if ( (xs=malloc(sizeof(lzma_stream))) == NULL) return NULL;
+      *xs=xs_init;
+      /* handle concatenated .xz streams like xz -dc does */
+      if (lzma_stream_decoder(xs,UINT64_MAX,LZMA_CONCATENATED)!=LZMA_OK)
+         { free(xs); return NULL; }
+      return xs;
+   }
+#endif
+#ifdef USE_ZSTD
+   ZSTD_DStream *zs;
+
+   if (comp==COMP_ZSTD)
+   {
+      if ( (zs=ZSTD_createDStream()) == NULL) return NULL;
+      if (ZSTD_isError(ZSTD_initDStream(zs)))
+         { ZSTD_freeDStream(zs); return NULL; }
+      return zs;
+   }
+#endif
+   return NULL;
+}
+
+/*********************************************/
+/* X_END - free xz/zstd stream decoder       */
+/*********************************************/
+
+static void x_end(LFILEPTR lf)
+{
+   if (lf->zfp==NULL) return;
+#ifdef USE_XZ
+   if (lf->comp==COMP_XZ) { lzma_end(lf->zfp); free(lf->zfp); }
+#endif
+#ifdef USE_ZSTD
+   if (lf->comp==COMP_ZSTD) ZSTD_freeDStream(lf->zfp);
+#endif
+   lf->zfp=NULL;
+}
+
+/*********************************************/
+/* X_READ - decompress some xz/zstd data     */
+/*********************************************/
+
+static int x_read(LFILEPTR lf)
+{
+   size_t out=0;
+   int    err=0;
+
+   while (out==0 && !lf->z_eof)
+   {
+      /* need more input? */
+      if (lf->z_inpos==lf->z_inlen)
+      {
+         lf->z_inlen=fread(lf->z_in,1,LF_BUFSIZE,lf->fp);
+         lf->z_inpos=0;
+      }
+
+#ifdef USE_XZ
+      if (lf->comp==COMP_XZ)
+      {
+         lzma_stream *xs=lf->zfp;
+         lzma_ret    ret;
+
+         xs->next_in=(uint8_t *)lf->z_in+lf->z_inpos;
+         xs->avail_in=lf->z_inlen-lf->z_inpos;
+         xs->next_out=(uint8_t *)lf->f_buf;
+         xs->avail_out=LF_BUFSIZE;
+         ret=lzma_code(xs,(lf->z_inlen)?LZMA_RUN:LZMA_FINISH);
+         lf->z_inpos=lf->z_inlen-xs->avail_in;
+         out=LF_BUFSIZE-xs->avail_out;
+         if (ret==LZMA_STREAM_END) lf->z_eof=1;
+         else if (ret!=LZMA_OK) lf->z_eof=err=1;
+      }
+#endif
+#ifdef USE_ZSTD
+      if (lf->comp==COMP_ZSTD)
+      {
+         ZSTD_inBuffer  zin;
+         ZSTD_outBuffer zout;
+
+         zin.src=lf->z_in; zin.size=lf->z_inlen; zin.pos=lf->z_inpos;
+         zout.dst=lf->f_buf; zout.size=LF_BUFSIZE; zout.pos=0;
+         if (ZSTD_isError(ZSTD_decompressStream(lf->zfp,&zout,&zin)))
+            lf->z_eof=err=1;
+         lf->z_inpos=zin.pos;
+         out=zout.pos;
+      }
+#endif
+      /* end of file and nothing more to flush */
+      if (lf->z_inlen==0 && out==0) lf->z_eof=1;
+   }
+   return (out==0 && err)?-1:(int)out;
+}
+
+#endif  /* USE_XZ || USE_ZSTD */
+
+/*********************************************/
+/* MM_OPEN - mmap a plain (uncompressed) log */
+/*********************************************/
+
+static int mm_open(LFILEPTR lf)
+{
+   struct stat mm_stat;
+
+   /* only regular, non-empty files can be mapped */
+   if (fstat(fileno(lf->fp), &mm_stat) || !S_ISREG(mm_stat.st_mode)
+       || mm_stat.st_size==0) return 0;
+
+   lf->mm_size=mm_stat.st_size;
+   if (mm_map(lf,0)) return 1;
+   return 0;                         /* mmap failed, fall back to stdio */
+}
+
+/*********************************************/
+/* MM_MAP - map window of logfile at offset  */
+/*********************************************/
+
+static int mm_map(LFILEPTR lf, off_t off)
+{
+   long pgsize=sysconf(_SC_PAGESIZE);
+
+   if (lf->mm_base!=NULL) munmap(lf->mm_base, lf->mm_wlen);
+
+   /* window must start on a page boundary */
+   lf->mm_woff=off-(off%pgsize);
+   lf->mm_wlen=(lf->mm_size-lf->mm_woff>MM_WINSIZE)?
+               MM_WINSIZE:(size_t)(lf->mm_size-lf->mm_woff);
+
+   /* private & writable, so the parser can work in-place */
+   lf->mm_base=mmap(NULL, lf->mm_wlen, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+                    fileno(lf->fp), lf->mm_woff);
+   if (lf->mm_base==MAP_FAILED) { lf->mm_base=NULL; return 0; }
+   madvise(lf->mm_base, lf->mm_wlen, MADV_SEQUENTIAL);
+   return 1;
+}
+
+/*********************************************/
+/* MM_GETS - get next record from mapping    */
+/*********************************************/
+
+static char *mm_gets(LFILEPTR lf, int *len)
+{
+   char   *cp, *eol;
+   size_t n;
+   long   pgsize;
+
+   /* put back char under previous terminator */
+   if (lf->mm_term!=NULL) { *lf->mm_term=lf->mm_save; lf->mm_term=NULL; }
+
+   if (lf->mm_pos>=lf->mm_size) return NULL;   /* all done */
+
+   /* ensure a full record fits in the window, remap if not */
+   if ( (lf->mm_pos-lf->mm_woff+BUFSIZE > (off_t)lf->mm_wlen) &&
+        (lf->mm_woff+(off_t)lf->mm_wlen < lf->mm_size) )
+   {
+      if (!mm_map(lf,lf->mm_pos))
+      {
+         if (verbose) fprintf(stderr,"%s %s\n",msg_log_err,lf->fname);
+         return NULL;
+      }
+   }
+
+   /* same chunking as fgets(buffer,BUFSIZE) */
+   cp=lf->mm_base+(lf->mm_pos-lf->mm_woff);
+   n=(lf->mm_size-lf->mm_pos<BUFSIZE-1)?
+     (size_t)(lf->mm_size-lf->mm_pos):BUFSIZE-1;
+   if ( (eol=memchr(cp,'\n',n))!=NULL ) n=eol-cp+1;
+   lf->mm_pos+=n;
+   if (eol!=NULL) lf->ck.pos=lf->mm_pos;
+
+   /* need a terminator: use the mapping unless at end of last page */
+   pgsize=sysconf(_SC_PAGESIZE);
+   if ( (lf->mm_pos-lf->mm_woff==(off_t)lf->mm_wlen) &&
+        (lf->mm_wlen%pgsize==0) )
+   {
+      memcpy(lf->buf,cp,n);               /* no room, copy it instead    */
+      lf->buf[n]='\0';
+      cp=lf->buf;
+   }
+   else
+   {
+      lf->mm_term=cp+n; lf->mm_save=*lf->mm_term; *lf->mm_term='\0';
+   }
+   *len=strlen(cp);
+   return cp;
+}
+
+/*********************************************/
+/* LF_MERGE_INIT - prime the k-way merge     */
+/*********************************************/
+
+void lf_merge_init()
+{
+   int i;
+
+   if (log_nfiles<2) return;                  /* nothing to merge         */
+
+   if ( (lf_heap=calloc(log_nfiles,sizeof(LFILEPTR))) == NULL)
+   {
+      fprintf(stderr,"Error: Can't allocate memory to merge log files\n");
+      exit(1);
+   }
+
+   /* read first record from each file */
+   for (i=0;i<log_nfiles;i++)
+   {
+      log_files[i]->idx=i;
+      if (lf_next(log_files[i])) heap_push(log_files[i]);
+   }
+}
+
+/*********************************************/
+/* GET_RECORD - next record, in time order   */
+/*********************************************/
+
+char *get_record(int *len)
+{
+   LFILEPTR lf;
+   char     buf[BUFSIZE];
+   int      big;
+
+   /* single file, no merge needed */
+   if (log_nfiles==1)
+      return (follow)?lf_follow(log_files[0],len):lf_gets(log_files[0],len);
+
+   if ( (lf=lf_cur) != NULL)
+   {
+      /* rest of an oversized record comes from the same file */
+      big=(lf->len==BUFSIZE-1);
+      lf_cur=NULL;
+      if (big)
+      {
+         if ( (lf->rec=lf_gets(lf,&lf->len)) == NULL) return NULL;
+         lf_cur=lf;
+         *len=lf->len;
+         return lf->rec;
+      }
+      if (lf_next(lf)) heap_push(lf);         /* back into the heap       */
+   }
+
+   if ( (lf=heap_pop()) == NULL) return NULL; /* all done                 */
+   lf_cur=lf;
+
+   /* make sure the parser is using this file's W3C field list */
+   if (log_type==LOG_W3C && lf->w3c_fields && w3c_own!=lf)
+   {
+      if (strncmp(lf->rec,"#Fields:",8))
+      {
+         strncpy(buf,lf->w3c_fields,BUFSIZE-1); buf[BUFSIZE-1]='\0';
+         parse_record(buf,strlen(buf),&log_rec);
+      }
+      w3c_own=lf;
+   }
+
+   *len=lf->len;
+   return lf->rec;
+}
+
+/*********************************************/
+/* LF_FOLLOW_INIT - setup for follow mode    */
+/*********************************************/
+
+void lf_follow_init()
+{
+   struct sigaction sig_act;
+
+   /* no SA_RESTART, so a blocked read on STDIN wakes up too */
+   sig_act.sa_handler=fl_signal;
+   sig_act.sa_flags=0;
+   sigemptyset(&sig_act.sa_mask);
+   sigaction(SIGINT, &sig_act, NULL);
+   sigaction(SIGTERM, &sig_act, NULL);
+
+   fl_time=time(NULL);
+   fl_nrec=0;
+}
+
+/*********************************************/
+/* FL_SIGNAL - finish up and exit (follow)   */
+/*********************************************/
+
+static void fl_signal(int signum)
+{
+   fl_stop=1;
+}
+
+/*********************************************/
+/* LF_FOLLOW - next record, wait if needed   */
+/*********************************************/
+
+static char *lf_follow(LFILEPTR lf, int *len)
+{
+   char   *rec;
+   time_t now;
+
+   while (!fl_stop)
+   {
+      /* time to refresh the reports? */
+      now=time(NULL);
+      if ( fl_nrec && ( (follow_recs && fl_nrec>=follow_recs) ||
+                        (now-fl_time>=follow_int) ) )
+      {
+         follow_update();
+         fl_time=now;
+         fl_nrec=0;
+      }
+
+      if ( (rec=fl_gets(lf,len)) != NULL) { fl_nrec++; return rec; }
+      if (lf->fname==NULL) break;             /* end of STDIN             */
+      if (!fl_check(lf)) sleep(1);            /* wait for more data       */
+   }
+   return NULL;
+}
+
+/*********************************************/
+/* FL_GETS - get complete record (follow)    */
+/*********************************************/
+
+static char *fl_gets(LFILEPTR lf, int *len)
+{
+   off_t pos=(lf->fname)?ftello(lf->fp):0;
+
+   if (fgets(lf->buf,BUFSIZE,lf->fp)==NULL)
+   {
+      clearerr(lf->fp);                       /* so we see new data       */
+      return NULL;
+   }
+
+   /* hit EOF before newline: writer isn't done with it yet */
+   if (lf->fname && feof(lf->fp) && !lf->fl_done)
+   {
+      fseeko(lf->fp,pos,SEEK_SET);            /* try again later          */
+      return NULL;
+   }
+   *len=strlen(lf->buf);
+   if (lf->buf[*len-1]=='\n') lf->ck.pos=pos+*len;
+   return lf->buf;
+}
+
+/*********************************************/
+/* FL_CHECK - check if log rotated/truncated */
+/*********************************************/
+
+static int fl_check(LFILEPTR lf)
+{
+   struct stat f_stat, n_stat;
+   off_t       pos=ftello(lf->fp);
+   FILE        *fp;
+
+   if (fstat(fileno(lf->fp),&f_stat)) return 0;
+   if (stat(lf->fl_path,&n_stat))     return 0;  /* gone, wait for new one */
+
+   if ( (n_stat.st_dev==f_stat.st_dev) && (n_stat.st_ino==f_stat.st_ino) )
+   {
+      if (f_stat.st_size>=pos) return 0;      /* same file, nothing new   */
+
+      /* file got smaller (copytruncate), start over */
+      if (verbose>1) printf("%s %s (truncated)\n",msg_log_use,lf->fname);
+      rewind(lf->fp);
+      lf_ckid(lf);
+      return 1;
+   }
+
+   /* rotated, but finish up the old one first */
+   if (f_stat.st_size>pos) { lf->fl_done=1; return 1; }
+
+   if ( (fp=fopen(lf->fl_path,"r")) == NULL) return 0;
+   fclose(lf->fp);
+   lf->fp=fp;
+   lf->fl_done=0;
+   lf_ckid(lf);
+   if (verbose>1) printf("%s %s (rotated)\n",msg_log_use,lf->fname);
+   return 1;
+}
+
+/*********************************************/
+/* LF_NEXT - read ahead next record of file  */
+/*********************************************/
+
+static int lf_next(LFILEPTR lf)
+{
+   if ( (lf->rec=lf_gets(lf,&lf->len)) == NULL) return 0;
+
+   /* W3C logs: remember this file's field list */
+   if (log_type==LOG_W3C && !strncmp(lf->rec,"#Fields:",8))
+   {
+      if (lf->w3c_fields) free(lf->w3c_fields);
+      lf->w3c_fields=strdup(lf->rec);
+   }
+
+   /* no usable timestamp? keep it where it is in this file */
+   lf_time(lf);
+   return 1;
+}
+
+/*********************************************/
+/* LF_NUM - convert fixed number of digits   */
+/*********************************************/
+
+static int lf_num(char *cp, int n)
+{
+   int i=0;
+   while (n--)
+   {
+      if (*cp<'0' || *cp>'9') return -1;
+      i=(i*10)+(*cp++-'0');
+   }
+   return i;
+}
+
+/*********************************************/
+/* LF_TSTAMP - date/time to merge timestamp  */
+/*********************************************/
+
+static int lf_tstamp(LFILEPTR lf, int day, char *mon, int month,
+                     int year, char *tm)
+{
+   int i, hour, min, sec;
+
+   /* month name or number */
+   if (mon!=NULL)
+   {
+      for (i=0;i<12;i++)
+         if ( (tolower(mon[0])==lf_month[i*3])   &&
+              (tolower(mon[1])==lf_month[i*3+1]) &&
+              (tolower(mon[2])==lf_month[i*3+2]) ) break;
+      month=i+1;
+   }
+   hour=lf_num(tm,2); min=lf_num(tm+3,2); sec=lf_num(tm+6,2);
+
+   if ( (month<1) || (month>12) || (day<1) || (day>31) || (year<1970) ||
+        (hour<0) || (min<0) || (sec<0) || (tm[2]!=':') || (tm[5]!=':') )
+      return 0;
+
+   lf->tstamp=((jdate(day,month,year)-epoch)*86400)+
+               (hour*3600)+(min*60)+sec;
+   return 1;
+}
+
+/*********************************************/
+/* LF_TIME - get timestamp of current record */
+/*********************************************/
+
+static int lf_time(LFILEPTR lf)
+{
+   char *cp=lf->rec, *eob=lf->rec+lf->len;
+   char *fld[32], dt[29];
+   int  i, n;
+
+   switch (log_type)
+   {
+      case LOG_SQUID:
+         /* seconds since epoch */
+         if (*cp<'0' || *cp>'9') return 0;
+         lf->tstamp=strtoul(cp,NULL,10);
+         return 1;
+
+      case LOG_W3C:
+      case LOG_FTP:
+         /* split up (copy of) whitespace separated fields */
+         for (n=0; n<32 && cp<eob; n++)
+         {
+            while (cp<eob && (*cp==' '||*cp=='\t')) cp++;
+            fld[n]=cp;
+            while (cp<eob && !LF_SEP(*cp)) cp++;
+            if (cp==fld[n]) break;
+         }
+
+         if (log_type==LOG_FTP)
+         {
+            /* Www Mmm dd hh:mm:ss yyyy */
+            if (n<5) return 0;
+            return lf_tstamp(lf,atoi(fld[2]),fld[1],0,atoi(fld[4]),fld[3]);
+         }
+
+         if (*lf->rec=='#')
+         {
+            /* find date & time in the '#Fields:' list */
+            if (strncmp(lf->rec,"#Fields:",8)) return 0;
+            lf->w3c_date=lf->w3c_time=0;
+            for (i=1;i<n;i++)
+            {
+               if (!strncmp(fld[i],"date",4) && LF_SEP(fld[i][4]))
+                  lf->w3c_date=i;
+               if (!strncmp(fld[i],"time",4) && LF_SEP(fld[i][4]))
+                  lf->w3c_time=i;
+            }
+            return 0;
+         }
+
+         /* yyyy-mm-dd hh:mm:ss */
+         if ( !lf->w3c_date || !lf->w3c_time ||
+              (n<lf->w3c_date) || (n<lf->w3c_time) ) return 0;
+         cp=fld[lf->w3c_date-1];
+         if (cp[4]!='-' || cp[7]!='-') return 0;
+         return lf_tstamp(lf,lf_num(cp+8,2),NULL,lf_num(cp+5,2),
+                          lf_num(cp,4),fld[lf->w3c_time-1]);
+
+      case LOG_JSON:
+         /* pull out the date, then same as CLF */
+         if (!json_tstamp(lf->rec,lf->len,dt)) return 0;
+         cp=dt; eob=dt+strlen(dt);
+         /* fall through */
+
+      case LOG_CLF:
+      default:
+         /* [dd/Mon/yyyy:hh:mm:ss */
+         while (cp<eob && *cp!='[') cp++;
+         if (eob-cp<21 || cp[3]!='/' || cp[7]!='/' || cp[12]!=':') return 0;
+         return lf_tstamp(lf,lf_num(cp+1,2),cp+4,0,lf_num(cp+8,4),cp+13);
+   }
+}
+
+/*********************************************/
+/* HEAP_PUSH - add file to merge heap        */
+/*********************************************/
+
+#define LF_LESS(a,b) ( ((a)->tstamp<(b)->tstamp) || \
+                       ((a)->tstamp==(b)->tstamp && (a)->idx<(b)->idx) )
+
+static void heap_push(LFILEPTR lf)
+{
+   int i=lf_hcnt++, p;
+
+   while (i>0)
+   {
+      p=(i-1)/2;
+      if (!LF_LESS(lf,lf_heap[p])) break;
+      lf_heap[i]=lf_heap[p];
+      i=p;
+   }
+   lf_heap[i]=lf;
+}
+
+/*********************************************/
+/* HEAP_POP - remove oldest file from heap   */
+/*********************************************/
+
+static LFILEPTR heap_pop()
+{
+   LFILEPTR top, lf;
+   int      i=0, c;
+
+   if (lf_hcnt==0) return NULL;
+   top=lf_heap[0];
+   lf=lf_heap[--lf_hcnt];
+
+   while ( (c=(i*2)+1) < lf_hcnt )
+   {
+      if ( (c+1<lf_hcnt) && LF_LESS(lf_heap[c+1],lf_heap[c]) ) c++;
+      if (!LF_LESS(lf_heap[c],lf)) break;
+      lf_heap[i]=lf_heap[c];
+      i=c;
+   }
+   lf_heap[i]=lf;
+   return top;
+}
+
+/*********************************************/
+/* LF_CKID - identify log file (incremental) */
+/*********************************************/
+
+static void lf_ckid(LFILEPTR lf)
+{
+   struct stat ck_stat;
+
+   lf->ck_ok=0;
+   lf->ck.pos=lf->rd_pos=0;
+   if (lf->fname==NULL || lf->comp) return;   /* only plain files         */
+   if (fstat(fileno(lf->fp),&ck_stat) || !S_ISREG(ck_stat.st_mode)) return;
+
+   lf->ck.dev =ck_stat.st_dev;
+   lf->ck.ino =ck_stat.st_ino;
+   lf->ck.size=ck_stat.st_size;
+   lf->ck_ok=lf_ckhash(fileno(lf->fp),lf->ck.size,&lf->ck.hash);
+}
+
+/*********************************************/
+/* LF_CKHASH - hash first block of log file  */
+/*********************************************/
+
+static int lf_ckhash(int fd, u_int64_t size, u_int64_t *hash)
+{
+   unsigned char buf[LF_CKBLK];
+   ssize_t  i, n;
+   u_int64_t h=14695981039346656037ULL;       /* FNV-1a 64 bit            */
+
+   if (size>LF_CKBLK) size=LF_CKBLK;
+   if ( (n=pread(fd,buf,size,0)) != (ssize_t)size) return 0;
+   for (i=0;i<n;i++) { h^=buf[i]; h*=1099511628211ULL; }
+   *hash=h;
+   return 1;
+}
+
+/*********************************************/
+/* LF_CKPT_ADD - restart point from state    */
+/*********************************************/
+
+void lf_ckpt_add(struct lf_ckpt *ck)
+{
+   struct lf_ckpt *cp;
+
+   if ( (cp=realloc(ck_old,(ck_nold+1)*sizeof(struct lf_ckpt))) == NULL)
+      return;                                 /* just rescan then         */
+   ck_old=cp;
+   ck_old[ck_nold++]=*ck;
+}
+
+/*********************************************/
+/* LF_CKPT_SAVE - write restart points       */
+/*********************************************/
+
+int lf_ckpt_save(FILE *fp)
+{
+   struct lf_ckpt *ck;
+   int  i;
+
+   if (fputs("# -logs- \n",fp)==EOF) return 1;
+   for (i=0;i<ck_nnew+log_nfiles;i++)
+   {
+      /* closed files first, then any still open (follow mode) */
+      if (i<ck_nnew) ck=&ck_new[i];
+      else
+      {
+         if (log_files[i-ck_nnew]==NULL || !log_files[i-ck_nnew]->ck_ok)
+            continue;
+         ck=&log_files[i-ck_nnew]->ck;
+      }
+      if (fprintf(fp,"%llu %llu %llu %llu %llu\n",
+          (unsigned long long)ck->dev,(unsigned long long)ck->ino,
+          (unsigned long long)ck->size,(unsigned long long)ck->hash,
+          (unsigned long long)ck->pos)<0) return 1;
+   }
+   if (fputs("# End Of Table - logs\n",fp)==EOF) return 1;
+   return 0;
+}
+
+/*********************************************/
+/* LF_RESUME - skip what the last run did    */
+/*********************************************/
+
+void lf_resume()
+{
+   LFILEPTR    lf;
+   struct stat ck_stat;
+   u_int64_t   hash;
+   int         i, j;
+
+   /* W3C logs need the '#Fields:' line at the start, so always rescan */
+   if (log_type==LOG_W3C) return;
+
+   for (i=0;i<log_nfiles;i++)
+   {
+      lf=log_files[i];
+      if (!lf->ck_ok) continue;
+
+      for (j=0;j<ck_nold;j++)
+         if (ck_old[j].dev==lf->ck.dev && ck_old[j].ino==lf->ck.ino) break;
+      if (j==ck_nold || ck_old[j].pos==0) continue;
+
+      /* same file?  If not, the timestamp check sorts it out */
+      if (fstat(fileno(lf->fp),&ck_stat)) continue;
+      if ( (u_int64_t)ck_stat.st_size < ck_old[j].size ||
+           (u_int64_t)ck_stat.st_size < ck_old[j].pos ) continue;
+      if (!lf_ckhash(fileno(lf->fp),ck_old[j].size,&hash) ||
+          hash!=ck_old[j].hash) continue;
+
+      /* Ok, start at the record after the last one done */
+      if (verbose>1) printf("%s %s (at %llu)\n",msg_log_use,
+                            lf->fname,(unsigned long long)ck_old[j].pos);
+      lf->ck.pos=ck_old[j].pos;
+      if (lf->mm_base!=NULL) lf->mm_pos=lf->ck.pos;  /* remaps if needed */
+      else
+      {
+         fseeko(lf->fp,(off_t)lf->ck.pos,SEEK_SET);
+         lf->rd_pos=lf->ck.pos;
+      }
+   }
+}
@@ -0,0 +1,64 @@
+#ifndef _LOGFILE_H
+#define _LOGFILE_H
+
+#define LF_BUFSIZE 16384                   /* decompression buffer size    */
+#define MM_WINSIZE (64*1024*1024)          /* mmap window (addr space)     */
+#define LF_CKBLK   4096                    /* bytes hashed for file ident  */
+
+/* incremental restart point for a plain log file */
+struct lf_ckpt { u_int64_t dev;            /* device of logfile            */
+                 u_int64_t ino;            /* inode of logfile             */
+                 u_int64_t size;           /* size when identified         */
+                 u_int64_t hash;           /* hash of first LF_CKBLK bytes */
+                 u_int64_t pos; };         /* end of last full record      */
+
+struct logfile { char *fname;              /* log filename (NULL=STDIN)    */
+                  int comp;                /* compression (COMP_xxx)       */
+                 FILE *fp;                 /* regular file pointer         */
+                 void *zfp;                /* compressed file pointer      */
+                 char *f_buf;              /* decompression buffer         */
+                 char *f_cp;               /* pointer into the buffer      */
+                 char *f_ep;               /* end of data in the buffer    */
+                 void *dz;                 /* threaded decompressor        */
+                 char *z_in;               /* xz/zstd input buffer         */
+               size_t z_inlen;             /* bytes in input buffer        */
+               size_t z_inpos;             /* bytes used so far            */
+                  int z_eof;               /* end of xz/zstd data          */
+                 char *mm_base;            /* mapped window of logfile     */
+               size_t mm_wlen;             /* length of mapped window      */
+                off_t mm_woff;             /* file offset of window        */
+                off_t mm_size;             /* size of mapped logfile       */
+                off_t mm_pos;              /* file offset of next record   */
+                 char *mm_term;            /* record terminator we set     */
+                 char mm_save;             /* char under terminator        */
+                 char *rec;                /* current record (merge)       */
+                  int len;                 /* current record length        */
+            u_int64_t tstamp;              /* current record timestamp     */
+                  int idx;                 /* command line order           */
+                  int w3c_date;            /* W3C date/time field index    */
+                  int w3c_time;
+                 char *w3c_fields;         /* last W3C '#Fields:' line     */
+                 char *fl_path;            /* absolute filename (follow)   */
+                  int fl_done;             /* file rotated away (follow)   */
+                  int ck_ok;               /* ck has file identity         */
+                off_t rd_pos;              /* bytes read (stdio)           */
+       struct lf_ckpt ck;                  /* restart point (incremental)  */
+                 char buf[BUFSIZE]; };     /* record buffer                */
+
+typedef struct logfile *LFILEPTR;
+
+extern LFILEPTR *log_files;                /* log files to process         */
+extern int      log_nfiles;                /* number of log files          */
+
+extern int      lf_open(char *, LFILEPTR *);        /* open a log file     */
+extern char     *lf_gets(LFILEPTR, int *);          /* get next record     */
+extern int      lf_rewind(LFILEPTR);                /* rewind log file     */
+extern void     lf_close(LFILEPTR);                 /* close log file      */
+extern void     lf_merge_init();                    /* setup k-way merge   */
+extern char     *get_record(int *);                 /* next merged record  */
+extern void     lf_follow_init();                   /* setup follow mode   */
+extern void     lf_ckpt_add(struct lf_ckpt *);      /* saved restart point */
+extern int      lf_ckpt_save(FILE *);               /* save restart points */
+extern void     lf_resume();                        /* skip done records   */
+
+#endif  /* _LOGFILE_H */
@@ -1937,6 +1937,7 @@ void top_ctry_table()
    int       ctry_fnd=0;
    u_int64_t idx;
    HNODEPTR  hptr;
+   struct ht_pos hp;
    char      *domain;
    u_int64_t pie_data[10];
    char      *pie_legend[10];
@@ -1953,82 +1954,86 @@ void top_ctry_table()
 #endif
    char          geo_ctry[3]="--";
 
+   /* start from zero, may get called more than once (follow mode) */
+   for (i=0;ctry[i].desc;i++)
+   {
+      ctry[i].count=0;
+      ctry[i].files=0;
+      ctry[i].xfer=0;
+   }
+   for (i=0;i<ntop_ctrys;i++) top_ctrys[i]=NULL;
+
    /* scan hash table adding up domain totals */
-   for (i=0;i<MAXHASH;i++)
+   for (hptr=ht_first(&sm_htab,&hp);hptr!=NULL;hptr=ht_next(&sm_htab,&hp))
    {
-      hptr=sm_htab[i];
-      while (hptr!=NULL)
+      if (hptr->flag != OBJ_GRP)   /* ignore group totals */
       {
-         if (hptr->flag != OBJ_GRP)   /* ignore group totals */
+         if (isipaddr(hptr->string)>0)
          {
-            if (isipaddr(hptr->string)>0)
-            {
-               idx=0;                 /* unresolved/unknown  */
+            idx=0;                 /* unresolved/unknown  */
 #ifdef USE_DNS
-               if (geodb)
+            if (geodb)
+            {
+               /* Lookup IP address here, turn into idx   */
+               geodb_get_cc(geo_db, hptr->string, geo_ctry);
+               if (geo_ctry[0]=='-')
                {
-                  /* Lookup IP address here, turn into idx   */
-                  geodb_get_cc(geo_db, hptr->string, geo_ctry);
-                  if (geo_ctry[0]=='-')
-                  {
-                     if (debug_mode)
-                        fprintf(stderr,"GeoDB: %s unknown!\n",hptr->string);
-                  }
-                  else idx=ctry_idx(geo_ctry);
+                  if (debug_mode)
+                     fprintf(stderr,"GeoDB: %s unknown!\n",hptr->string);
                }
+               else idx=ctry_idx(geo_ctry);
+            }
 #endif
 #ifdef USE_GEOIP
-               if (geoip)
+            if (geoip)
+            {
+               /* Lookup IP address here,  turn into idx  */
+               geo_rc=GeoIP_country_code_by_addr(geo_fp, hptr->string);
+               if (geo_rc==NULL||geo_rc[0]=='\0'||geo_rc[0]=='-')
                {
-                  /* Lookup IP address here,  turn into idx  */
-                  geo_rc=GeoIP_country_code_by_addr(geo_fp, hptr->string);
-                  if (geo_rc==NULL||geo_rc[0]=='\0'||geo_rc[0]=='-')
-                  {
-                     if (debug_mode)
-                        fprintf(stderr,"GeoIP: %s unknown (returns '%s')\n",
-                                hptr->string,(geo_rc==NULL)?"null":geo_rc);
-                  }
-                  else
-                  {
-                     /* index returned geo_ctry */
-                     geo_ctry[0]=tolower(geo_rc[0]);
-                     geo_ctry[1]=tolower(geo_rc[1]);
-                     idx=ctry_idx(geo_ctry);
-                  }
+                  if (debug_mode)
+                     fprintf(stderr,"GeoIP: %s unknown (returns '%s')\n",
+                             hptr->string,(geo_rc==NULL)?"null":geo_rc);
                }
-#endif /* USE_GEOIP */
-            }
-            else
-            {
-               /* resolved hostname.. try to get TLD */
-               domain = hptr->string+strlen(hptr->string)-1;
-               while ( (*domain!='.')&&(domain!=hptr->string)) domain--;
-               if (domain++==hptr->string) idx=0;
-               else idx=ctry_idx(domain);
-            }
-            if (idx!=0)
-            {
-               ctry_fnd=0;
-               for (j=0;ctry[j].desc;j++)
+               else
                {
-                  if (idx==ctry[j].idx)
-                  {
-                     ctry[j].count+=hptr->count;
-                     ctry[j].files+=hptr->files;
-                     ctry[j].xfer +=hptr->xfer;
-                     ctry_fnd=1;
-                     break;
-                  }
+                  /* index returned geo_ctry */
+                  geo_ctry[0]=tolower(geo_rc[0]);
+                  geo_ctry[1]=tolower(geo_rc[1]);
+                  idx=ctry_idx(geo_ctry);
                }
             }
-            if (!ctry_fnd || idx==0)
+#endif /* USE_GEOIP */
+         }
+         else
+         {
+            /* resolved hostname.. try to get TLD */
+            domain = hptr->string+strlen(hptr->string)-1;
+            while ( (*domain!='.')&&(domain!=hptr->string)) domain--;
+            if (domain++==hptr->string) idx=0;
+            else idx=ctry_idx(domain);
+         }
+         if (idx!=0)
+         {
+            ctry_fnd=0;
+            for (j=0;ctry[j].desc;j++)
             {
-               ctry[0].count+=hptr->count;
-               ctry[0].files+=hptr->files;
-               ctry[0].xfer +=hptr->xfer;
+               if (idx==ctry[j].idx)
+               {
+                  ctry[j].count+=hptr->count;
+                  ctry[j].files+=hptr->files;
+                  ctry[j].xfer +=hptr->xfer;
+                  ctry_fnd=1;
+                  break;
+               }
             }
          }
-         hptr=hptr->next;
+         if (!ctry_fnd || idx==0)
+         {
+            ctry[0].count+=hptr->count;
+            ctry[0].files+=hptr->files;
+            ctry[0].xfer +=hptr->xfer;
+         }
       }
    }
 
@@ -2740,19 +2745,14 @@ int qs_ident_cmph(const void *cp1, const void *cp2)
 u_int64_t load_site_array(HNODEPTR *pointer)
 {
    HNODEPTR  hptr;
-   int       i;
+   struct ht_pos hp;
    u_int64_t ctr = 0;
 
    /* load the array */
-   for (i=0;i<MAXHASH;i++)
+   for (hptr=ht_first(&sm_htab,&hp);hptr!=NULL;hptr=ht_next(&sm_htab,&hp))
    {
-      hptr=sm_htab[i];
-      while (hptr!=NULL)
-      {
-         if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
-         else *(pointer+ctr++)=hptr;     /* otherwise, really do the load  */
-         hptr=hptr->next;
-      }
+      if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
+      else *(pointer+ctr++)=hptr;     /* otherwise, really do the load  */
    }
    return ctr;   /* return number loaded */
 }
@@ -2764,19 +2764,14 @@ u_int64_t load_site_array(HNODEPTR *pointer)
 u_int64_t load_url_array(UNODEPTR *pointer)
 {
    UNODEPTR  uptr;
-   int       i;
+   struct ht_pos hp;
    u_int64_t ctr = 0;
 
    /* load the array */
-   for (i=0;i<MAXHASH;i++)
+   for (uptr=ht_first(&um_htab,&hp);uptr!=NULL;uptr=ht_next(&um_htab,&hp))
    {
-      uptr=um_htab[i];
-      while (uptr!=NULL)
-      {
-         if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
-         else *(pointer+ctr++)=uptr;     /* otherwise, really do the load  */
-         uptr=uptr->next;
-      }
+      if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
+      else *(pointer+ctr++)=uptr;     /* otherwise, really do the load  */
    }
    return ctr;   /* return number loaded */
 }
@@ -2788,19 +2783,14 @@ u_int64_t load_url_array(UNODEPTR *pointer)
 u_int64_t load_ref_array(RNODEPTR *pointer)
 {
    RNODEPTR  rptr;
-   int       i;
+   struct ht_pos hp;
    u_int64_t ctr = 0;
 
    /* load the array */
-   for (i=0;i<MAXHASH;i++)
+   for (rptr=ht_first(&rm_htab,&hp);rptr!=NULL;rptr=ht_next(&rm_htab,&hp))
    {
-      rptr=rm_htab[i];
-      while (rptr!=NULL)
-      {
-         if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
-         else *(pointer+ctr++)=rptr;     /* otherwise, really do the load  */
-         rptr=rptr->next;
-      }
+      if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
+      else *(pointer+ctr++)=rptr;     /* otherwise, really do the load  */
    }
    return ctr;   /* return number loaded */
 }
@@ -2812,19 +2802,14 @@ u_int64_t load_ref_array(RNODEPTR *pointer)
 u_int64_t load_agent_array(ANODEPTR *pointer)
 {
    ANODEPTR  aptr;
-   int       i;
+   struct ht_pos hp;
    u_int64_t ctr = 0;
 
    /* load the array */
-   for (i=0;i<MAXHASH;i++)
+   for (aptr=ht_first(&am_htab,&hp);aptr!=NULL;aptr=ht_next(&am_htab,&hp))
    {
-      aptr=am_htab[i];
-      while (aptr!=NULL)
-      {
-         if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
-         else *(pointer+ctr++)=aptr;     /* otherwise, really do the load  */
-         aptr=aptr->next;
-      }
+      if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
+      else *(pointer+ctr++)=aptr;     /* otherwise, really do the load  */
    }
    return ctr;   /* return number loaded */
 }
@@ -2836,19 +2821,14 @@ u_int64_t load_agent_array(ANODEPTR *pointer)
 u_int64_t load_srch_array(SNODEPTR *pointer)
 {
    SNODEPTR  sptr;
-   int       i;
+   struct ht_pos hp;
    u_int64_t ctr = 0;
 
    /* load the array */
-   for (i=0;i<MAXHASH;i++)
+   for (sptr=ht_first(&sr_htab,&hp);sptr!=NULL;sptr=ht_next(&sr_htab,&hp))
    {
-      sptr=sr_htab[i];
-      while (sptr!=NULL)
-      {
-         if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
-         else *(pointer+ctr++)=sptr;     /* otherwise, really do the load  */
-         sptr=sptr->next;
-      }
+      if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
+      else *(pointer+ctr++)=sptr;     /* otherwise, really do the load  */
    }
    return ctr;   /* return number loaded */
 }
@@ -2860,19 +2840,14 @@ u_int64_t load_srch_array(SNODEPTR *pointer)
 u_int64_t load_ident_array(INODEPTR *pointer)
 {
    INODEPTR  iptr;
-   int       i;
+   struct ht_pos hp;
    u_int64_t ctr = 0;
 
    /* load the array */
-   for (i=0;i<MAXHASH;i++)
+   for (iptr=ht_first(&im_htab,&hp);iptr!=NULL;iptr=ht_next(&im_htab,&hp))
    {
-      iptr=im_htab[i];
-      while (iptr!=NULL)
-      {
-         if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
-         else *(pointer+ctr++)=iptr;     /* otherwise, really do the load  */
-         iptr=iptr->next;
-      }
+      if (pointer==NULL) ctr++;       /* fancy way to just count 'em    */
+      else *(pointer+ctr++)=iptr;     /* otherwise, really do the load  */
    }
    return ctr;   /* return number loaded */
 }
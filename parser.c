@@ -31,6 +31,7 @@
 #include <string.h>
 #include <unistd.h>                           /* normal stuff             */
 #include <ctype.h>
+#include <limits.h>
 #include <sys/utsname.h>
 
 /* ensure sys/types */
@@ -52,12 +53,67 @@
 #include "lang.h"
 #include "parser.h"
 
+/* vectorized fmt_logrec() on x86 (SSE2 base, AVX2 picked at runtime) */
+#if defined(__GNUC__) && (defined(__x86_64__) || \
+    (defined(__i386__) && defined(__SSE2__)))
+#define FMT_SIMD
+#include <immintrin.h>
+#endif
+
+/* fmt_logrec() tokenizer state */
+struct fmt_state { int q, b, p; };       /* in quote, [ depth, ( depth */
+
+/* local time conversion cache (w3c/squid), one per parser */
+struct tz_cache { time_t hour;           /* UTC hour it is for (secs)  */
+                  long   off;            /* local time - UTC (secs)    */
+                  int    ok; };          /* off good for whole hour    */
+
+#define TZ_MAXLT 253402300800LL          /* 10000-01-01, %Y 4 digits  */
+
+/* LogFormat (custom CLF style layout) field types */
+#define LF_LIT     0                     /* literal text to match      */
+#define LF_SKIP    1                     /* field we don't use         */
+#define LF_HOST    2                     /* %h %a $remote_addr         */
+#define LF_IDENT   3                     /* %u $remote_user            */
+#define LF_DATE    4                     /* %t  ([date] w/brackets)    */
+#define LF_TIME    5                     /* $time_local (no brackets)  */
+#define LF_REQ     6                     /* %r $request                */
+#define LF_STATUS  7                     /* %s %>s $status             */
+#define LF_BYTES   8                     /* %b %B %O $body_bytes_sent  */
+#define LF_REFER   9                     /* %{Referer}i $http_referer  */
+#define LF_AGENT  10                     /* %{User-Agent}i, $http_...  */
+#define LF_URL    11                     /* just the URL (JSON only)   */
+
+#define LF_MAXOPS 64                     /* max fields+literals        */
+
+struct lf_op { int  type;                /* LF_xxx field type          */
+               char *lit;                /* literal text (LF_LIT)      */
+               int  len;                 /* literal length             */
+               char term;                /* char that ends the field   */
+               int  todate; };           /* [date] next (lit len+1)    */
+
+static struct lf_op lf_ops[LF_MAXOPS];   /* compiled LogFormat         */
+static int          lf_nops=0;           /* number of ops (0=none)     */
+
+#ifdef FMT_SIMD
+static char *(*fmt_simd)(char *, char *, char *, struct fmt_state *)=NULL;
+#endif
+
 /* internal function prototypes */
-void fmt_logrec(char *);
-int  parse_record_clf(char *, int);
-int  parse_record_ftp(char *, int);
-int  parse_record_squid(char *, int);
-int  parse_record_w3c(char *, int);
+void fmt_logrec(char *, int);
+int  parse_record_clf(char *, int, struct log_struct *);
+int  parse_record_ftp(char *, int, struct log_struct *);
+int  parse_record_squid(char *, int, struct log_struct *);
+int  parse_record_w3c(char *, int, struct log_struct *);
+int  parse_record_fmt(char *, int, struct log_struct *);
+static int lf_fldcpy(char *, char *, char *, int, int);
+static int fldcpy(char *, char *, int);
+static int tz_get(struct tz_cache *, time_t, long *);
+static void tz_fmt(char *, time_t);
+static void tz_local(char *, time_t, struct tz_cache *);
+int  parse_record_json(char *, int, struct log_struct *);
+static int json_scan(char *, int, struct log_struct *, char *,
+                     struct tz_cache *);
 
 char *strncopy(char *a, const char *b, size_t n)
 {
@@ -68,48 +124,182 @@ char *strncopy(char *a, const char *b, size_t n)
 }
 
 /*********************************************/
-/* FMT_LOGREC - terminate log fields w/zeros */
+/* FMT_BYTES - scalar field tokenizer        */
 /*********************************************/
 
-void fmt_logrec(char *buffer)
-{
-   char *cp=buffer;
-   int  q=0,b=0,p=0;
+/* walk bytes from cp up to ep (or '\0' if ep is NULL), updating */
+/* the quote/bracket/paren state.  returns where it stopped.   */
 
-   while (*cp != '\0')
+static char *fmt_bytes(char *buffer, char *cp, char *ep, struct fmt_state *st)
+{
+   while ((ep==NULL || cp<ep) && *cp != '\0')
    {
-      /* break record up, terminate fields with '\0' */
       switch (*cp)
       {
-       case '\t': if (b || q || p) break; *cp='\0';   break;
-       case ' ': if (b || q || p) break; *cp='\0';    break;
-       case '"': if (*(cp-1)=='\\') break; else q^=1; break;
-       case '[': if (q) break; b++;                   break;
-       case ']': if (q) break; if (b>0) b--;          break;
-       case '(': if (q) break; p++;                   break;
-       case ')': if (q) break; if (p>0) p--;          break;
+       case '\t': if (st->b || st->q || st->p) break; *cp='\0'; break;
+       case ' ': if (st->b || st->q || st->p) break; *cp='\0';  break;
+       case '"': if (cp>buffer && *(cp-1)=='\\') break; st->q^=1; break;
+       case '[': if (st->q) break; st->b++;               break;
+       case ']': if (st->q) break; if (st->b>0) st->b--;  break;
+       case '(': if (st->q) break; st->p++;               break;
+       case ')': if (st->q) break; if (st->p>0) st->p--;  break;
       }
       cp++;
    }
+   return cp;
+}
+
+#ifdef FMT_SIMD
+/*********************************************/
+/* FMT_SSE2 - tokenize 16 bytes at a time    */
+/*********************************************/
+
+/* Quotes are classified with a compare/movemask per block and the */
+/* in-quote mask is the prefix XOR of the (unescaped) quote bits,  */
+/* carried across blocks.  Separators outside quotes and outside   */
+/* any [..] or (..) are zeroed.  Blocks that hold a bracket/paren  */
+/* go through fmt_bytes(), since nesting depth is a counter, not a */
+/* parity bit.  Stops before the block holding the terminating \0. */
+
+static char *fmt_sse2(char *buffer, char *cp, char *ep, struct fmt_state *st)
+{
+   __m128i v, zr=_mm_setzero_si128();
+   __m128i sp=_mm_set1_epi8(' '),  tb=_mm_set1_epi8('\t');
+   __m128i qt=_mm_set1_epi8('"'),  bs=_mm_set1_epi8('\\');
+   __m128i ob=_mm_set1_epi8('['),  cb=_mm_set1_epi8(']');
+   __m128i op=_mm_set1_epi8('('),  cl=_mm_set1_epi8(')');
+   unsigned int e, q, s, pe;
+
+   pe=(cp>buffer && *(cp-1)=='\\');       /* escape carried into block */
+   while (ep-cp >= 16)
+   {
+      v=_mm_loadu_si128((__m128i *)cp);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(v,zr))) break;
+      if (_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v,ob),_mm_cmpeq_epi8(v,cb)),
+            _mm_or_si128(_mm_cmpeq_epi8(v,op),_mm_cmpeq_epi8(v,cl)))))
+      {
+         cp=fmt_bytes(buffer,cp,cp+16,st);
+         pe=(*(cp-1)=='\\');
+         continue;
+      }
+      e=_mm_movemask_epi8(_mm_cmpeq_epi8(v,bs));
+      q=_mm_movemask_epi8(_mm_cmpeq_epi8(v,qt)) & ~((e<<1)|pe);
+      pe=e>>15;
+      q^=q<<1; q^=q<<2; q^=q<<4; q^=q<<8;    /* prefix xor = in quote */
+      q=(st->q)? ~q&0xffff : q&0xffff;
+      st->q=q>>15;
+      if (st->b || st->p) { cp+=16; continue; }
+      s=_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v,sp),
+                                       _mm_cmpeq_epi8(v,tb))) & ~q;
+      while (s) { cp[__builtin_ctz(s)]='\0'; s&=s-1; }
+      cp+=16;
+   }
+   return cp;
+}
+
+/*********************************************/
+/* FMT_AVX2 - tokenize 32 bytes at a time    */
+/*********************************************/
+
+__attribute__((target("avx2")))
+static char *fmt_avx2(char *buffer, char *cp, char *ep, struct fmt_state *st)
+{
+   __m256i v, zr=_mm256_setzero_si256();
+   __m256i sp=_mm256_set1_epi8(' '),  tb=_mm256_set1_epi8('\t');
+   __m256i qt=_mm256_set1_epi8('"'),  bs=_mm256_set1_epi8('\\');
+   __m256i ob=_mm256_set1_epi8('['),  cb=_mm256_set1_epi8(']');
+   __m256i op=_mm256_set1_epi8('('),  cl=_mm256_set1_epi8(')');
+   unsigned int e, q, s, pe;
+
+   pe=(cp>buffer && *(cp-1)=='\\');
+   while (ep-cp >= 32)
+   {
+      v=_mm256_loadu_si256((__m256i *)cp);
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,zr))) break;
+      if (_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v,ob),_mm256_cmpeq_epi8(v,cb)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v,op),_mm256_cmpeq_epi8(v,cl)))))
+      {
+         cp=fmt_bytes(buffer,cp,cp+32,st);
+         pe=(*(cp-1)=='\\');
+         continue;
+      }
+      e=(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,bs));
+      q=(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,qt))
+         & ~((e<<1)|pe);
+      pe=e>>31;
+      q^=q<<1; q^=q<<2; q^=q<<4; q^=q<<8; q^=q<<16;
+      if (st->q) q=~q;
+      st->q=q>>31;
+      if (st->b || st->p) { cp+=32; continue; }
+      s=(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v,sp),_mm256_cmpeq_epi8(v,tb))) & ~q;
+      while (s) { cp[__builtin_ctz(s)]='\0'; s&=s-1; }
+      cp+=32;
+   }
+   return cp;
+}
+#endif  /* FMT_SIMD */
+
+/*********************************************/
+/* FMT_LOGREC - terminate log fields w/zeros */
+/*********************************************/
+
+void fmt_logrec(char *buffer, int size)
+{
+   struct fmt_state st = {0,0,0};
+   char *cp=buffer;
+
+#ifdef FMT_SIMD
+   if (fmt_simd==NULL)                       /* pick once, by cpu        */
+   {
+      __builtin_cpu_init();
+      fmt_simd=(__builtin_cpu_supports("avx2"))? fmt_avx2 : fmt_sse2;
+   }
+   cp=fmt_simd(buffer,cp,buffer+size,&st);
+#endif
+   fmt_bytes(buffer,cp,NULL,&st);            /* whatever is left         */
+}
+
+/*********************************************/
+/* CLEAR_RECORD - reset log record fields    */
+/*********************************************/
+
+void clear_record(struct log_struct *lr)
+{
+   /* The string fields are only ever used up to their terminating */
+   /* null (and lengths), so there is no need to zero the whole    */
+   /* (6k+) structure for every record.  Just make them all empty. */
+   lr->hostname[0]=lr->datetime[0]=lr->url[0]='\0';
+   lr->refer[0]=lr->agent[0]=lr->srchstr[0]=lr->ident[0]='\0';
+   lr->hnamelen=lr->urllen=lr->referlen=0;
+   lr->agentlen=lr->srchlen=lr->identlen=0;
+   lr->resp_code=0;
+   lr->xfer_size=0;
+   lr->year=lr->month=lr->day=0;
+   lr->hour=lr->min=lr->sec=0;
 }
 
 /*********************************************/
 /* PARSE_RECORD - uhhh, you know...          */
 /*********************************************/
 
-int parse_record(char *buffer, int len)
+int parse_record(char *buffer, int len, struct log_struct *lr)
 {
    /* clear out structure */
-   memset(&log_rec,0,sizeof(struct log_struct));
+   clear_record(lr);
 
    /* call appropriate handler */
    switch (log_type)
    {
       default:
-      case LOG_CLF:   return parse_record_clf(buffer,len);   break; /* clf   */
-      case LOG_FTP:   return parse_record_ftp(buffer,len);   break; /* ftp   */
-      case LOG_SQUID: return parse_record_squid(buffer,len); break; /* squid */
-      case LOG_W3C:   return parse_record_w3c(buffer,len);   break; /* w3c   */
+      case LOG_CLF:   if (lf_nops) return parse_record_fmt(buffer,len,lr);
+                      return parse_record_clf(buffer,len,lr);   break; /* clf   */
+      case LOG_FTP:   return parse_record_ftp(buffer,len,lr);   break; /* ftp   */
+      case LOG_SQUID: return parse_record_squid(buffer,len,lr); break; /* squid */
+      case LOG_W3C:   return parse_record_w3c(buffer,len,lr);   break; /* w3c   */
+      case LOG_JSON:  return parse_record_json(buffer,len,lr);  break; /* json  */
    }
 }
 
@@ -117,13 +307,13 @@ int parse_record(char *buffer, int len)
 /* PARSE_RECORD_FTP - ftp log handler        */
 /*********************************************/
 
-int parse_record_ftp(char *buffer,int size)
+int parse_record_ftp(char *buffer,int size, struct log_struct *lr)
 {
    int i,j,count;
    char *cp1, *cp2, *cpx, *cpy, *eob, *et;
 
    eob = buffer+size;                     /* calculate end of buffer     */
-   fmt_logrec(buffer);                    /* separate fields with \0's   */
+   fmt_logrec(buffer,eob-buffer);         /* separate fields with \0's   */
 
    /* Start out with date/time       */
    cp1=buffer;
@@ -146,7 +336,7 @@ int parse_record_ftp(char *buffer,int size)
    if (i<1 || i>31) return 0;
 
    /* format date/time field         */
-   snprintf(log_rec.datetime,sizeof(log_rec.datetime),
+   snprintf(lr->datetime,sizeof(lr->datetime),
             "[%02d/%s/%4d:%s -0000]",i,cpx,j,cpy);
 
    /* skip seconds... */
@@ -158,24 +348,23 @@ int parse_record_ftp(char *buffer,int size)
    if (*(cp1+1)==0)
    {
       /* Blank? That's weird.. */
-      strcpy(log_rec.hostname,"NONE");
-	  log_rec.hnamelen = sizeof("NONE")-1;
+      strcpy(lr->hostname,"NONE");
+	  lr->hnamelen = sizeof("NONE")-1;
       if (debug_mode) fprintf(stderr, "Warning: Blank hostname found!\n");
    }
    else
    {
       /* good hostname */
-      et = strncopy(log_rec.hostname, ++cp1, MAXHOST);
+      et = strncopy(lr->hostname, ++cp1, MAXHOST);
 	  *et = 0;
-	  log_rec.hnamelen = et - cp1;
-	  cp1 = et+1;
+	  lr->hnamelen = et - lr->hostname;
       while (*cp1!=0 && cp1<eob) cp1++;
    }
    while (*cp1==0 && cp1<eob) cp1++;
 
    /* get filesize */
-   if (*cp1<'0'||*cp1>'9') log_rec.xfer_size=0;
-   else log_rec.xfer_size = strtoul(cp1,NULL,10);
+   if (*cp1<'0'||*cp1>'9') lr->xfer_size=0;
+   else lr->xfer_size = strtoul(cp1,NULL,10);
 
    /* URL stuff */
    while (*cp1!=0 && cp1<eob) cp1++;
@@ -193,21 +382,21 @@ int parse_record_ftp(char *buffer,int size)
 
    /* fabricate an appropriate request string based on direction */
    if (*cp1=='i')
-      log_rec.urllen = snprintf(log_rec.url,sizeof(log_rec.url),"\"POST %s\"",cpx);
+      lr->urllen = snprintf(lr->url,sizeof(lr->url),"\"POST %s\"",cpx);
    else
-      log_rec.urllen = snprintf(log_rec.url,sizeof(log_rec.url),"\"GET %s\"",cpx);
+      lr->urllen = snprintf(lr->url,sizeof(lr->url),"\"GET %s\"",cpx);
 
    if (cp1<eob) cp1++;
    if (cp1<eob) cp1++;
    while (*cp1!=0 && cp1<eob) cp1++;
    if (cp1<eob) cp1++;
-   cp2=log_rec.ident;count=MAXIDENT-1;
+   cp2=lr->ident;count=MAXIDENT-1;
    while (*cp1!=0 && cp1<eob && count) { *cp2++ = *cp1++; count--; }
    *cp2='\0';
-   log_rec.identlen = cp2 - log_rec.ident;
+   lr->identlen = cp2 - lr->ident;
 
    /* return appropriate response code */
-   log_rec.resp_code=(*(eob-2)=='i')?206:200;
+   lr->resp_code=(*(eob-2)=='i')?206:200;
 
    return 1;
 }
@@ -216,21 +405,21 @@ int parse_record_ftp(char *buffer,int size)
 /* PARSE_RECORD_CLF - CLF web log handler    */
 /*********************************************/
 
-int parse_record_clf(char *buffer, int size)
+int parse_record_clf(char *buffer, int size, struct log_struct *lr)
 {
    char *cp1, *cp2, *cpx, *eob, *eos;
 
    eob = buffer+size;                     /* calculate end of buffer     */
-   fmt_logrec(buffer);                    /* separate fields with \0's   */
+   fmt_logrec(buffer,eob-buffer);         /* separate fields with \0's   */
 
    /* HOSTNAME */
-   cp1 = cpx = buffer; cp2=log_rec.hostname;
+   cp1 = cpx = buffer; cp2=lr->hostname;
    eos = (cp1+MAXHOST)-1;
    if (eos >= eob) eos=eob-1;
 
    while ( (*cp1 != '\0') && (cp1 != eos) ) *cp2++ = *cp1++;
    *cp2 = '\0';
-   log_rec.hnamelen = cp2 - log_rec.hostname;
+   lr->hnamelen = cp2 - lr->hostname;
    if (*cp1 != '\0')
    {
       if (verbose)
@@ -249,7 +438,7 @@ int parse_record_clf(char *buffer, int size)
 
    /* IDENT (authuser) field */
    cpx = cp1;
-   cp2 = log_rec.ident;
+   cp2 = lr->ident;
    eos = (cp1+MAXIDENT-1);
    if (eos >= eob) eos=eob-1;
 
@@ -259,7 +448,7 @@ int parse_record_clf(char *buffer, int size)
       *cp2++=*cp1++;
    }
    *cp2--='\0';
-   log_rec.identlen = cp2 - log_rec.ident;
+   lr->identlen = cp2 - lr->ident;
 
    if (cp1 >= eob) return 0;
 
@@ -280,7 +469,7 @@ int parse_record_clf(char *buffer, int size)
 
    /* date/time string */
    cpx = cp1;
-   cp2 = log_rec.datetime;
+   cp2 = lr->datetime;
    eos = (cp1+28);
    if (eos >= eob) eos=eob-1;
 
@@ -299,19 +488,19 @@ int parse_record_clf(char *buffer, int size)
    if (cp1 < eob) cp1++;
 
    /* minimal sanity check on timestamp */
-   if ( (log_rec.datetime[0] != '[') ||
-        (log_rec.datetime[3] != '/') ||
+   if ( (lr->datetime[0] != '[') ||
+        (lr->datetime[3] != '/') ||
         (cp1 >= eob))  return 0;
 
    /* HTTP request */
    cpx = cp1;
-   cp2 = log_rec.url;
+   cp2 = lr->url;
    eos = (cp1+MAXURL-1);
    if (eos >= eob) eos = eob-1;
    cp2 = strncopy(cp2, cp1, MAXURL);
    *cp2 = '\0';
-   log_rec.urllen = cp2 - log_rec.url;
-   cp1 += log_rec.urllen;
+   lr->urllen = cp2 - lr->url;
+   cp1 += lr->urllen;
 
    while ( (*cp1 != '\0') && (cp1 != eos) ) cp1++;
    if (*cp1 != '\0')
@@ -326,25 +515,25 @@ int parse_record_clf(char *buffer, int size)
    }
    if (cp1 < eob) cp1++;
 
-   if ( (log_rec.url[0] != '"') ||
+   if ( (lr->url[0] != '"') ||
         (cp1 >= eob) ) return 0;
 
    /* Strip off HTTP version from URL */
-   if ( (cp2=strstr(log_rec.url,"HTTP"))!=NULL )
+   if ( (cp2=strstr(lr->url,"HTTP"))!=NULL )
    {
       *cp2='\0';          /* Terminate string */
-	  log_rec.urllen = cp2 - log_rec.url;
+	  lr->urllen = cp2 - lr->url;
       *(--cp2)='"';       /* change <sp> to " */
    }
 
    /* response code */
-   log_rec.resp_code = atoi(cp1);
+   lr->resp_code = atoi(cp1);
 
    /* xfer size */
    while ( (*cp1 != '\0') && (cp1 < eob) ) cp1++;
    if (cp1 < eob) cp1++;
-   if (*cp1<'0'||*cp1>'9') log_rec.xfer_size=0;
-   else log_rec.xfer_size = strtoul(cp1,NULL,10);
+   if (*cp1<'0'||*cp1>'9') lr->xfer_size=0;
+   else lr->xfer_size = strtoul(cp1,NULL,10);
 
    /* done with CLF record */
    if (cp1>=eob) return 1;
@@ -353,13 +542,13 @@ int parse_record_clf(char *buffer, int size)
    if (cp1 < eob) cp1++;
    /* get referrer if present */
    cpx = cp1;
-   cp2 = log_rec.refer;
+   cp2 = lr->refer;
    eos = (cp1+MAXREF-1);
    if (eos >= eob) eos = eob-1;
 
    while ( (*cp1 != '\0') && (*cp1 != '\n') && (cp1 != eos) ) *cp2++ = *cp1++;
    *cp2 = '\0';
-   log_rec.referlen = cp2 - log_rec.refer;
+   lr->referlen = cp2 - lr->refer;
    if (*cp1 != '\0')
    {
       if (verbose)
@@ -373,13 +562,13 @@ int parse_record_clf(char *buffer, int size)
    if (cp1 < eob) cp1++;
 
    cpx = cp1;
-   cp2 = log_rec.agent;
+   cp2 = lr->agent;
    eos = cp1+(MAXAGENT-1);
    if (eos >= eob) eos = eob-1;
 
    while ( (*cp1 != '\0') && (cp1 != eos) ) *cp2++ = *cp1++;
    *cp2 = '\0';
-   log_rec.agentlen = cp2 - log_rec.agent;
+   lr->agentlen = cp2 - lr->agent;
 
    return 1;     /* maybe a valid record, return with TRUE */
 }
@@ -388,22 +577,22 @@ int parse_record_clf(char *buffer, int size)
 /* PARSE_RECORD_SQUID - squid log handler    */
 /*********************************************/
 
-int parse_record_squid(char *buffer,int size)
+int parse_record_squid(char *buffer,int size, struct log_struct *lr)
 {
    int slash_count=0;
    time_t i;
    char *cp1, *cp2, *cpx, *eob, *eos;
+   static struct tz_cache tz_squid={-1,0,0};
 
    eob = buffer+size;                     /* calculate end of buffer     */
-   fmt_logrec(buffer);                    /* separate fields with \0's   */
+   fmt_logrec(buffer,eob-buffer);         /* separate fields with \0's   */
 
    /* date/time */
    cp1=buffer;
    i=atoi(cp1);		/* get timestamp */
 
    /* format date/time field */
-   strftime(log_rec.datetime,sizeof(log_rec.datetime),
-            "[%d/%b/%Y:%H:%M:%S -0000]",localtime(&i));
+   tz_local(lr->datetime,i,&tz_squid);
 
    while (*cp1!=0 && cp1<eob) cp1++;
    while (*cp1==0) cp1++;
@@ -413,12 +602,13 @@ int parse_record_squid(char *buffer,int size)
    while (*cp1==0) cp1++;
 
    /* HOSTNAME */
-   cpx = cp1; cp2=log_rec.hostname;
+   cpx = cp1; cp2=lr->hostname;
    eos = (cp1+MAXHOST)-1;
    if (eos >= eob) eos=eob-1;
 
    while ((*cp1 != '\0') && (cp1 != eos)) *cp2++ = *cp1++;
    *cp2='\0';
+   lr->hnamelen = cp2 - lr->hostname;
    if (*cp1 != '\0')
    {
       if (verbose)
@@ -436,20 +626,20 @@ int parse_record_squid(char *buffer,int size)
    cp1++;
 
    /* response code */
-   log_rec.resp_code = atoi(cp1);
+   lr->resp_code = atoi(cp1);
    while (*cp1!=0 && cp1<eob) cp1++;
    while (*cp1==0) cp1++;
 
    /* xfer size */
-   if (*cp1<'0'||*cp1>'9') log_rec.xfer_size=0;
-   else log_rec.xfer_size = strtoul(cp1,NULL,10);
+   if (*cp1<'0'||*cp1>'9') lr->xfer_size=0;
+   else lr->xfer_size = strtoul(cp1,NULL,10);
 
    while (*cp1!=0 && cp1<eob) cp1++;
    while (*cp1==0) cp1++;
 
    /* HTTP request type */
    cpx = cp1;
-   cp2 = log_rec.url;
+   cp2 = lr->url;
    *cp2++ = '\"';
    eos = (cp1+MAXURL-1);
    if (eos >= eob) eos = eob-1;
@@ -497,11 +687,12 @@ int parse_record_squid(char *buffer,int size)
    }
    if (cp1 < eob) cp1++;
 
-   *cp2++ = '\"';
+   *cp2++ = '\"'; *cp2 = '\0';
+   lr->urllen = cp2 - lr->url;
 
    /* IDENT (authuser) field */
    cpx = cp1;
-   cp2 = log_rec.ident;
+   cp2 = lr->ident;
    eos = (cp1+MAXIDENT-1);
    if (eos >= eob) eos=eob-1;
 
@@ -515,6 +706,7 @@ int parse_record_squid(char *buffer,int size)
 
    /* strip trailing space(s) */
    while (*cp2==' ') *cp2--='\0';
+   lr->identlen = cp2 - lr->ident + 1;
 
    /* we have no interest in the remaining fields */
    return 1;
@@ -557,7 +749,7 @@ struct  fields_struct
    char *agent;    /* User agent field */
 };
 
-int parse_record_w3c(char *buffer,int size)
+int parse_record_w3c(char *buffer,int size, struct log_struct *lr)
 {
    char *eob;
    char *cp;
@@ -566,6 +758,8 @@ int parse_record_w3c(char *buffer,int size)
    struct fields_struct fields;
    struct tm gm_time, *local_time;
    time_t timestamp;
+   long   off;
+   static struct tz_cache tz_w3c={-1,0,0};
 
    memset(&gm_time, 0, sizeof(struct tm));
    eob = buffer + size;                   /* calculate end of buffer     */
@@ -584,7 +778,7 @@ int parse_record_w3c(char *buffer,int size)
          break;
    }
 
-   fmt_logrec(buffer);                    /* separate fields with \0's   */
+   fmt_logrec(buffer,eob-buffer);         /* separate fields with \0's   */
 
    cp = buffer;
 
@@ -681,35 +875,38 @@ int parse_record_w3c(char *buffer,int size)
          fields.method="NONE";
 
       if (fields.query && (fields.query[0]!='-'))
-           snprintf(log_rec.url, MAXURL, "\"%s %s?%s\"",
+           lr->urllen = snprintf(lr->url, MAXURL, "\"%s %s?%s\"",
                     fields.method, fields.url, fields.query);
-      else snprintf(log_rec.url, MAXURL, "\"%s %s\"",
+      else lr->urllen = snprintf(lr->url, MAXURL, "\"%s %s\"",
                     fields.method, fields.url);
+      if (lr->urllen >= MAXURL) lr->urllen = MAXURL-1;
    }
    else return 0;
 
    /* Save hostname */
-   if (fields.ip) strncpy(log_rec.hostname, fields.ip, MAXHOST - 1);
+   if (fields.ip) lr->hnamelen = fldcpy(lr->hostname, fields.ip, MAXHOST);
       
    /* Save response code */
-   if (fields.status) log_rec.resp_code = atoi(fields.status);
+   if (fields.status) lr->resp_code = atoi(fields.status);
    
    /* Save referer */
-   if (fields.referer) strncpy(log_rec.refer, fields.referer, MAXREF - 1);
+   if (fields.referer)
+      lr->referlen = fldcpy(lr->refer, fields.referer, MAXREF);
    
    /* Save transfer size */
-   if (fields.size) log_rec.xfer_size = strtoul(fields.size, NULL, 10);
+   if (fields.size) lr->xfer_size = strtoul(fields.size, NULL, 10);
    
    /* Save user agent */
    if (fields.agent)
    {
       cp = fields.agent;
       while (*cp) { if (*cp=='+') *cp=' '; cp++; }
-      strncpy(log_rec.agent, fields.agent, MAXAGENT - 1);
+      lr->agentlen = fldcpy(lr->agent, fields.agent, MAXAGENT);
    }
    
    /* Save auth username */
-   if (fields.username) strncpy(log_rec.ident, fields.username, MAXIDENT - 1);
+   if (fields.username)
+      lr->identlen = fldcpy(lr->ident, fields.username, MAXIDENT);
    
    /* Parse date and time and save it */
    if (fields.date)
@@ -738,6 +935,24 @@ int parse_record_w3c(char *buffer,int size)
       gm_time.tm_sec = atoi(fields.time);
    }
    
+   /* Sane GMT date/time?  do it with the cached offset if we can */
+   if (gm_time.tm_year>=70  && gm_time.tm_year<8000 &&
+       gm_time.tm_mon>=0    && gm_time.tm_mon<12    &&
+       gm_time.tm_mday>=1   && gm_time.tm_mday<=31  &&
+       gm_time.tm_hour>=0   && gm_time.tm_hour<24   &&
+       gm_time.tm_min>=0    && gm_time.tm_min<60    &&
+       gm_time.tm_sec>=0    && gm_time.tm_sec<=60)
+   {
+      timestamp=(time_t)(jdate(gm_time.tm_mday,gm_time.tm_mon+1,
+                 gm_time.tm_year+1900)-epoch)*86400 + gm_time.tm_hour*3600
+                 + gm_time.tm_min*60 + gm_time.tm_sec;
+      if (tz_get(&tz_w3c,timestamp,&off) && timestamp+off<TZ_MAXLT)
+      {
+         tz_fmt(lr->datetime,timestamp+off);
+         return 1;
+      }
+   }
+
    /* Convert GMT to localtime */
    gm_time.tm_isdst = -1;                              /* force dst check   */
    timestamp = mktime(&gm_time);                       /* get time in sec   */
@@ -747,7 +962,630 @@ int parse_record_w3c(char *buffer,int size)
    timestamp = mktime(&gm_time)+gm_time.tm_gmtoff;     /* glibc systems     */
 #endif
    local_time = localtime(&timestamp);                 /* update tm struct  */
-   strftime(log_rec.datetime, sizeof(log_rec.datetime),/* and format sting  */
+   strftime(lr->datetime, sizeof(lr->datetime),/* and format sting  */
      "[%d/%b/%Y:%H:%M:%S -0000]", local_time);         /* for log_rec field */
    return 1;
 }
+
+/*********************************************/
+/* LF_COMPILE - compile LogFormat string     */
+/*********************************************/
+
+/* Turns an Apache (%h %t "%r" ...) or nginx ($remote_addr ...)    */
+/* style format into a list of literal/field ops that the parser   */
+/* just walks.  Fields we don't use are skipped.  Returns 1 if ok, */
+/* 0 if the format is bad (adjacent fields, missing host/date/req). */
+
+int lf_compile(char *fmt)
+{
+   static struct { char *name; int type; } names[] = {
+      { "%h",              LF_HOST   }, { "%a",              LF_HOST   },
+      { "%u",              LF_IDENT  }, { "%t",              LF_DATE   },
+      { "%r",              LF_REQ    }, { "%s",              LF_STATUS },
+      { "%>s",             LF_STATUS }, { "%b",              LF_BYTES  },
+      { "%B",              LF_BYTES  }, { "%O",              LF_BYTES  },
+      { "%{Referer}i",     LF_REFER  }, { "%{User-Agent}i",  LF_AGENT  },
+      { "$remote_addr",    LF_HOST   }, { "$remote_user",    LF_IDENT  },
+      { "$time_local",     LF_TIME   }, { "$request",        LF_REQ    },
+      { "$status",         LF_STATUS }, { "$body_bytes_sent",LF_BYTES  },
+      { "$bytes_sent",     LF_BYTES  }, { "$http_referer",   LF_REFER  },
+      { "$http_user_agent",LF_AGENT  }, { NULL,              0         } };
+
+   char *cp=fmt, *ep, *lit;
+   int  i, n=0, got=0;
+
+   if ( (lit=malloc(strlen(fmt)+1))==NULL ) return 0;
+
+   while (*cp)
+   {
+      if (n>=LF_MAXOPS) return 0;
+
+      if ( (*cp=='%' && cp[1]!='%' && cp[1]!='\0') ||
+           (*cp=='$' && (isalpha((unsigned char)cp[1]) || cp[1]=='_')) )
+      {
+         /* find end of field name */
+         ep=cp+1;
+         if (*cp=='%')
+         {
+            while (*ep=='<' || *ep=='>') ep++;
+            if (*ep=='{') { while (*ep && *ep!='}') ep++; if (*ep) ep++; }
+            if (*ep) ep++;
+         }
+         else while (isalnum((unsigned char)*ep) || *ep=='_') ep++;
+
+         /* two fields in a row can't be told apart */
+         if (n && lf_ops[n-1].type!=LF_LIT) return 0;
+
+         lf_ops[n].type=LF_SKIP;
+         for (i=0;names[i].name;i++)
+            if ( (int)strlen(names[i].name)==(ep-cp) &&
+                 !strncasecmp(names[i].name,cp,ep-cp) &&
+                 (cp[1]=='{' || !strncmp(names[i].name,cp,ep-cp)) )
+               { lf_ops[n].type=names[i].type; break; }
+         got|=1<<lf_ops[n].type;
+         n++; cp=ep;
+         continue;
+      }
+
+      /* literal text, up to next field */
+      if (n==0 || lf_ops[n-1].type!=LF_LIT)
+      {
+         lf_ops[n].type=LF_LIT;
+         lf_ops[n].lit=lit; lf_ops[n].len=0;
+         n++;
+      }
+      if (*cp=='%') cp++;                 /* '%%' is a literal '%'    */
+      *lit++=*cp++; lf_ops[n-1].len++;
+   }
+
+   /* each field ends at the first char of the literal after it */
+   for (i=0;i<n;i++)
+   {
+      lf_ops[i].term=(i+1<n && lf_ops[i+1].type==LF_LIT)?*lf_ops[i+1].lit:0;
+      lf_ops[i].todate=0;
+      if (i+2<n && lf_ops[i+1].type==LF_LIT)
+      {
+         /* chars of the literal in front of the '[' of the date */
+         if (lf_ops[i+2].type==LF_DATE)
+            lf_ops[i].todate=lf_ops[i+1].len+1;
+         else if (lf_ops[i+2].type==LF_TIME &&
+                  lf_ops[i+1].lit[lf_ops[i+1].len-1]=='[')
+            lf_ops[i].todate=lf_ops[i+1].len;
+      }
+   }
+
+   if ( !(got&(1<<LF_HOST)) || !(got&((1<<LF_DATE)|(1<<LF_TIME))) ||
+        !(got&(1<<LF_REQ)) ) return 0;
+
+   lf_nops=n;
+   return 1;
+}
+
+/*********************************************/
+/* PARSE_RECORD_FMT - LogFormat handler      */
+/*********************************************/
+
+/* Builds the same log_rec fields the CLF parser would, so the rest  */
+/* of the program can't tell the difference: date in [brackets],    */
+/* and the request, referrer and agent in double quotes.            */
+
+int parse_record_fmt(char *buffer, int size, struct log_struct *lr)
+{
+   char *cp=buffer, *eob=buffer+size, *fs, *cp2;
+   struct lf_op *op;
+   int  i, j;
+
+   /* remove line end markers */
+   while (eob>buffer && (*(eob-1)=='\n' || *(eob-1)=='\r')) *--eob='\0';
+
+   for (i=0,op=lf_ops;i<lf_nops;i++,op++)
+   {
+      /* short record?  ok if we got the important bits already */
+      if (cp>=eob)
+      {
+         if (lr->url[0]=='\0') return 0;
+         break;
+      }
+
+      if (op->type==LF_LIT)
+      {
+         for (j=0;j<op->len;j++)
+         {
+            if (op->lit[j]==' ')         /* blank matches any run   */
+            {
+               if (cp>=eob || (*cp!=' ' && *cp!='\t')) return 0;
+               while (cp<eob && (*cp==' ' || *cp=='\t')) cp++;
+            }
+            else if (cp>=eob || *cp++!=op->lit[j]) return 0;
+         }
+         continue;
+      }
+
+      /* find end of field */
+      fs=cp;
+      if (!op->term) cp=eob;
+      else if (op->todate)                /* like CLF, field (username)  */
+      {                                   /* may have blanks, so run up  */
+         while (cp<eob && *cp!='[') cp++; /* to the [date] instead       */
+         cp-=op->todate-1;
+         if (cp<fs) cp=fs;
+      }
+      else
+      {
+         if (*cp=='[' && op->term!=']')   /* [date] has blanks       */
+            while (cp<eob && *cp!=']') cp++;
+         while (cp<eob && *cp!=op->term &&
+                !(op->term==' ' && *cp=='\t'))
+         {
+            if (*cp=='\\' && cp+1<eob) cp++;  /* \" in quoted fields */
+            cp++;
+         }
+      }
+
+      switch (op->type)
+      {
+         case LF_HOST:
+            lr->hnamelen=lf_fldcpy(lr->hostname,fs,cp,MAXHOST,0);
+            if (lr->hnamelen<cp-fs && verbose)
+               fprintf(stderr,"%s\n",msg_big_host);
+            break;
+         case LF_IDENT:
+            lr->identlen=lf_fldcpy(lr->ident,fs,cp,MAXIDENT,0);
+            if (lr->identlen<cp-fs && verbose)
+               fprintf(stderr,"%s\n",msg_big_user);
+            break;
+         case LF_DATE:
+            lf_fldcpy(lr->datetime,fs,cp,sizeof(lr->datetime),0);
+            break;
+         case LF_TIME:
+            lf_fldcpy(lr->datetime,fs,cp,sizeof(lr->datetime),'[');
+            break;
+         case LF_REQ:
+            lr->urllen=lf_fldcpy(lr->url,fs,cp,MAXURL,'"');
+            if (lr->urllen-2<cp-fs && verbose)
+               fprintf(stderr,"%s\n",msg_big_req);
+            /* Strip off HTTP version from URL */
+            if ( (cp2=strstr(lr->url,"HTTP"))!=NULL )
+            {
+               *cp2='\0';
+               lr->urllen = cp2 - lr->url;
+               *(--cp2)='"';
+            }
+            break;
+         case LF_STATUS:
+            lr->resp_code=atoi(fs);
+            break;
+         case LF_BYTES:
+            if (*fs<'0'||*fs>'9') lr->xfer_size=0;
+            else lr->xfer_size=strtoul(fs,NULL,10);
+            break;
+         case LF_REFER:
+            lr->referlen=lf_fldcpy(lr->refer,fs,cp,MAXREF,'"');
+            break;
+         case LF_AGENT:
+            lr->agentlen=lf_fldcpy(lr->agent,fs,cp,MAXAGENT,'"');
+            break;
+      }
+   }
+
+   /* minimal sanity check on timestamp */
+   if ( (lr->datetime[0] != '[') || (lr->datetime[3] != '/') ) return 0;
+   return 1;
+}
+
+/*********************************************/
+/* LF_FLDCPY - copy LogFormat field          */
+/*********************************************/
+
+/* copies [src,end) to dst (size bytes), optionally wrapped in the */
+/* given quote/bracket char.  returns length stored.               */
+
+static int lf_fldcpy(char *dst, char *src, char *end, int size, int q)
+{
+   char *cp=dst, *eos=dst+size-1;
+
+   if (q) { *cp++=q; eos--; if (q=='[') q=']'; }
+   while (src<end && cp<eos) *cp++=*src++;
+   if (q) *cp++=q;
+   *cp='\0';
+   return cp-dst;
+}
+
+/*********************************************/
+/* JSON_KEY - map a JSON key to a field      */
+/*********************************************/
+
+/* JSON log keys, one per log_rec field (changed by "JSONKey") */
+static struct { char *field; int type; char key[64]; } json_keys[] = {
+   { "host",     LF_HOST,   "remote_addr"     },
+   { "user",     LF_IDENT,  "remote_user"     },
+   { "date",     LF_DATE,   "time_local"      },
+   { "request",  LF_REQ,    "request"         },
+   { "url",      LF_URL,    ""                },
+   { "status",   LF_STATUS, "status"          },
+   { "bytes",    LF_BYTES,  "body_bytes_sent" },
+   { "referrer", LF_REFER,  "http_referer"    },
+   { "agent",    LF_AGENT,  "http_user_agent" },
+   { NULL,       0,         ""                } };
+
+/* value is "<field> <key>", returns 0 if bad field name */
+
+int json_key(char *str)
+{
+   char *cp=str;
+   int  i;
+
+   while (*cp && !isspace((unsigned char)*cp)) cp++;
+   for (i=0;json_keys[i].field;i++)
+      if ( (int)strlen(json_keys[i].field)==(cp-str) &&
+           !strncasecmp(json_keys[i].field,str,cp-str) ) break;
+   if (!json_keys[i].field) return 0;
+
+   while (isspace((unsigned char)*cp)) cp++;
+   if (*cp=='"') cp++;                      /* allow "key"           */
+   strncpy(json_keys[i].key,cp,sizeof(json_keys[i].key)-1);
+   cp=json_keys[i].key+strlen(json_keys[i].key);
+   if (cp>json_keys[i].key && *(cp-1)=='"') *(cp-1)='\0';
+   return 1;
+}
+
+/*********************************************/
+/* JSON_SKIP - skip over a JSON value        */
+/*********************************************/
+
+/* returns pointer past the value, or NULL if it runs off the end */
+
+static char *json_skip(char *cp, char *eob)
+{
+   int depth=0;
+
+   while (cp<eob)
+   {
+      switch (*cp)
+      {
+         case '"':
+            for (cp++; cp<eob && *cp!='"'; cp++)
+               if (*cp=='\\') cp++;
+            if (cp>=eob) return NULL;
+            if (!depth) return cp+1;
+            break;
+         case '{': case '[': depth++; break;
+         case '}': case ']':
+            if (!depth) return cp;          /* end of enclosing object */
+            if (!--depth) return cp+1;
+            break;
+         case ',': case ' ': case '\t': case '\r': case '\n':
+            if (!depth) return cp;
+            break;
+      }
+      cp++;
+   }
+   return (depth)?NULL:cp;
+}
+
+/*********************************************/
+/* JSON_STR - copy (unescaped) JSON string   */
+/*********************************************/
+
+/* cp points after the opening quote.  copies into dst (size bytes) */
+/* and returns pointer past the closing quote, or NULL if none.     */
+
+static char *json_str(char *cp, char *eob, char *dst, int size, int *len)
+{
+   char *dp=dst, *eos=dst+size-1;
+   unsigned int u;
+   int  i;
+
+   while (cp<eob && *cp!='"')
+   {
+      if (*cp!='\\') { if (dp<eos) *dp++=*cp; cp++; continue; }
+      if (++cp>=eob) return NULL;
+      switch (*cp++)
+      {
+         case 'b': u='\b'; break;
+         case 'f': u='\f'; break;
+         case 'n': u='\n'; break;
+         case 'r': u='\r'; break;
+         case 't': u='\t'; break;
+         case 'u':
+            for (i=0,u=0; i<4 && cp<eob && isxdigit((unsigned char)*cp); i++,cp++)
+               u=u*16+((*cp<='9')?*cp-'0':(tolower((unsigned char)*cp)-'a'+10));
+            if (u==0 || (u>=0xd800 && u<0xe000)) u='?';  /* no NUL or */
+                                                     /* surrogates */
+            break;
+         default:  u=(unsigned char)*(cp-1); break;   /* \" \\ \/ */
+      }
+      /* store as UTF-8 */
+      if (u<0x80)       { if (dp<eos) *dp++=u; }
+      else if (u<0x800) { if (dp+1<eos)
+                          { *dp++=0xc0|(u>>6); *dp++=0x80|(u&0x3f); } }
+      else              { if (dp+2<eos)
+                          { *dp++=0xe0|(u>>12); *dp++=0x80|((u>>6)&0x3f);
+                            *dp++=0x80|(u&0x3f); } }
+   }
+   *dp='\0';
+   if (len) *len=dp-dst;
+   return (cp<eob)?cp+1:NULL;
+}
+
+/*********************************************/
+/* JSON_DATE - JSON time value to log date   */
+/*********************************************/
+
+/* Accepts seconds since the epoch (nginx $msec etc.), ISO 8601     */
+/* (yyyy-mm-ddThh:mm:ss, local time as logged, like CLF) or a CLF   */
+/* style dd/Mon/yyyy:hh:mm:ss date.  Anything else is passed along */
+/* as-is so fix_date() can complain about it.                      */
+
+static void json_date(char *val, char *dt, struct tz_cache *tc)
+{
+   static char *mname[12]={ "Jan","Feb","Mar","Apr","May","Jun",
+                            "Jul","Aug","Sep","Oct","Nov","Dec" };
+   char *cp=val;
+   int  mon;
+   long long t;
+
+   while (isdigit((unsigned char)*cp)) cp++;
+   if (cp>val && (*cp=='\0' || *cp=='.'))
+   {
+      t=strtoll(val,NULL,10);
+      if (t>0 && t<TZ_MAXLT) { tz_local(dt,(time_t)t,tc); return; }
+   }
+
+   if (cp-val==4 && val[4]=='-' && val[7]=='-' && val[13]==':' &&
+       (val[10]=='T' || val[10]==' ') && val[16]==':')
+   {
+      mon=atoi(&val[5]);
+      if (mon>=1 && mon<=12)
+      {
+         snprintf(dt,29,"[%.2s/%s/%.4s:%.2s:%.2s:%.2s -0000]",
+                  &val[8],mname[mon-1],val,&val[11],&val[14],&val[17]);
+         return;
+      }
+   }
+
+   snprintf(dt,29,"[%s",val);
+}
+
+/*********************************************/
+/* JSON_SCAN - walk one JSON log record      */
+/*********************************************/
+
+/* Streams through the top level object, copying the values of the  */
+/* keys we know straight into the log record (nothing is allocated  */
+/* and other keys, objects and arrays are just skipped).  If lr is  */
+/* NULL, only the date is wanted and goes into dt.  Returns a mask  */
+/* of the LF_xxx types found, or 0 if the record is bad.            */
+
+static int json_scan(char *buffer, int size, struct log_struct *lr,
+                     char *dt, struct tz_cache *tc)
+{
+   char *cp=buffer, *eob=buffer+size, *key, *ep;
+   char tmp[MAXURL];
+   int  i, klen, type, len, got=0;
+
+   while (cp<eob && isspace((unsigned char)*cp)) cp++;
+   if (cp>=eob || *cp++!='{') return 0;
+
+   while (cp<eob)
+   {
+      while (cp<eob && (isspace((unsigned char)*cp) || *cp==',')) cp++;
+      if (cp>=eob || *cp=='}') break;
+      if (*cp++!='"') return 0;
+
+      /* key (raw, escapes in keys not decoded) */
+      key=cp;
+      while (cp<eob && *cp!='"') { if (*cp=='\\') cp++; cp++; }
+      if (cp>=eob) return 0;
+      klen=cp++-key;
+      while (cp<eob && isspace((unsigned char)*cp)) cp++;
+      if (cp>=eob || *cp++!=':') return 0;
+      while (cp<eob && isspace((unsigned char)*cp)) cp++;
+      if (cp>=eob) return 0;
+
+      type=0;
+      for (i=0;json_keys[i].field;i++)
+         if (json_keys[i].key[0] && !strncmp(json_keys[i].key,key,klen) &&
+             json_keys[i].key[klen]=='\0')
+            { type=json_keys[i].type; break; }
+      if (!lr && type!=LF_DATE) type=0;
+
+      if (!type || *cp=='{' || *cp=='[')
+      {
+         if ( (cp=json_skip(cp,eob))==NULL ) return 0;
+         continue;
+      }
+
+      /* get value: string (unescaped) or bare number/literal */
+      if (*cp=='"')
+      {
+         if ( (cp=json_str(cp+1,eob,tmp,sizeof(tmp),&len))==NULL ) return 0;
+      }
+      else
+      {
+         if ( (ep=json_skip(cp,eob))==NULL ) return 0;
+         len=(ep-cp<(int)sizeof(tmp))?ep-cp:(int)sizeof(tmp)-1;
+         memcpy(tmp,cp,len); tmp[len]='\0';
+         if (!strcmp(tmp,"null")) len=tmp[0]='\0';
+         cp=ep;
+      }
+      got|=1<<type;
+
+      if (type==LF_DATE)
+      {
+         json_date(tmp,(lr)?lr->datetime:dt,tc);
+         continue;
+      }
+
+      /* CLF uses '-' for empty fields */
+      if (len==0 && (type==LF_IDENT || type==LF_REFER || type==LF_AGENT))
+         { tmp[0]='-'; tmp[1]='\0'; len=1; }
+
+      switch (type)
+      {
+         case LF_HOST:
+            lr->hnamelen=lf_fldcpy(lr->hostname,tmp,tmp+len,MAXHOST,0);
+            break;
+         case LF_IDENT:
+            lr->identlen=lf_fldcpy(lr->ident,tmp,tmp+len,MAXIDENT,0);
+            break;
+         case LF_REQ:
+            lr->urllen=lf_fldcpy(lr->url,tmp,tmp+len,MAXURL,'"');
+            /* Strip off HTTP version from URL */
+            if ( (ep=strstr(lr->url,"HTTP"))!=NULL )
+            {
+               *ep='\0';
+               lr->urllen = ep - lr->url;
+               *(--ep)='"';
+            }
+            break;
+         case LF_URL:                       /* make it look like a    */
+            if (got&(1<<LF_REQ)) break;     /* request with no method */
+            lr->url[0]='"'; lr->url[1]=' ';
+            lr->urllen=lf_fldcpy(lr->url+2,tmp,tmp+len,MAXURL-3,0)+2;
+            lr->url[lr->urllen++]='"'; lr->url[lr->urllen]='\0';
+            break;
+         case LF_STATUS:
+            lr->resp_code=atoi(tmp);
+            break;
+         case LF_BYTES:
+            if (tmp[0]<'0'||tmp[0]>'9') lr->xfer_size=0;
+            else lr->xfer_size=strtoul(tmp,NULL,10);
+            break;
+         case LF_REFER:
+            lr->referlen=lf_fldcpy(lr->refer,tmp,tmp+len,MAXREF,'"');
+            break;
+         case LF_AGENT:
+            lr->agentlen=lf_fldcpy(lr->agent,tmp,tmp+len,MAXAGENT,'"');
+            break;
+      }
+   }
+   return got;
+}
+
+/*********************************************/
+/* PARSE_RECORD_JSON - JSON lines handler    */
+/*********************************************/
+
+int parse_record_json(char *buffer, int size, struct log_struct *lr)
+{
+   static struct tz_cache tz_json={-1,0,0};
+   int got=json_scan(buffer,size,lr,NULL,&tz_json);
+
+   /* need host, date and a request or URL */
+   if ( !(got&(1<<LF_HOST)) || !(got&(1<<LF_DATE)) ||
+        !(got&((1<<LF_REQ)|(1<<LF_URL))) ) return 0;
+   return 1;
+}
+
+/*********************************************/
+/* JSON_TSTAMP - get date for log merging    */
+/*********************************************/
+
+/* used by logfile.c (merge thread), so it has its own tz cache.    */
+/* puts the CLF style [date] in dt (29 bytes), 0 if there isn't one */
+
+int json_tstamp(char *rec, int len, char *dt)
+{
+   static struct tz_cache tz_merge={-1,0,0};
+
+   return (json_scan(rec,len,NULL,dt,&tz_merge)&(1<<LF_DATE))?1:0;
+}
+
+/*********************************************/
+/* FLDCPY - copy field, return its length    */
+/*********************************************/
+
+static int fldcpy(char *dst, char *src, int size)
+{
+   char *cp=dst, *eos=dst+size-1;
+
+   /* unlike strncpy(), don't pad the rest of the field with zeros */
+   while ( (*src != '\0') && (cp < eos) ) *cp++ = *src++;
+   *cp = '\0';
+   return cp - dst;
+}
+
+/*********************************************/
+/* TZ_OFF - local time offset from UTC       */
+/*********************************************/
+
+static long tz_off(time_t t)
+{
+   struct tm *tp=localtime(&t);
+
+   if (tp==NULL) return LONG_MAX;
+   return (long)((time_t)(jdate(tp->tm_mday,tp->tm_mon+1,tp->tm_year+1900)
+          -epoch)*86400 + tp->tm_hour*3600 + tp->tm_min*60 + tp->tm_sec - t);
+}
+
+/*********************************************/
+/* TZ_GET - cached UTC offset for timestamp  */
+/*********************************************/
+
+/* Returns 1 with the offset if it holds for the whole hour and a   */
+/* day either side of it, so the mktime/localtime dance can be      */
+/* skipped.  Returns 0 near a DST change (or if localtime fails),  */
+/* in which case the caller does the full libc conversion.         */
+
+static int tz_get(struct tz_cache *tc, time_t t, long *off)
+{
+   time_t h=t-(t%3600);
+
+   if (h!=tc->hour)
+   {
+      tc->hour=h;
+      tc->off =tz_off(h);
+      tc->ok  =(tc->off!=LONG_MAX && tz_off(h-86400)==tc->off &&
+                tz_off(h+3600+86400)==tc->off);
+   }
+   *off=tc->off;
+   return tc->ok;
+}
+
+/*********************************************/
+/* TZ_FMT - format local time for log_rec    */
+/*********************************************/
+
+/* same as strftime "[%d/%b/%Y:%H:%M:%S -0000]" (C locale) for a   */
+/* local time given as seconds, lt >= 0 and before year 10000.     */
+
+static void tz_fmt(char *dp, time_t lt)
+{
+   static char *mname[12]={ "Jan","Feb","Mar","Apr","May","Jun",
+                            "Jul","Aug","Sep","Oct","Nov","Dec" };
+   long z, era, doe, yoe, doy, mp, d, m, y, sec;
+
+   /* days to civil date (proleptic gregorian, march based year) */
+   z   = lt/86400 + 719468;  sec = lt%86400;
+   era = z/146097;           doe = z - era*146097;
+   yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+   doy = doe - (365*yoe + yoe/4 - yoe/100);
+   mp  = (5*doy + 2)/153;
+   d   = doy - (153*mp + 2)/5 + 1;
+   m   = (mp<10)? mp+3 : mp-9;
+   y   = yoe + era*400 + (m<=2);
+
+   *dp++='[';
+   *dp++='0'+d/10;         *dp++='0'+d%10;         *dp++='/';
+   memcpy(dp,mname[m-1],3); dp+=3;                 *dp++='/';
+   *dp++='0'+y/1000;       *dp++='0'+(y/100)%10;
+   *dp++='0'+(y/10)%10;    *dp++='0'+y%10;         *dp++=':';
+   *dp++='0'+sec/36000;    *dp++='0'+(sec/3600)%10; *dp++=':';
+   *dp++='0'+(sec%3600)/600; *dp++='0'+(sec/60)%10; *dp++=':';
+   *dp++='0'+(sec%60)/10;  *dp++='0'+sec%10;
+   memcpy(dp," -0000]",8);
+}
+
+/*********************************************/
+/* TZ_LOCAL - format UTC seconds as local    */
+/*********************************************/
+
+static void tz_local(char *dp, time_t t, struct tz_cache *tc)
+{
+   long off;
+
+   if (t>=86400 && tz_get(tc,t,&off) && t+off<TZ_MAXLT)
+      tz_fmt(dp,t+off);
+   else strftime(dp,29,"[%d/%b/%Y:%H:%M:%S -0000]",localtime(&t));
+}
@@ -1,6 +1,10 @@
 #ifndef _PARSER_H
 #define _PARSER_H
 
-extern int  parse_record(char *, int);
+extern int  parse_record(char *, int, struct log_struct *);
+extern void clear_record(struct log_struct *);
+extern int  lf_compile(char *);
+extern int  json_key(char *);
+extern int  json_tstamp(char *, int, char *);
 
 #endif  /* _PARSER_H */
@@ -0,0 +1,450 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>                           /* normal stuff             */
+#include <sched.h>
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#include "webalizer.h"                        /* main header              */
+#include "lang.h"                             /* language declares        */
+#include "parser.h"                           /* record parser            */
+#include "logfile.h"                          /* log file input           */
+#include "pipeline.h"                         /* our header               */
+
+#ifdef USE_THREADS    /* skip whole file if not using threads...          */
+
+#include <pthread.h>
+
+/* max size of one packed record (all fields + raw copy + lengths) */
+#define PL_RECMAX   (int)(sizeof(struct log_struct)+BUFSIZE+64)
+
+/* batch of records passed between stages */
+struct pl_batch { int  n;                     /* records in batch         */
+                  int  eof;                   /* last batch of input      */
+                  int  off[PL_BATCH];         /* record offset in data    */
+                  int  len[PL_BATCH];         /* raw record length        */
+                  int  rc[PL_BATCH];          /* parse status (PR_xxx)    */
+                  char data[PL_DATA]; };      /* records (raw or packed)  */
+
+/* single producer/consumer ring of batch pointers */
+struct pl_ring  { struct pl_batch *slot[PL_RING];
+                  unsigned int head;          /* next put (producer only) */
+                  unsigned int tail; };       /* next take (consumer only)*/
+
+/* fixed part of a packed record, strings follow */
+struct pl_fixed { u_int64_t xfer_size;        /* xfer size in bytes       */
+                  int  resp_code;             /* response code            */
+                  int  year, month, day;      /* record date/time         */
+                  int  hour, min, sec;
+                  int  hnamelen, urllen, referlen;
+                  int  agentlen, srchlen, identlen; };
+
+static struct pl_ring pl_raw;                 /* reader -> parser         */
+static struct pl_ring pl_rfree;               /* parser -> reader (empty) */
+static struct pl_ring pl_recs;                /* parser -> main           */
+static struct pl_ring pl_pfree;               /* main   -> parser (empty) */
+
+static struct pl_batch *pl_bufs[PL_RING*2];   /* all allocated batches    */
+static pthread_t pl_rtid, pl_ptid;            /* reader/parse threads     */
+static int  pl_spin=0;                        /* spin before yield (0=no) */
+
+static struct pl_batch *pl_out=NULL;          /* parser output batch      */
+static int  pl_used=0;                        /* bytes used in pl_out     */
+
+static struct pl_batch *pl_cur=NULL;          /* main thread input batch  */
+static int  pl_idx=0;                         /* next record in pl_cur    */
+static char pl_hdr[8];                        /* bad record prefix        */
+
+extern char tmp_buf[];                        /* raw record (debug)       */
+
+static void pl_pause(int *);
+static void pl_put(struct pl_ring *, struct pl_batch *);
+static struct pl_batch *pl_take(struct pl_ring *);
+static void *pl_reader(void *);
+static void *pl_parser(void *);
+static void pl_emit(int, struct log_struct *, char *, char *);
+static void pl_flush(int);
+static char *pl_pack(char *, char *, int, int);
+static char *pl_unpack(char *, char *);
+
+/*********************************************/
+/* PL_START - start reader/parse threads     */
+/*********************************************/
+
+int pl_start()
+{
+   int  i;
+
+   memset(&pl_raw,  0,sizeof(struct pl_ring));
+   memset(&pl_rfree,0,sizeof(struct pl_ring));
+   memset(&pl_recs, 0,sizeof(struct pl_ring));
+   memset(&pl_pfree,0,sizeof(struct pl_ring));
+
+   /* each stage owns PL_RING batches, so puts never block */
+   for (i=0;i<PL_RING*2;i++)
+   {
+      if ( (pl_bufs[i]=malloc(sizeof(struct pl_batch)))==NULL )
+      {
+         while (i--) free(pl_bufs[i]);
+         return 0;
+      }
+      pl_put((i<PL_RING)?&pl_rfree:&pl_pfree, pl_bufs[i]);
+   }
+   pl_cur=NULL; pl_idx=0;
+
+   /* spinning only helps if the other stages have their own cpu */
+   pl_spin=(sysconf(_SC_NPROCESSORS_ONLN)>2)?100:0;
+
+   if (pthread_create(&pl_rtid,NULL,pl_reader,NULL)!=0)
+   {
+      for (i=0;i<PL_RING*2;i++) free(pl_bufs[i]);
+      return 0;
+   }
+   if (pthread_create(&pl_ptid,NULL,pl_parser,NULL)!=0)
+   {
+      /* reader already running: let it finish on its own */
+      fprintf(stderr,"Error: Unable to start parse thread\n");
+      exit(1);
+   }
+   return 1;
+}
+
+/*********************************************/
+/* PL_GET - get next record from the parser  */
+/*********************************************/
+
+int pl_get(char **rec)
+{
+   struct pl_fixed fx;
+   char   *dp;
+   int    rc;
+
+   while (pl_cur==NULL || pl_idx>=pl_cur->n)
+   {
+      if (pl_cur!=NULL)
+      {
+         if (pl_cur->eof) return PR_EOF;
+         pl_put(&pl_pfree,pl_cur);          /* give batch back        */
+      }
+      pl_cur=pl_take(&pl_recs); pl_idx=0;
+   }
+
+   rc=pl_cur->rc[pl_idx];
+   dp=pl_cur->data+pl_cur->off[pl_idx++];
+   *rec=pl_hdr;
+
+   switch (rc)
+   {
+      case PR_OK:
+         clear_record(&log_rec);
+         memcpy(&fx,dp,sizeof(struct pl_fixed));
+         dp+=sizeof(struct pl_fixed);
+         log_rec.xfer_size=fx.xfer_size;
+         log_rec.resp_code=fx.resp_code;
+         log_rec.year =fx.year;  log_rec.month=fx.month; log_rec.day=fx.day;
+         log_rec.hour =fx.hour;  log_rec.min  =fx.min;   log_rec.sec=fx.sec;
+         log_rec.hnamelen=fx.hnamelen; log_rec.urllen =fx.urllen;
+         log_rec.referlen=fx.referlen; log_rec.agentlen=fx.agentlen;
+         log_rec.srchlen =fx.srchlen;  log_rec.identlen=fx.identlen;
+         dp=pl_unpack(dp,log_rec.hostname);
+         dp=pl_unpack(dp,log_rec.datetime);
+         dp=pl_unpack(dp,log_rec.url);
+         dp=pl_unpack(dp,log_rec.refer);
+         dp=pl_unpack(dp,log_rec.agent);
+         dp=pl_unpack(dp,log_rec.srchstr);
+         dp=pl_unpack(dp,log_rec.ident);
+         break;
+      case PR_DATE:
+         dp=pl_unpack(dp,log_rec.datetime);
+         if (debug_mode) dp=pl_unpack(dp,tmp_buf);
+         break;
+      case PR_BAD:
+         dp=pl_unpack(dp,pl_hdr);
+         if (debug_mode) dp=pl_unpack(dp,tmp_buf);
+         break;
+   }
+   return rc;
+}
+
+/*********************************************/
+/* PL_STOP - wait for threads and clean up   */
+/*********************************************/
+
+void pl_stop()
+{
+   char *rec;
+   int  i;
+
+   /* main loop may stop early, drain so threads can finish */
+   while (pl_get(&rec)!=PR_EOF);
+
+   pthread_join(pl_rtid,NULL);
+   pthread_join(pl_ptid,NULL);
+   for (i=0;i<PL_RING*2;i++) { free(pl_bufs[i]); pl_bufs[i]=NULL; }
+   pl_cur=NULL;
+}
+
+/*********************************************/
+/* PL_READER - read raw records (thread)     */
+/*********************************************/
+
+static void *pl_reader(void *arg)
+{
+   struct pl_batch *b;
+   char   *rec;
+   int    len, used, eof=0;
+
+   while (!eof)
+   {
+      b=pl_take(&pl_rfree);
+      b->n=0; used=0;
+      while (b->n<PL_BATCH && PL_DATA-used>BUFSIZE)
+      {
+         if ( (rec=get_record(&len))==NULL ) { eof=1; break; }
+         memcpy(b->data+used,rec,len);
+         b->data[used+len]='\0';
+         b->off[b->n]=used;
+         b->len[b->n++]=len;
+         used+=len+1;
+      }
+      b->eof=eof;
+      pl_put(&pl_raw,b);                  /* b belongs to parser now  */
+   }
+   return NULL;
+}
+
+/*********************************************/
+/* PL_PARSER - parse raw records (thread)    */
+/*********************************************/
+
+static void *pl_parser(void *arg)
+{
+   struct pl_batch   *b;
+   struct log_struct lrec;
+   char   raw[BUFSIZE], hdr[8], *rec;
+   int    i, len, eof=0, big=0;
+   u_int64_t recno=0;
+
+   pl_out=pl_take(&pl_pfree);
+   pl_out->n=pl_out->eof=pl_used=0;
+
+   while (!eof)
+   {
+      b=pl_take(&pl_raw);
+      for (i=0;i<b->n;i++)
+      {
+         rec=b->data+b->off[i]; len=b->len[i];
+
+         /* skip the rest of an oversized record */
+         if (big)
+         {
+            if (debug_mode && verbose) fprintf(stderr,"%s%s",rec,
+                                    (len<BUFSIZE-1)?"\n":"");
+            if (len<BUFSIZE-1) big=0;
+            continue;
+         }
+
+         recno++;
+         if (len == (BUFSIZE-1))
+         {
+            /* one write, so it doesn't split around main thread output */
+            if (verbose)
+            {
+               if (debug_mode) fprintf(stderr,"%s:\n%s",msg_big_rec,rec);
+               else fprintf(stderr,"%s\n",msg_big_rec);
+            }
+            big=1;
+            pl_emit(PR_BIG,NULL,NULL,NULL);
+            continue;
+         }
+
+         if (debug_mode) strcpy(raw,rec);   /* save in case of error    */
+         if (!parse_record(rec,len,&lrec))
+         {
+            strncpy(hdr,rec,sizeof(hdr)-1); hdr[sizeof(hdr)-1]='\0';
+            pl_emit(PR_BAD,NULL,hdr,raw);
+         }
+         else if (!fix_date(&lrec)) pl_emit(PR_DATE,&lrec,NULL,raw);
+         else
+         {
+            fix_record(&lrec,recno);
+            pl_emit(PR_OK,&lrec,NULL,NULL);
+         }
+      }
+      eof=b->eof;
+      pl_put(&pl_rfree,b);                  /* give batch back        */
+      pl_flush(eof);
+   }
+   return NULL;
+}
+
+/*********************************************/
+/* PL_EMIT - add parsed record to out batch  */
+/*********************************************/
+
+static void pl_emit(int rc, struct log_struct *lr, char *hdr, char *raw)
+{
+   struct pl_fixed fx;
+   char   *dp;
+
+   if (pl_out->n>=PL_BATCH || PL_DATA-pl_used<PL_RECMAX) pl_flush(0);
+
+   dp=pl_out->data+pl_used;
+   pl_out->rc[pl_out->n]=rc;
+   pl_out->off[pl_out->n]=pl_used;
+
+   switch (rc)
+   {
+      case PR_OK:
+         memset(&fx,0,sizeof(struct pl_fixed));
+         fx.xfer_size=lr->xfer_size;
+         fx.resp_code=lr->resp_code;
+         fx.year =lr->year;  fx.month=lr->month; fx.day=lr->day;
+         fx.hour =lr->hour;  fx.min  =lr->min;   fx.sec=lr->sec;
+         fx.hnamelen=lr->hnamelen; fx.urllen  =lr->urllen;
+         fx.referlen=lr->referlen; fx.agentlen=lr->agentlen;
+         fx.srchlen =lr->srchlen;  fx.identlen=lr->identlen;
+         memcpy(dp,&fx,sizeof(struct pl_fixed));
+         dp+=sizeof(struct pl_fixed);
+         dp=pl_pack(dp,lr->hostname,lr->hnamelen,MAXHOST);
+         dp=pl_pack(dp,lr->datetime,0,sizeof(lr->datetime));
+         dp=pl_pack(dp,lr->url,lr->urllen,MAXURL);
+         dp=pl_pack(dp,lr->refer,lr->referlen,MAXREF);
+         dp=pl_pack(dp,lr->agent,lr->agentlen,MAXAGENT);
+         dp=pl_pack(dp,lr->srchstr,lr->srchlen,MAXSRCH);
+         dp=pl_pack(dp,lr->ident,lr->identlen,MAXIDENT);
+         break;
+      case PR_DATE:
+         dp=pl_pack(dp,lr->datetime,0,sizeof(lr->datetime));
+         if (debug_mode) dp=pl_pack(dp,raw,0,BUFSIZE);
+         break;
+      case PR_BAD:
+         dp=pl_pack(dp,hdr,0,8);
+         if (debug_mode) dp=pl_pack(dp,raw,0,BUFSIZE);
+         break;
+   }
+
+   /* keep the next record aligned */
+   pl_used=((dp-pl_out->data)+7)&~7;
+   pl_out->n++;
+}
+
+/*********************************************/
+/* PL_FLUSH - pass out batch to main thread  */
+/*********************************************/
+
+static void pl_flush(int eof)
+{
+   if (pl_out->n==0 && !eof) return;        /* nothing to send        */
+   pl_out->eof=eof;
+   pl_put(&pl_recs,pl_out);
+   if (eof) { pl_out=NULL; return; }
+   pl_out=pl_take(&pl_pfree);
+   pl_out->n=pl_out->eof=pl_used=0;
+}
+
+/*********************************************/
+/* PL_PACK - copy string field into batch    */
+/*********************************************/
+
+static char *pl_pack(char *dp, char *str, int len, int size)
+{
+   int  n=strlen(str)+1;
+
+   /* hashing uses the stored length, so keep whatever it covers */
+   if (len>=n) n=len+1;
+   if (n>size) n=size;
+   memcpy(dp,&n,sizeof(int));
+   memcpy(dp+sizeof(int),str,n);
+   return dp+sizeof(int)+n;
+}
+
+/*********************************************/
+/* PL_UNPACK - copy string field from batch  */
+/*********************************************/
+
+static char *pl_unpack(char *dp, char *str)
+{
+   int  n;
+
+   memcpy(&n,dp,sizeof(int));
+   memcpy(str,dp+sizeof(int),n);
+   return dp+sizeof(int)+n;
+}
+
+/*********************************************/
+/* PL_PUT - add batch to ring (producer)     */
+/*********************************************/
+
+static void pl_put(struct pl_ring *r, struct pl_batch *b)
+{
+   unsigned int head=r->head;
+   int spin=0;
+
+   while (head-__atomic_load_n(&r->tail,__ATOMIC_ACQUIRE)>=PL_RING)
+      pl_pause(&spin);
+   r->slot[head%PL_RING]=b;
+   __atomic_store_n(&r->head,head+1,__ATOMIC_RELEASE);
+}
+
+/*********************************************/
+/* PL_TAKE - remove batch from ring          */
+/*********************************************/
+
+static struct pl_batch *pl_take(struct pl_ring *r)
+{
+   struct pl_batch *b;
+   unsigned int tail=r->tail;
+   int spin=0;
+
+   while (__atomic_load_n(&r->head,__ATOMIC_ACQUIRE)==tail)
+      pl_pause(&spin);
+   b=r->slot[tail%PL_RING];
+   __atomic_store_n(&r->tail,tail+1,__ATOMIC_RELEASE);
+   return b;
+}
+
+/*********************************************/
+/* PL_PAUSE - back off while ring is empty   */
+/*********************************************/
+
+static void pl_pause(int *spin)
+{
+   /* spin briefly, then yield, then sleep so idle waits are cheap */
+   if (++(*spin)<pl_spin) return;
+   if (*spin<pl_spin+1000) { sched_yield(); return; }
+   usleep(100);
+}
+
+#endif  /* USE_THREADS */
@@ -0,0 +1,15 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#ifdef USE_THREADS  /* skip whole file if not using threads...             */
+
+#define PL_BATCH   512                     /* records per batch            */
+#define PL_DATA    (1024*1024)             /* record data per batch        */
+#define PL_RING    8                       /* batches in flight per stage  */
+
+extern int   pl_start();                   /* start reader/parse threads   */
+extern int   pl_get(char **);              /* get next parsed record       */
+extern void  pl_stop();                    /* stop threads and clean up    */
+
+#endif  /* USE_THREADS */
+#endif  /* _PIPELINE_H */
@@ -55,6 +55,7 @@
 #include "hashtab.h"
 #include "parser.h"
 #include "preserve.h"
+#include "logfile.h"
 
 extern char *strncopy(char *a, const char *b, size_t n);
 
@@ -111,7 +112,7 @@ void get_history()
                         yr = hist[i].year;
                         mth= hist[i].month+1;
                         if (mth>12) { mth=1; yr++; }
-                        memcpy(&hist[0], &hist[1], sizeof(hist[0])*i);
+                        memmove(&hist[0], &hist[1], sizeof(hist[0])*i);
                         memset(&hist[i], 0, sizeof(struct hist_rec));
                         hist[i].year=yr; hist[i].month=mth; n--;
                     }
@@ -279,7 +280,7 @@ void update_history()
                   yr = hist[i].year;
                   mth= hist[i].month+1;
                   if (mth>12) { mth=1; yr++; }
-                  memcpy(&hist[0],&hist[1],sizeof(hist[0])*i);
+                  memmove(&hist[0],&hist[1],sizeof(hist[0])*i);
                   memset(&hist[i], 0, sizeof(struct hist_rec));
                   hist[i].year=yr; hist[i].month=mth; n--;
                }
@@ -319,6 +320,7 @@ int save_state()
    FILE *fp;
    int  i;
    struct stat state_stat;
+   struct ht_pos hp;
 
    char buffer[BUFSIZE];
    char new_fname[MAXKVAL+4];
@@ -398,124 +400,106 @@ int save_state()
 
    /* now we need to save our linked lists */
    /* URL list */
-   if (fputs("# -urls- \n",fp)==EOF) return 1;  /* error exit */
-   for (i=0;i<MAXHASH;i++)
+   sprintf(buffer,"# -urls- %llu\n",
+           (unsigned long long)ht_slots(&um_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
+   for (uptr=ht_first(&um_htab,&hp);uptr!=NULL;uptr=ht_next(&um_htab,&hp))
    {
-      uptr=um_htab[i];
-      while (uptr!=NULL)
-      {
-         snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n",
-                  uptr->string, uptr->flag, uptr->count, uptr->files,
-                  uptr->xfer, uptr->entry, uptr->exit);
-         if (fputs(buffer,fp)==EOF) return 1;
-         uptr=uptr->next;
-      }
+      snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n",
+               uptr->string, uptr->flag, uptr->count, uptr->files,
+               uptr->xfer, uptr->entry, uptr->exit);
+      if (fputs(buffer,fp)==EOF) return 1;
    }
    if (fputs("# End Of Table - urls\n",fp)==EOF) return 1;  /* error exit */
 
    /* daily hostname list */
-   if (fputs("# -sites- (monthly)\n",fp)==EOF) return 1;  /* error exit */
+   sprintf(buffer,"# -sites- (monthly) %llu\n",
+           (unsigned long long)ht_slots(&sm_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
 
-   for (i=0;i<MAXHASH;i++)
+   for (hptr=ht_first(&sm_htab,&hp);hptr!=NULL;hptr=ht_next(&sm_htab,&hp))
    {
-      hptr=sm_htab[i];
-      while (hptr!=NULL)
-      {
-         snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n%s\n",
-                  hptr->string, hptr->flag, hptr->count, hptr->files,
-                  hptr->xfer, hptr->visit, hptr->tstamp,
-                  (hptr->lasturl==blank_str)?"-":hptr->lasturl);
-         if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
-         hptr=hptr->next;
-      }
+      snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n%s\n",
+               hptr->string, hptr->flag, hptr->count, hptr->files,
+               hptr->xfer, hptr->visit, hptr->tstamp,
+               (hptr->lasturl==blank_str)?"-":hptr->lasturl);
+      if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
    }
    if (fputs("# End Of Table - sites (monthly)\n",fp)==EOF) return 1;
 
    /* hourly hostname list */
-   if (fputs("# -sites- (daily)\n",fp)==EOF) return 1;  /* error exit */
-   for (i=0;i<MAXHASH;i++)
+   sprintf(buffer,"# -sites- (daily) %llu\n",
+           (unsigned long long)ht_slots(&sd_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
+   for (hptr=ht_first(&sd_htab,&hp);hptr!=NULL;hptr=ht_next(&sd_htab,&hp))
    {
-      hptr=sd_htab[i];
-      while (hptr!=NULL)
-      {
-         snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n%s\n",
-                  hptr->string, hptr->flag, hptr->count, hptr->files,
-                  hptr->xfer, hptr->visit, hptr->tstamp,
-                  (hptr->lasturl==blank_str)?"-":hptr->lasturl);
-         if (fputs(buffer,fp)==EOF) return 1;
-         hptr=hptr->next;
-      }
+      snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n%s\n",
+               hptr->string, hptr->flag, hptr->count, hptr->files,
+               hptr->xfer, hptr->visit, hptr->tstamp,
+               (hptr->lasturl==blank_str)?"-":hptr->lasturl);
+      if (fputs(buffer,fp)==EOF) return 1;
    }
    if (fputs("# End Of Table - sites (daily)\n",fp)==EOF) return 1;
 
    /* Referrer list */
-   if (fputs("# -referrers- \n",fp)==EOF) return 1;  /* error exit */
+   sprintf(buffer,"# -referrers- %llu\n",
+           (unsigned long long)ht_slots(&rm_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
    if (t_ref != 0)
    {
-      for (i=0;i<MAXHASH;i++)
+      for (rptr=ht_first(&rm_htab,&hp);rptr!=NULL;rptr=ht_next(&rm_htab,&hp))
       {
-         rptr=rm_htab[i];
-         while (rptr!=NULL)
-         {
-            snprintf(buffer,sizeof(buffer),"%s\n%d %llu\n",
-                     rptr->string, rptr->flag, rptr->count);
-            if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
-            rptr=rptr->next;
-         }
+         snprintf(buffer,sizeof(buffer),"%s\n%d %llu\n",
+                  rptr->string, rptr->flag, rptr->count);
+         if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
       }
    }
    if (fputs("# End Of Table - referrers\n",fp)==EOF) return 1;
 
    /* User agent list */
-   if (fputs("# -agents- \n",fp)==EOF) return 1;  /* error exit */
+   sprintf(buffer,"# -agents- %llu\n",
+           (unsigned long long)ht_slots(&am_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
    if (t_agent != 0)
    {
-      for (i=0;i<MAXHASH;i++)
+      for (aptr=ht_first(&am_htab,&hp);aptr!=NULL;aptr=ht_next(&am_htab,&hp))
       {
-         aptr=am_htab[i];
-         while (aptr!=NULL)
-         {
-            snprintf(buffer,sizeof(buffer),"%s\n%d %llu\n",
-                     aptr->string, aptr->flag, aptr->count);
-            if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
-            aptr=aptr->next;
-         }
+         snprintf(buffer,sizeof(buffer),"%s\n%d %llu\n",
+                  aptr->string, aptr->flag, aptr->count);
+         if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
       }
    }
    if (fputs("# End Of Table - agents\n",fp)==EOF) return 1;
 
    /* Search String list */
-   if (fputs("# -search strings- \n",fp)==EOF) return 1;  /* error exit */
-   for (i=0;i<MAXHASH;i++)
+   sprintf(buffer,"# -search strings- %llu\n",
+           (unsigned long long)ht_slots(&sr_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
+   for (sptr=ht_first(&sr_htab,&hp);sptr!=NULL;sptr=ht_next(&sr_htab,&hp))
    {
-      sptr=sr_htab[i];
-      while (sptr!=NULL)
-      {
-         snprintf(buffer,sizeof(buffer),"%s\n%llu\n",
-                  sptr->string,sptr->count);
-         if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
-         sptr=sptr->next;
-      }
+      snprintf(buffer,sizeof(buffer),"%s\n%llu\n",
+               sptr->string,sptr->count);
+      if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
    }
    if (fputs("# End Of Table - search strings\n",fp)==EOF) return 1;
 
    /* username list */
-   if (fputs("# -usernames- \n",fp)==EOF) return 1;  /* error exit */
+   sprintf(buffer,"# -usernames- %llu\n",
+           (unsigned long long)ht_slots(&im_htab));
+   if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
 
-   for (i=0;i<MAXHASH;i++)
+   for (iptr=ht_first(&im_htab,&hp);iptr!=NULL;iptr=ht_next(&im_htab,&hp))
    {
-      iptr=im_htab[i];
-      while (iptr!=NULL)
-      {
-         snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n",
-                  iptr->string, iptr->flag, iptr->count, iptr->files,
-              iptr->xfer, iptr->visit, iptr->tstamp);
-         if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
-         iptr=iptr->next;
-      }
+      snprintf(buffer,sizeof(buffer),"%s\n%d %llu %llu %.0f %llu %llu\n",
+               iptr->string, iptr->flag, iptr->count, iptr->files,
+           iptr->xfer, iptr->visit, iptr->tstamp);
+      if (fputs(buffer,fp)==EOF) return 1;  /* error exit */
    }
    if (fputs("# End Of Table - usernames\n",fp)==EOF) return 1;
 
+   /* where we got to in each log file */
+   if (lf_ckpt_save(fp)) return 1;              /* error exit */
+
    /* Done, close file */
    fclose(fp);
 
@@ -528,6 +512,23 @@ int save_state()
    return 0;            /* successful, return with good return code      */
 }
 
+/*********************************************/
+/* TAB_SIZE - hash slots from table header   */
+/*********************************************/
+
+/* saved at the end of the header line, older versions don't have it */
+
+static u_int64_t tab_size(char *str)
+{
+   unsigned long long n=0;
+   char               *cp=str+strlen(str);
+
+   while (cp>str && isspace((unsigned char)cp[-1])) cp--;
+   while (cp>str && isdigit((unsigned char)cp[-1])) cp--;
+   if (isdigit((unsigned char)*cp)) sscanf(cp,"%llu",&n);
+   return (u_int64_t)n;
+}
+
 /*********************************************/
 /* RESTORE_STATE - reload internal run data  */
 /*********************************************/
@@ -542,6 +543,8 @@ int restore_state()
    struct anode t_anode;
    struct snode t_snode;
    struct inode t_inode;
+   struct lf_ckpt t_ckpt;        /* log file restart point */
+   unsigned long long ck[5];     /* (as read, u_int64_t may be long) */
 
    char         buffer[BUFSIZE];
    char         tmp_buf[BUFSIZE];
@@ -644,6 +647,7 @@ int restore_state()
       { if (strncmp(buffer,"# -urls- ",9)) return 10; }  /* (url)        */
       else return 10;   /* error exit */
    }
+   ht_size(&um_htab,tab_size(buffer));        /* pre-size the table       */
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -662,8 +666,9 @@ int restore_state()
          &t_unode.entry, &t_unode.exit);
 
       /* Good record, insert into hash table */
-      if (put_unode(tmp_buf,len,t_unode.flag,t_unode.count,
-         t_unode.xfer,&ul_bogus,t_unode.entry,t_unode.exit,um_htab))
+      if (put_unode(tmp_buf,len,hash(tmp_buf,len),t_unode.flag,
+         t_unode.count,t_unode.xfer,&ul_bogus,t_unode.entry,t_unode.exit,
+         &um_htab))
       {
          if (verbose)
          /* Error adding URL node, skipping ... */
@@ -675,6 +680,7 @@ int restore_state()
    if ((fgets(buffer,BUFSIZE,fp)) != NULL)               /* Table header */
    { if (strncmp(buffer,"# -sites- ",10)) return 8; }    /* (monthly)    */
    else return 8;   /* error exit */
+   ht_size(&sm_htab,tab_size(buffer));
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -704,13 +710,14 @@ int restore_state()
       {
 	     t_hnode.llen = strlen(buffer)-1;
          buffer[t_hnode.llen]=0;
-         t_hnode.lasturl=find_url(buffer,&t_hnode.llen);
+         t_hnode.lasturl=find_url(buffer,&t_hnode.llen,
+                                   hash(buffer,t_hnode.llen));
       }
 
       /* Good record, insert into hash table */
-      if (put_hnode(tmp_buf,len,t_hnode.flag,
+      if (put_hnode(tmp_buf,len,hash(tmp_buf,len),t_hnode.flag,
          t_hnode.count,t_hnode.files,t_hnode.xfer,&ul_bogus,
-         t_hnode.visit+1,t_hnode.tstamp,t_hnode.lasturl,t_hnode.llen,sm_htab))
+         t_hnode.visit+1,t_hnode.tstamp,t_hnode.lasturl,t_hnode.llen,&sm_htab))
       {
          /* Error adding host node (monthly), skipping .... */
          if (verbose) fprintf(stderr,"%s %s\n",msg_nomem_mh, t_hnode.string);
@@ -721,6 +728,7 @@ int restore_state()
    if ((fgets(buffer,BUFSIZE,fp)) != NULL)               /* Table header */
    { if (strncmp(buffer,"# -sites- ",10)) return 9; }    /* (daily)      */
    else return 9;   /* error exit */
+   ht_size(&sd_htab,tab_size(buffer));
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -750,13 +758,14 @@ int restore_state()
       {
 	     t_hnode.llen = strlen(buffer)-1;
          buffer[t_hnode.llen]=0;
-         t_hnode.lasturl=find_url(buffer,&t_hnode.llen);
+         t_hnode.lasturl=find_url(buffer,&t_hnode.llen,
+                                   hash(buffer,t_hnode.llen));
       }
 
       /* Good record, insert into hash table */
-      if (put_hnode(tmp_buf,len,t_hnode.flag,
+      if (put_hnode(tmp_buf,len,hash(tmp_buf,len),t_hnode.flag,
          t_hnode.count,t_hnode.files,t_hnode.xfer,&ul_bogus,
-         t_hnode.visit+1,t_hnode.tstamp,t_hnode.lasturl,t_hnode.llen,sd_htab))
+         t_hnode.visit+1,t_hnode.tstamp,t_hnode.lasturl,t_hnode.llen,&sd_htab))
       {
          /* Error adding host node (daily), skipping .... */
          if (verbose) fprintf(stderr,"%s %s\n",msg_nomem_dh, t_hnode.string);
@@ -767,6 +776,7 @@ int restore_state()
    if ((fgets(buffer,BUFSIZE,fp)) != NULL)               /* Table header */
    { if (strncmp(buffer,"# -referrers- ",14)) return 11; } /* (referrers)*/
    else return 11;   /* error exit */
+   ht_size(&rm_htab,tab_size(buffer));
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -782,8 +792,8 @@ int restore_state()
       sscanf(buffer,"%d %llu",&t_rnode.flag,&t_rnode.count);
 
       /* insert node */
-      if (put_rnode(tmp_buf,len,t_rnode.flag,
-         t_rnode.count, &ul_bogus, rm_htab))
+      if (put_rnode(tmp_buf,len,hash(tmp_buf,len),t_rnode.flag,
+         t_rnode.count, &ul_bogus, &rm_htab))
       {
          if (verbose) fprintf(stderr,"%s %s\n", msg_nomem_r, log_rec.refer);
       }
@@ -793,6 +803,7 @@ int restore_state()
    if ((fgets(buffer,BUFSIZE,fp)) != NULL)               /* Table header */
    { if (strncmp(buffer,"# -agents- ",11)) return 12; } /* (agents)*/
    else return 12;   /* error exit */
+   ht_size(&am_htab,tab_size(buffer));
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -808,8 +819,8 @@ int restore_state()
       sscanf(buffer,"%d %llu",&t_anode.flag,&t_anode.count);
 
       /* insert node */
-      if (put_anode(tmp_buf,len,t_anode.flag,t_anode.count,
-         &ul_bogus,am_htab))
+      if (put_anode(tmp_buf,len,hash(tmp_buf,len),t_anode.flag,
+         t_anode.count,&ul_bogus,&am_htab))
       {
          if (verbose) fprintf(stderr,"%s %s\n", msg_nomem_a, log_rec.agent);
       }
@@ -819,6 +830,7 @@ int restore_state()
    if ((fgets(buffer,BUFSIZE,fp)) != NULL)               /* Table header */
    { if (strncmp(buffer,"# -search string",16)) return 13; }  /* (search)*/
    else return 13;   /* error exit */
+   ht_size(&sr_htab,tab_size(buffer));
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -834,7 +846,7 @@ int restore_state()
       sscanf(buffer,"%llu",&t_snode.count);
 
       /* insert node */
-      if (put_snode(tmp_buf,len,t_snode.count,sr_htab))
+      if (put_snode(tmp_buf,len,hash(tmp_buf,len),t_snode.count,&sr_htab))
       {
          if (verbose) fprintf(stderr,"%s %s\n", msg_nomem_sc, t_snode.string);
       }
@@ -844,6 +856,7 @@ int restore_state()
    if ((fgets(buffer,BUFSIZE,fp)) != NULL)               /* Table header */
    { if (strncmp(buffer,"# -usernames- ",10)) return 14; }
    else return 14;   /* error exit */
+   ht_size(&im_htab,tab_size(buffer));
 
    while ((fgets(buffer,BUFSIZE,fp)) != NULL)
    {
@@ -863,9 +876,9 @@ int restore_state()
          &t_inode.visit, &t_inode.tstamp);
 
       /* Good record, insert into hash table */
-      if (put_inode(tmp_buf,len,t_inode.flag,
+      if (put_inode(tmp_buf,len,hash(tmp_buf,len),t_inode.flag,
          t_inode.count,t_inode.files,t_inode.xfer,&ul_bogus,
-         t_inode.visit+1,t_inode.tstamp,im_htab))
+         t_inode.visit+1,t_inode.tstamp,&im_htab))
       {
          if (verbose)
          /* Error adding username node, skipping .... */
@@ -873,6 +886,22 @@ int restore_state()
       }
    }
 
+   /* log file restart points (optional) */
+   if ((fgets(buffer,BUFSIZE,fp)) != NULL &&
+       !strncmp(buffer,"# -logs- ",9))
+   {
+      while ((fgets(buffer,BUFSIZE,fp)) != NULL)
+      {
+         if (!strncmp(buffer,"# End Of Table ",15)) break;
+         if (sscanf(buffer,"%llu %llu %llu %llu %llu",
+             &ck[0], &ck[1], &ck[2], &ck[3], &ck[4])!=5)
+            return 15;                                   /* error exit */
+         t_ckpt.dev=ck[0];  t_ckpt.ino=ck[1]; t_ckpt.size=ck[2];
+         t_ckpt.hash=ck[3]; t_ckpt.pos=ck[4];
+         lf_ckpt_add(&t_ckpt);
+      }
+   }
+
    fclose(fp);
    check_dup = 1;              /* enable duplicate checking */
    return 0;                   /* return with ok code       */
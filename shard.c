@@ -0,0 +1,612 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>                           /* normal stuff             */
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#include "webalizer.h"                        /* main header              */
+#include "lang.h"                             /* language declares        */
+#include "linklist.h"                         /* linked list stuff        */
+#include "hashtab.h"                          /* hash table functions     */
+#include "dcache.h"                           /* decision caches          */
+#include "shard.h"                            /* our header               */
+
+#ifdef USE_THREADS    /* skip whole file if not using threads...          */
+
+#include <pthread.h>
+
+/* hash keys in each record, every key is owned by one shard thread   */
+#define SH_URL      0                         /* URL                      */
+#define SH_IDENT    1                         /* username                 */
+#define SH_REF      2                         /* referrer                 */
+#define SH_HOST     3                         /* hostname (daily/monthly) */
+#define SH_AGENT    4                         /* user agent               */
+#define SH_SRCH     5                         /* search string            */
+#define SH_GURL     6                         /* URL group                */
+#define SH_GSITE    7                         /* site/domain group        */
+#define SH_GREF     8                         /* referrer group           */
+#define SH_GAGENT   9                         /* user agent group         */
+#define SH_GUSER   10                         /* username group           */
+#define SH_NKEY    11
+
+/* max string data for one record */
+#define SH_RECMAX   (int)(sizeof(struct log_struct)+64)
+
+/* key owner, each hash table segment is only changed by one thread */
+#define SH_OWNER(h) (HT_SEG(h)%sh_n)
+
+/* record as seen by the shard threads */
+struct sh_rec { u_int64_t tstamp;             /* record timestamp         */
+                double    xfer;               /* xfer size in bytes       */
+                char      *key[SH_NKEY];      /* hash keys (NULL=none)    */
+                int       klen[SH_NKEY];      /* key lengths              */
+                u_int64_t hv[SH_NKEY];        /* key hashes               */
+                unsigned char own[SH_NKEY];   /* owning shard of key      */
+                char      file;               /* file flag (RC_OK/PART)   */
+                char      gfile;              /* file flag (groups)       */
+                char      okurl;              /* count URL/ident?         */
+                char      unew;               /* added a new URL node     */
+                struct sh_url url; };         /* URL info for host nodes  */
+
+struct sh_batch { int n;                      /* records in batch         */
+                  int used;                   /* string data used         */
+                  struct sh_rec rec[SH_BATCH];
+                  char data[SH_DATA]; };
+
+/* per thread counters, added to the totals by sh_sync() */
+struct sh_thread { pthread_t tid;             /* thread id                */
+                   int       id;              /* shard number             */
+                   u_int64_t t_url, t_user, t_ref, t_agent;
+                   u_int64_t t_site, dt_site, bogus; };
+
+static struct sh_thread sh_thr[SH_MAXTHREADS];
+static int  sh_n=0;                           /* number of shard threads  */
+
+static struct sh_batch *sh_bufs[2];           /* double buffered batches  */
+static struct sh_batch *sh_fill=NULL;         /* being filled by main     */
+static struct sh_batch *sh_work=NULL;         /* being done by shards     */
+
+static pthread_mutex_t sh_lock;               /* protects everything below*/
+static pthread_cond_t  sh_go;                 /* new batch for shards     */
+static pthread_cond_t  sh_mid;                /* all shards done pass one */
+static pthread_cond_t  sh_done;               /* all shards done batch    */
+static int  sh_gen=0;                         /* batch generation number  */
+static int  sh_left=0;                        /* shards still working     */
+static int  sh_bar=0, sh_bgen=0;              /* mid batch barrier        */
+static int  sh_quit=0;                        /* time to go home          */
+
+static void *sh_worker(void *);
+static void sh_pass1(struct sh_thread *, struct sh_batch *);
+static void sh_pass2(struct sh_thread *, struct sh_batch *);
+static void sh_flush();
+static void sh_wait();
+static void sh_key(struct sh_rec *, int, char *, int, u_int64_t, int);
+static void sh_grp(struct sh_rec *, int, char *, int);
+
+/*********************************************/
+/* SH_START - start shard threads            */
+/*********************************************/
+
+int sh_start(int n)
+{
+   int  i;
+
+   if (n<1) return 0;
+   if (n>SH_MAXTHREADS) n=SH_MAXTHREADS;
+
+   for (i=0;i<2;i++)
+   {
+      if ( (sh_bufs[i]=malloc(sizeof(struct sh_batch)))==NULL )
+      {
+         if (i) free(sh_bufs[0]);
+         return 0;
+      }
+      sh_bufs[i]->n=sh_bufs[i]->used=0;
+   }
+   sh_fill=sh_bufs[0]; sh_work=NULL;
+
+   pthread_mutex_init(&sh_lock,NULL);
+   pthread_cond_init(&sh_go,NULL);
+   pthread_cond_init(&sh_mid,NULL);
+   pthread_cond_init(&sh_done,NULL);
+   sh_gen=sh_left=sh_bar=sh_bgen=sh_quit=0;
+
+   memset(sh_thr,0,sizeof(sh_thr));
+   for (sh_n=0;sh_n<n;sh_n++)
+   {
+      sh_thr[sh_n].id=sh_n;
+      if (pthread_create(&sh_thr[sh_n].tid,NULL,sh_worker,&sh_thr[sh_n])!=0)
+         break;
+   }
+
+   if (sh_n<n)
+   {
+      /* couldn't get them all, so don't use any */
+      if (sh_n) sh_stop();
+      else { free(sh_bufs[0]); free(sh_bufs[1]); }
+      sh_n=0;
+      return 0;
+   }
+   return 1;
+}
+
+/*********************************************/
+/* SH_ADD - queue log_rec for shard threads  */
+/*********************************************/
+
+void sh_add(int file, int page, u_int64_t tstamp)
+{
+   struct sh_rec *r;
+   char   *cp1, buf[BUFSIZE];
+   int    len;
+
+   if (sh_fill->n>=SH_BATCH || SH_DATA-sh_fill->used<SH_RECMAX) sh_flush();
+
+   r=&sh_fill->rec[sh_fill->n];
+   memset(r->key,0,sizeof(r->key));
+   r->tstamp = tstamp;
+   r->xfer   = log_rec.xfer_size;
+   r->file   = file;
+   r->gfile  = (log_rec.resp_code==RC_OK);
+   r->okurl  = (log_rec.resp_code==RC_OK)||(log_rec.resp_code==RC_NOMOD)||
+               (log_rec.resp_code==RC_PARTIALCONTENT);
+   r->unew   = 0;
+   r->url.page    = page;
+   r->url.lasturl = blank_str;
+   r->url.llen    = 0;
+   r->url.entry   = NULL;
+   r->url.idx     = sh_fill->n;
+
+   /* same tests as put_record(), only the hash updates are deferred */
+   sh_key(r,SH_URL,log_rec.url,log_rec.urllen,log_rec.urlhash,MAXURL);
+   if (r->okurl)
+      sh_key(r,SH_IDENT,log_rec.ident,log_rec.identlen,log_rec.identhash,
+             MAXIDENT);
+   if (ntop_refs && log_rec.refer[0]!='\0')
+   {
+      /* put_rnode() renames direct requests, so do it here first */
+      /* to get the same shard (and group match) it would get     */
+      if (log_rec.refer[0]=='-')
+      {
+         strcpy(log_rec.refer,"- (Direct Request)");
+         len=sizeof("- (Direct Request)")-1;
+         sh_key(r,SH_REF,log_rec.refer,len,hash(log_rec.refer,len),MAXREF);
+      }
+      else sh_key(r,SH_REF,log_rec.refer,log_rec.referlen,log_rec.referhash,
+                  MAXREF);
+   }
+   sh_key(r,SH_HOST,log_rec.hostname,log_rec.hnamelen,log_rec.hnamehash,
+          MAXHOST);
+   if (ntop_agents && log_rec.agent[0]!='\0')
+      sh_key(r,SH_AGENT,log_rec.agent,log_rec.agentlen,log_rec.agenthash,
+             MAXAGENT);
+   if (page && ntop_search)
+   {
+      if ( (cp1=srch_string(log_rec.srchstr,buf,&len))!=NULL )
+         sh_key(r,SH_SRCH,cp1,len,hash(cp1,len),BUFSIZE-(cp1-buf));
+   }
+
+   /* groups (names are in the config lists, so no copy needed) */
+   len = log_rec.urllen;
+   if ( (cp1=dc_group(&dc_url,DC_GROUP,group_urls,
+                       log_rec.url,&len,log_rec.urlhash))!=NULL)
+      sh_grp(r,SH_GURL,cp1,len);
+
+   len = log_rec.hnamelen;
+   if ( (cp1=dc_group(&dc_host,DC_GROUP,group_sites,
+                       log_rec.hostname,&len,log_rec.hnamehash))!=NULL)
+      sh_grp(r,SH_GSITE,cp1,len);
+   else if (group_domains)
+   {
+      /* domain is part of the hostname, so point into our copy */
+      len = log_rec.hnamelen;
+      if ( (cp1=get_domain(log_rec.hostname,&len))!=NULL)
+         sh_grp(r,SH_GSITE,r->key[SH_HOST]+(cp1-log_rec.hostname),len);
+   }
+
+   len = log_rec.referlen;
+   if ( (cp1=dc_group(&dc_ref,DC_GROUP,group_refs,
+                       log_rec.refer,&len,log_rec.referhash))!=NULL)
+      sh_grp(r,SH_GREF,cp1,len);
+
+   len = log_rec.agentlen;
+   if ( (cp1=dc_group(&dc_agent,DC_GROUP,group_agents,
+                       log_rec.agent,&len,log_rec.agenthash))!=NULL)
+      sh_grp(r,SH_GAGENT,cp1,len);
+
+   len = log_rec.identlen;
+   if ( (cp1=dc_group(&dc_user,DC_GROUP,group_users,
+                       log_rec.ident,&len,log_rec.identhash))!=NULL)
+      sh_grp(r,SH_GUSER,cp1,len);
+
+   sh_fill->n++;
+}
+
+/*********************************************/
+/* SH_SYNC - finish queued records           */
+/*********************************************/
+
+void sh_sync()
+{
+   int  i;
+
+   sh_flush();
+   sh_wait();
+
+   /* add the shard counters to the totals */
+   for (i=0;i<sh_n;i++)
+   {
+      t_url  +=sh_thr[i].t_url;   sh_thr[i].t_url  =0;
+      t_user +=sh_thr[i].t_user;  sh_thr[i].t_user =0;
+      t_ref  +=sh_thr[i].t_ref;   sh_thr[i].t_ref  =0;
+      t_agent+=sh_thr[i].t_agent; sh_thr[i].t_agent=0;
+      t_site +=sh_thr[i].t_site;  sh_thr[i].t_site =0;
+      dt_site+=sh_thr[i].dt_site; sh_thr[i].dt_site=0;
+      sh_thr[i].bogus=0;
+   }
+}
+
+/*********************************************/
+/* SH_STOP - stop threads and clean up       */
+/*********************************************/
+
+void sh_stop()
+{
+   int  i;
+
+   sh_sync();
+
+   pthread_mutex_lock(&sh_lock);
+   sh_quit=1;
+   pthread_cond_broadcast(&sh_go);
+   pthread_mutex_unlock(&sh_lock);
+
+   for (i=0;i<sh_n;i++) pthread_join(sh_thr[i].tid,NULL);
+
+   pthread_mutex_destroy(&sh_lock);
+   pthread_cond_destroy(&sh_go);
+   pthread_cond_destroy(&sh_mid);
+   pthread_cond_destroy(&sh_done);
+   free(sh_bufs[0]); free(sh_bufs[1]);
+   sh_fill=sh_work=NULL;
+}
+
+/*********************************************/
+/* SH_NEWER - URL node added by later record */
+/*********************************************/
+
+int sh_newer(UNODEPTR uptr, int idx)
+{
+   struct sh_rec *r;
+   int    i;
+
+   /* only used when a URL group has the name of the URL, so rare */
+   for (i=idx+1;i<sh_work->n;i++)
+   {
+      r=&sh_work->rec[i];
+      if (r->unew && r->klen[SH_URL]==uptr->slen &&
+          strcmp(r->key[SH_URL],uptr->string)==0) return 1;
+   }
+   return 0;
+}
+
+/*********************************************/
+/* SH_WORKER - shard thread main loop        */
+/*********************************************/
+
+static void *sh_worker(void *arg)
+{
+   struct sh_thread *t=arg;
+   struct sh_batch  *b;
+   int    gen=0, bgen;
+
+   while (1)
+   {
+      pthread_mutex_lock(&sh_lock);
+      while (sh_gen==gen && !sh_quit) pthread_cond_wait(&sh_go,&sh_lock);
+      if (sh_gen==gen) { pthread_mutex_unlock(&sh_lock); break; }
+      gen=sh_gen; b=sh_work;
+      pthread_mutex_unlock(&sh_lock);
+
+      sh_pass1(t,b);
+
+      /* host nodes need the URL table as of each record, so wait */
+      /* until every shard has done the first pass for the batch  */
+      pthread_mutex_lock(&sh_lock);
+      bgen=sh_bgen;
+      if (++sh_bar==sh_n)
+      {
+         sh_bar=0; sh_bgen++;
+         pthread_cond_broadcast(&sh_mid);
+      }
+      else while (sh_bgen==bgen) pthread_cond_wait(&sh_mid,&sh_lock);
+      pthread_mutex_unlock(&sh_lock);
+
+      sh_pass2(t,b);
+
+      pthread_mutex_lock(&sh_lock);
+      if (--sh_left==0) pthread_cond_signal(&sh_done);
+      pthread_mutex_unlock(&sh_lock);
+   }
+   return NULL;
+}
+
+/*********************************************/
+/* SH_PASS1 - all but the host hash tables   */
+/*********************************************/
+
+static void sh_pass1(struct sh_thread *t, struct sh_batch *b)
+{
+   struct sh_rec *r;
+   u_int64_t n;
+   int    i, me=t->id;
+
+   for (i=0;i<b->n;i++)
+   {
+      r=&b->rec[i];
+      sh_cur=&r->url;
+
+      if (r->own[SH_URL]==me)
+      {
+         /* URL hash table (only if valid response code) */
+         if (r->okurl)
+         {
+            n=t->t_url;
+            if (put_unode(r->key[SH_URL],r->klen[SH_URL],r->hv[SH_URL],
+                OBJ_REG,(u_int64_t)1,r->xfer,&t->t_url,(u_int64_t)0,
+                (u_int64_t)0,&um_htab))
+            {
+               if (verbose)
+               /* Error adding URL node, skipping ... */
+               fprintf(stderr,"%s %s\n", msg_nomem_u, r->key[SH_URL]);
+            }
+            r->unew=(n!=t->t_url);
+         }
+         /* remember what the host nodes will need to know */
+         if (r->url.page)
+            url_info(r->key[SH_URL],r->klen[SH_URL],r->hv[SH_URL],&r->url);
+      }
+
+      if (r->key[SH_IDENT] && r->own[SH_IDENT]==me)
+      {
+         if (put_inode(r->key[SH_IDENT],r->klen[SH_IDENT],r->hv[SH_IDENT],
+             OBJ_REG,1,(u_int64_t)r->file,r->xfer,&t->t_user,0,r->tstamp,
+             &im_htab))
+         {
+            if (verbose)
+            /* Error adding ident node, skipping .... */
+            fprintf(stderr,"%s %s\n", msg_nomem_i, r->key[SH_IDENT]);
+         }
+      }
+
+      if (r->key[SH_REF] && r->own[SH_REF]==me)
+      {
+         if (put_rnode(r->key[SH_REF],r->klen[SH_REF],r->hv[SH_REF],
+             OBJ_REG,(u_int64_t)1,&t->t_ref,&rm_htab))
+         {
+            if (verbose)
+            fprintf(stderr,"%s %s\n", msg_nomem_r, r->key[SH_REF]);
+         }
+      }
+
+      if (r->key[SH_AGENT] && r->own[SH_AGENT]==me)
+      {
+         if (put_anode(r->key[SH_AGENT],r->klen[SH_AGENT],r->hv[SH_AGENT],
+             OBJ_REG,(u_int64_t)1,&t->t_agent,&am_htab))
+         {
+            if (verbose)
+            fprintf(stderr,"%s %s\n", msg_nomem_a, r->key[SH_AGENT]);
+         }
+      }
+
+      if (r->key[SH_SRCH] && r->own[SH_SRCH]==me)
+      {
+         if (put_snode(r->key[SH_SRCH],r->klen[SH_SRCH],r->hv[SH_SRCH],
+             (u_int64_t)1,&sr_htab))
+         {
+            if (verbose)
+            /* Error adding search string node, skipping .... */
+            fprintf(stderr,"%s %s\n", msg_nomem_sc, r->key[SH_SRCH]);
+         }
+      }
+
+      if (r->key[SH_GURL] && r->own[SH_GURL]==me)
+      {
+         if (put_unode(r->key[SH_GURL],r->klen[SH_GURL],r->hv[SH_GURL],
+             OBJ_GRP,(u_int64_t)1,r->xfer,&t->bogus,(u_int64_t)0,
+             (u_int64_t)0,&um_htab))
+         {
+            if (verbose)
+            /* Error adding URL node, skipping ... */
+            fprintf(stderr,"%s %s\n", msg_nomem_u, r->key[SH_GURL]);
+         }
+      }
+
+      if (r->key[SH_GREF] && r->own[SH_GREF]==me)
+      {
+         if (put_rnode(r->key[SH_GREF],r->klen[SH_GREF],r->hv[SH_GREF],
+             OBJ_GRP,(u_int64_t)1,&t->bogus,&rm_htab))
+         {
+            if (verbose)
+            /* Error adding Referrer node, skipping ... */
+            fprintf(stderr,"%s %s\n", msg_nomem_r, r->key[SH_GREF]);
+         }
+      }
+
+      if (r->key[SH_GAGENT] && r->own[SH_GAGENT]==me)
+      {
+         if (put_anode(r->key[SH_GAGENT],r->klen[SH_GAGENT],
+             r->hv[SH_GAGENT],OBJ_GRP,(u_int64_t)1,&t->bogus,&am_htab))
+         {
+            if (verbose)
+            /* Error adding User Agent node, skipping ... */
+            fprintf(stderr,"%s %s\n", msg_nomem_a, r->key[SH_GAGENT]);
+         }
+      }
+
+      if (r->key[SH_GUSER] && r->own[SH_GUSER]==me)
+      {
+         if (put_inode(r->key[SH_GUSER],r->klen[SH_GUSER],r->hv[SH_GUSER],
+             OBJ_GRP,1,(u_int64_t)r->gfile,r->xfer,&t->bogus,0,r->tstamp,
+             &im_htab))
+         {
+            if (verbose)
+            /* Error adding Username node, skipping ... */
+            fprintf(stderr,"%s %s\n", msg_nomem_i, r->key[SH_GUSER]);
+         }
+      }
+   }
+   sh_cur=NULL;
+}
+
+/*********************************************/
+/* SH_PASS2 - host (site) hash tables        */
+/*********************************************/
+
+static void sh_pass2(struct sh_thread *t, struct sh_batch *b)
+{
+   struct sh_rec *r;
+   int    i, me=t->id;
+
+   for (i=0;i<b->n;i++)
+   {
+      r=&b->rec[i];
+      sh_cur=&r->url;
+
+      if (r->own[SH_HOST]==me)
+      {
+         /* hostname (site) hash table - monthly, before daily */
+         if (put_hnode(r->key[SH_HOST],r->klen[SH_HOST],r->hv[SH_HOST],
+             OBJ_REG,1,(u_int64_t)r->file,r->xfer,&t->t_site,
+             0,r->tstamp,"",0,&sm_htab))
+         {
+            if (verbose)
+            /* Error adding host node (monthly), skipping .... */
+            fprintf(stderr,"%s %s\n", msg_nomem_mh, r->key[SH_HOST]);
+         }
+
+         /* hostname (site) hash table - daily */
+         if (put_hnode(r->key[SH_HOST],r->klen[SH_HOST],r->hv[SH_HOST],
+             OBJ_REG,1,(u_int64_t)r->file,r->xfer,&t->dt_site,
+             0,r->tstamp,"",0,&sd_htab))
+         {
+            if (verbose)
+            /* Error adding host node (daily), skipping .... */
+            fprintf(stderr,"%s %s\n",msg_nomem_dh, r->key[SH_HOST]);
+         }
+      }
+
+      if (r->key[SH_GSITE] && r->own[SH_GSITE]==me)
+      {
+         if (put_hnode(r->key[SH_GSITE],r->klen[SH_GSITE],r->hv[SH_GSITE],
+             OBJ_GRP,1,
+             (u_int64_t)r->gfile,r->xfer,&t->bogus,
+             0,r->tstamp,"",0,&sm_htab))
+         {
+            if (verbose)
+            /* Error adding Site node, skipping ... */
+            fprintf(stderr,"%s %s\n", msg_nomem_mh, r->key[SH_GSITE]);
+         }
+      }
+   }
+   sh_cur=NULL;
+}
+
+/*********************************************/
+/* SH_FLUSH - hand filled batch to shards    */
+/*********************************************/
+
+static void sh_flush()
+{
+   if (sh_fill->n==0) return;
+
+   sh_wait();                               /* one batch at a time    */
+   pthread_mutex_lock(&sh_lock);
+   sh_work=sh_fill;
+   sh_left=sh_n;
+   sh_gen++;
+   pthread_cond_broadcast(&sh_go);
+   pthread_mutex_unlock(&sh_lock);
+
+   /* fill the other one while they work */
+   sh_fill=(sh_fill==sh_bufs[0])?sh_bufs[1]:sh_bufs[0];
+   sh_fill->n=sh_fill->used=0;
+}
+
+/*********************************************/
+/* SH_WAIT - wait for shards to finish batch */
+/*********************************************/
+
+static void sh_wait()
+{
+   pthread_mutex_lock(&sh_lock);
+   while (sh_left>0) pthread_cond_wait(&sh_done,&sh_lock);
+   pthread_mutex_unlock(&sh_lock);
+}
+
+/*********************************************/
+/* SH_KEY - copy hash key into batch         */
+/*********************************************/
+
+static void sh_key(struct sh_rec *r, int k, char *str, int len, u_int64_t h,
+                   int size)
+{
+   char *dp=sh_fill->data+sh_fill->used;
+   int  n=strlen(str)+1;
+
+   /* hash() uses the length given, so keep whatever that covers */
+   if (len>=n) n=len+1;
+   if (n>size) n=size;
+   memcpy(dp,str,n);
+   sh_fill->used+=n;
+
+   r->key[k]=dp;
+   r->klen[k]=len;
+   r->hv[k]=h;
+   r->own[k]=SH_OWNER(h);
+}
+
+/*********************************************/
+/* SH_GRP - set group name hash key          */
+/*********************************************/
+
+static void sh_grp(struct sh_rec *r, int k, char *str, int len)
+{
+   r->key[k]=str;
+   r->klen[k]=len;
+   r->hv[k]=hash(str,len);
+   r->own[k]=SH_OWNER(r->hv[k]);
+}
+
+#endif  /* USE_THREADS */
@@ -0,0 +1,17 @@
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#ifdef USE_THREADS  /* skip whole file if not using threads...             */
+
+#define SH_MAXTHREADS 64                   /* max shard threads            */
+#define SH_BATCH      4096                 /* records per batch            */
+#define SH_DATA       (2*1024*1024)        /* string data per batch        */
+
+extern int   sh_start(int);                /* start shard threads          */
+extern void  sh_add(int, int, u_int64_t);  /* queue log_rec for the shards */
+extern void  sh_sync();                    /* wait for queued records      */
+extern void  sh_stop();                    /* stop threads and clean up    */
+extern int   sh_newer(UNODEPTR, int);      /* URL node added by later rec? */
+
+#endif  /* USE_THREADS */
+#endif  /* _SHARD_H */
@@ -77,7 +77,6 @@
 
 #ifdef USE_BZIP
 #include <bzlib.h>
-int bz2_rewind(void **, char *, char *);
 #endif
 
 #include "webalizer.h"                         /* main header              */
@@ -86,6 +85,12 @@ int bz2_rewind(void **, char *, char *);
 #include "preserve.h"
 #include "hashtab.h"
 #include "linklist.h"
+#include "logfile.h"
+#include "pipeline.h"
+#include "shard.h"
+#include "chclass.h"
+#include "ipset.h"
+#include "dcache.h"
 #include "webalizer_lang.h"                    /* lang. support            */
 #ifdef USE_DNS
 #include "dns_resolv.h"
@@ -97,16 +102,13 @@ void    clear_month();                              /* clear monthly stuff */
 int     unescape(char *);                           /* unescape URLs       */
 void    print_opts(char *);                         /* print options       */
 void    print_version();                            /* duhh...             */
-int     isurlchar(unsigned char, int);              /* valid URL char fnc. */
 void    get_config(char *);                         /* Read a config file  */
 static  char *save_opt(char *);                     /* save conf option    */
-void    srch_string(char *);                        /* srch str analysis   */
-char	*get_domain(char *,int *);                  /* return domain name  */
-void    agent_mangle(char *);                       /* reformat user agent */
-static  fgets_func our_gzgets;                      /* our gzgets          */
+static  int get_parsed(char **);                    /* next parsed record  */
+static  void comp_ptype();                          /* PageType hash setup */
+static  int ptype_match(char *, int);               /* PageType ext match  */
 int     ouricmp(char *, char *);                    /* case ins. compare   */
 int     isipaddr(char *);                           /* is IP address test  */
-fgets_func *ourget;
 
 /*********************************************/
 /* GLOBAL VARIABLES                          */
@@ -134,6 +136,11 @@ int     shade_groups = 1;                     /* Group shading 0=no 1=yes */
 int     hlite_groups = 1;                     /* Group hlite 0=no 1=yes   */
 int     mangle_agent = 0;                     /* mangle user agents       */
 int     incremental  = 0;                     /* incremental mode 1=yes   */
+int     follow       = 0;                     /* follow log file (0=no)   */
+int     follow_int   = 60;                    /* report update (seconds)  */
+int     follow_recs  = 0;                     /* report update (records)  */
+int     follow_ckpt  = 600;                   /* state checkpoint (secs)  */
+time_t  ckpt_time    = 0;                     /* last state checkpoint    */
 int     use_https    = 0;                     /* use 'https://' on URLs   */
 int     htaccess     = 0;                     /* create .htaccess? (0=no) */
 int     stripcgi     = 1;                     /* strip url cgi (0=no)     */
@@ -155,6 +162,7 @@ char    *html_ext    = "html";                /* HTML file suffix         */
 char    *dump_ext    = "tab";                 /* Dump file suffix         */
 char    *conf_fname  = NULL;                  /* name of config file      */
 char    *log_fname   = NULL;                  /* log file pointer         */
+char    *log_format  = NULL;                  /* custom LogFormat string  */
 char    *out_dir     = NULL;                  /* output directory         */
 char    *blank_str   = "";                    /* blank string             */
 char    *geodb_fname = NULL;                  /* GeoDB database filename  */
@@ -162,6 +170,9 @@ char    *dns_cache   = NULL;                  /* DNS cache file name      */
 int     dns_children = 0;                     /* DNS children (0=don't do)*/
 int     cache_ips    = 0;                     /* CacheIPs in DB (0=no)    */
 int     cache_ttl    = 7;                     /* DNS Cache TTL (days)     */
+int     dz_threads   = -1;                    /* decomp threads (-1=auto) */
+int     pipeline     = 0;                     /* threaded pipeline (0=no) */
+int     shards       = 0;                     /* shard threads (0=no)     */
 int     geodb        = 0;                     /* Use GeoDB (0=no)         */
 int     graph_mths   = 12;                    /* # months in index graph  */
 int     index_mths   = 12;                    /* # months in index table  */
@@ -214,7 +225,11 @@ u_int64_t  req_tstamp=0;
 u_int64_t  epoch;                             /* used for timestamp adj.  */
 
 int        check_dup=0;                       /* check for dup flag       */
-int        gz_log=COMP_NONE;                  /* gziped log? (0=no)       */
+
+int        good_rec    =0;                    /* 1 if we had a good record*/
+u_int64_t  total_rec   =0;                    /* Total Records Processed  */
+u_int64_t  total_ignore=0;                    /* Total Records Ignored    */
+u_int64_t  total_bad   =0;                    /* Total Bad Records        */
 
 double     t_xfer=0.0;                        /* monthly total xfer value */
 u_int64_t  t_hit=0,t_file=0,t_site=0,         /* monthly total vars       */
@@ -243,21 +258,13 @@ struct     utsname system_info;               /* system info structure    */
 u_int64_t  ul_bogus =0;                       /* Dummy counter for groups */
 
 struct     log_struct log_rec;                /* expanded log storage     */
-
-void       *zlog_fp;                          /* compressed logfile ptr   */
-FILE       *log_fp;                           /* regular logfile pointer  */
-void       *our_fp;                           /* current logfile ptr      */
+int        log_page;                          /* log_rec is a page (1=yes)*/
 
 char       buffer[BUFSIZE];                   /* log file record buffer   */
 char       tmp_buf[BUFSIZE];                  /* used to temp save above  */
 
 CLISTPTR   *top_ctrys    = NULL;              /* Top countries table      */
 
-#define    GZ_BUFSIZE 16384                   /* our_getfs buffer size    */
-char       f_buf[GZ_BUFSIZE];                 /* our_getfs buffer         */
-char       *f_cp=f_buf+GZ_BUFSIZE;            /* pointer into the buffer  */
-int        f_end=0;                           /* count to end of buffer   */ 
-
 char    hit_color[]   = "#00805c";            /* graph hit color          */
 char    file_color[]  = "#0040ff";            /* graph file color         */
 char    site_color[]  = "#ff8000";            /* graph site color         */
@@ -277,11 +284,13 @@ char    pie_color4[]  = "#ffc080";            /* pie additionnal color 4  */
 int main(int argc, char *argv[])
 {
    int      i;                           /* generic counter             */
-   char     *cp1, *cp2, *cp3;            /* generic char pointers       */
+   int      len;                         /* length of current record    */
+   int      rc;                          /* record status (PR_xxx)      */
+   int      page;                        /* record is a page            */
+   char     *cp1;                        /* generic char pointer        */
+   char     *rec_buf;                    /* current log record          */
    char     host_buf[MAXHOST+1];         /* used to save hostname       */
 
-   NLISTPTR lptr;                        /* generic list pointer        */
-
    extern char *optarg;                  /* used for command line       */
    extern int optind;                    /* parsing routine 'getopt'    */
    extern int opterr;
@@ -290,25 +299,14 @@ int main(int argc, char *argv[])
    float  temp_time;                     /* temporary time storage      */
 
    int    rec_year,rec_month=1,rec_day,rec_hour,rec_min,rec_sec;
-
-   int       good_rec    =0;             /* 1 if we had a good record   */
-   u_int64_t total_rec   =0;             /* Total Records Processed     */
-   u_int64_t total_ignore=0;             /* Total Records Ignored       */
-   u_int64_t total_bad   =0;             /* Total Bad Records           */
+   int    j_year=0,j_month=0,j_day=0;     /* day of j_base (cached)      */
+   u_int64_t j_base=0;                   /* rec day start, since epoch  */
 
    int    max_ctry;                      /* max countries defined       */
 
-   /* month names used for parsing logfile (shouldn't be lang specific) */
-   char *log_month[12]={ "jan", "feb", "mar",
-                         "apr", "may", "jun",
-                         "jul", "aug", "sep",
-                         "oct", "nov", "dec"};
-
-   /* stat struct for files */
-   struct stat log_stat;
-
    /* Assume that LC_CTYPE is what the user wants for non-ASCII chars   */
    setlocale(LC_CTYPE,"");
+   cc_init();                            /* char classes (uses locale)  */
 
    /* initalize epoch */
    epoch=jdate(1,1,1970);                /* used for timestamp adj.     */
@@ -322,7 +320,7 @@ int main(int argc, char *argv[])
 
    /* get command line options */
    opterr = 0;     /* disable parser errors */
-   while ((i=getopt(argc,argv,"a:A:bc:C:dD:e:E:fF:g:GhHiI:jJ:k:K:l:Lm:M:n:N:o:O:pP:qQr:R:s:S:t:Tu:U:vVwW:x:XYz:Z"))!=EOF)
+   while ((i=getopt(argc,argv,"a:A:bc:C:dD:e:E:fF:g:GhHiI:jJ:k:K:l:Lm:M:n:N:o:O:pP:qQr:R:s:S:t:Tu:U:vVwW:x:XyYz:Z"))!=EOF)
    {
       switch (i)
       {
@@ -339,7 +337,8 @@ int main(int argc, char *argv[])
         case 'F': log_type=(tolower(optarg[0])=='f')?
                    LOG_FTP:(tolower(optarg[0])=='s')?
                    LOG_SQUID:(tolower(optarg[0])=='w')?
-                   LOG_W3C:LOG_CLF;          break;  /* define log type     */
+                   LOG_W3C:(tolower(optarg[0])=='j')?
+                   LOG_JSON:LOG_CLF;         break;  /* define log type     */
 	case 'g': group_domains=atoi(optarg); break; /* GroupDomains (0=no) */
         case 'G': hourly_graph=0;            break;  /* no hourly graph     */
         case 'h': print_opts(argv[0]);       break;  /* help                */
@@ -378,24 +377,21 @@ int main(int argc, char *argv[])
 #endif
         case 'x': html_ext=optarg;           break;  /* HTML file extension */
         case 'X': hide_sites=1;              break;  /* Hide ind. sites     */
+        case 'y': follow=1;                  break;  /* Follow log file     */
         case 'Y': ctry_graph=0;              break;  /* Supress ctry graph  */
         case 'Z': normalize=0;               break;  /* Dont normalize URLs */
         case 'z': use_flags=1; flag_dir=optarg; break; /* Ctry flag dir     */
       }
    }
 
-   if (argc - optind != 0) log_fname = argv[optind];
-   if ( log_fname && (log_fname[0]=='-')) log_fname=NULL; /* force STDIN?   */
-
-   /* check for gzipped file - .gz */
-   if (log_fname) if (!strcmp((log_fname+strlen(log_fname)-3),".gz"))
-      gz_log=COMP_GZIP;
-
-#ifdef USE_BZIP
-   /* check for bzip file - .bz2 */
-   if (log_fname) if (!strcmp((log_fname+strlen(log_fname)-4),".bz2"))
-      gz_log=COMP_BZIP;
-#endif
+   /* log files given on command line override LogFile */
+   if (argc - optind != 0) log_nfiles = argc - optind;
+   else                    log_nfiles = 1;
+   if ( (log_files=calloc(log_nfiles,sizeof(LFILEPTR))) == NULL)
+   {
+      fprintf(stderr,"Error: Can't allocate memory for log files\n");
+      exit(1);
+   }
 
    /* setup our internal variables */
    init_counters();                      /* initalize (zero) main counters  */
@@ -404,9 +400,21 @@ int main(int argc, char *argv[])
    /* add default index. alias if needed */
    if (default_index) add_nlist("index.",&index_alias);
 
+   /* compile custom log layout if given (CLF type logs only) */
+   if (log_format)
+   {
+      if (log_type!=LOG_CLF) log_format=NULL;
+      else if (!lf_compile(log_format))
+      {
+         fprintf(stderr,"Error: Invalid LogFormat: %s\n",log_format);
+         exit(1);
+      }
+   }
+
    if (page_type==NULL)                  /* check if page types present     */
    {
-      if ((log_type==LOG_CLF)||(log_type==LOG_SQUID)||(log_type==LOG_W3C))
+      if ((log_type==LOG_CLF)||(log_type==LOG_SQUID)||(log_type==LOG_W3C)||
+          (log_type==LOG_JSON))
       {
          add_nlist("htm*"  ,&page_type); /* if no page types specified, we  */
          add_nlist("cgi"   ,&page_type); /* use the default ones here...    */
@@ -453,20 +461,22 @@ int main(int argc, char *argv[])
       }
    }
 
+   /* compile the long pattern lists, now they are complete */
+   comp_glist(group_sites);   comp_glist(group_urls);   comp_glist(group_refs);
+   comp_glist(group_agents);  comp_glist(group_users);  comp_glist(search_list);
+   comp_nlist(hidden_sites);  comp_nlist(hidden_urls);  comp_nlist(hidden_refs);
+   comp_nlist(hidden_agents); comp_nlist(hidden_users);
+   comp_nlist(ignored_sites); comp_nlist(ignored_urls); comp_nlist(ignored_refs);
+   comp_nlist(ignored_agents);comp_nlist(ignored_users);
+   comp_nlist(include_sites); comp_nlist(include_urls); comp_nlist(include_refs);
+   comp_nlist(include_agents);comp_nlist(include_users);
+   comp_nlist(page_type);     comp_nlist(omit_page);     comp_ptype();
+
    /* ensure entry/exits don't exceed urls */
    i=(ntop_urls>ntop_urlsK)?ntop_urls:ntop_urlsK;
    if (ntop_entry>i) ntop_entry=i;
    if (ntop_exit>i)  ntop_exit=i;
 
-   for (i=0;i<MAXHASH;i++)
-   {
-      sm_htab[i]=sd_htab[i]=NULL;        /* initalize hash tables           */
-      um_htab[i]=NULL;
-      rm_htab[i]=NULL;
-      am_htab[i]=NULL;
-      sr_htab[i]=NULL;
-   }
-
    /* Be polite and announce yourself... */
    if (verbose>1)
    {
@@ -486,70 +496,66 @@ int main(int argc, char *argv[])
    if (cache_ttl>100) cache_ttl=100;
 #endif  /* USE_DNS */
 
-   /* open log file */
-   if (log_fname)
+   /* open log file(s) */
+   for (i=0;i<log_nfiles;i++)
    {
-      /* stat the file */
-      if ( !(lstat(log_fname, &log_stat)) )
-      {
-         /* check if the file a symlink */
-         if ( S_ISLNK(log_stat.st_mode) )
-         {
-            if (verbose)
-            fprintf(stderr,"%s %s (symlink)\n",msg_log_err,log_fname);
-            exit(EBADF);
-         }
-      }
+      if (argc - optind != 0) log_fname = argv[optind+i];
+      if ( log_fname && (log_fname[0]=='-')) log_fname=NULL; /* STDIN?   */
 
-      if (gz_log)
+      if ( (len=lf_open(log_fname,&log_files[i])) != 0) exit(len);
+
+      /* Using logfile ... */
+      if (verbose>1)
       {
-         /* open compressed file */
+         printf("%s %s (",msg_log_use,log_fname?log_fname:"STDIN");
+         if (log_files[i]->comp==COMP_GZIP) printf("gzip-");
 #ifdef USE_BZIP
-         if (gz_log==COMP_BZIP)
-            zlog_fp = BZ2_bzopen(log_fname,"rb");
-         else
+         if (log_files[i]->comp==COMP_BZIP) printf("bzip-");
 #endif
-         zlog_fp = gzopen(log_fname, "rb");
-         if (zlog_fp==Z_NULL)
-         {
-            /* Error: Can't open log file ... */
-            fprintf(stderr, "%s %s (%d)\n",msg_log_err,log_fname,ENOENT);
-            exit(ENOENT);
-         }
-		 our_fp = zlog_fp;
-      }
-      else
-      {
-         /* open regular file */
-         log_fp = fopen(log_fname,"r");
-         if (log_fp==NULL)
+#ifdef USE_XZ
+         if (log_files[i]->comp==COMP_XZ)   printf("xz-");
+#endif
+#ifdef USE_ZSTD
+         if (log_files[i]->comp==COMP_ZSTD) printf("zstd-");
+#endif
+         switch (log_type)
          {
-            /* Error: Can't open log file ... */
-            fprintf(stderr, "%s %s\n",msg_log_err,log_fname);
-            exit(1);
+            /* display log file type hint */
+            case LOG_CLF:   printf((log_format)?"custom)\n":"clf)\n");
+                            break;
+            case LOG_FTP:   printf("ftp)\n");   break;
+            case LOG_SQUID: printf("squid)\n"); break;
+            case LOG_W3C:   printf("w3c)\n");   break;
+            case LOG_JSON:  printf("json)\n");  break;
          }
-		 our_fp = log_fp;
       }
-   } else {
-      our_fp = stdin;
    }
 
-   /* Using logfile ... */
-   if (verbose>1)
+   /* follow mode needs a single, uncompressed log */
+   if (follow && (log_nfiles>1 || log_files[0]->comp))
    {
-      printf("%s %s (",msg_log_use,log_fname?log_fname:"STDIN");
-      if (gz_log==COMP_GZIP) printf("gzip-");
-#ifdef USE_BZIP
-      if (gz_log==COMP_BZIP) printf("bzip-");
-#endif
-      switch (log_type)
-      {
-         /* display log file type hint */
-         case LOG_CLF:   printf("clf)\n");   break;
-         case LOG_FTP:   printf("ftp)\n");   break;
-         case LOG_SQUID: printf("squid)\n"); break;
-         case LOG_W3C:   printf("w3c)\n");   break;
-      }
+      if (verbose)
+         fprintf(stderr,"Warning: Can only follow a single uncompressed " \
+                        "log file, follow mode disabled\n");
+      follow=0;
+   }
+
+   /* pipeline can't follow, or refeed W3C headers across files */
+   if (pipeline && (follow || (log_type==LOG_W3C && log_nfiles>1)))
+   {
+      if (verbose)
+         fprintf(stderr,"Warning: Pipeline not supported with follow " \
+                        "mode or multiple W3C logs, disabled\n");
+      pipeline=0;
+   }
+
+   /* shard threads are only synced at day/month change, not for follow */
+   if (shards && follow)
+   {
+      if (verbose)
+         fprintf(stderr,"Warning: ShardThreads not supported with follow " \
+                        "mode, disabled\n");
+      shards=0;
    }
 
    /* switch directories if needed */
@@ -581,12 +587,9 @@ int main(int argc, char *argv[])
       /* DNS Lookup (#children): */
       if (verbose>1) printf("%s (%d): ",msg_dns_rslv,dns_children);
       fflush(stdout);
-	  dns_resolver(our_fp);
-#ifdef USE_BZIP
-      (gz_log==COMP_BZIP)?bz2_rewind(&zlog_fp, log_fname, "rb"):
-#endif
-      (gz_log==COMP_GZIP)?gzrewind(zlog_fp):
-      (log_fname)?rewind(log_fp):exit(0);
+      dns_resolver();
+      for (i=0;i<log_nfiles;i++)
+         if (lf_rewind(log_files[i])) exit(0);
    }
 
    if (strstr(argv[0],"webazolver")!=0) exit(0);   /* webazolver exits here */
@@ -669,6 +672,7 @@ int main(int argc, char *argv[])
          fprintf(stderr,"%s (%d)\n",msg_bad_data,i);
          exit(1);
       }
+      if (check_dup) lf_resume();        /* skip to where we left off       */
    }
 
    /* Allocate memory for our TOP countries array */
@@ -684,70 +688,45 @@ int main(int argc, char *argv[])
    /* MAIN PROCESS LOOP - read through log file */
    /*********************************************/
 
-   ourget = gz_log ? our_gzgets : fgets;
-   while ( ourget(buffer,BUFSIZE,our_fp) != NULL )
+   lf_merge_init();                      /* merge multiple log files */
+   if (follow)
+   {
+      if (follow_int<1) follow_int=1;    /* keep report updates sane */
+      ckpt_time=start_time;
+      lf_follow_init();                  /* tail log until signaled  */
+   }
+#ifdef USE_THREADS
+   if (pipeline && !pl_start())          /* read/parse in threads    */
+   {
+      if (verbose)
+         fprintf(stderr,"Warning: Unable to start pipeline threads\n");
+      pipeline=0;
+   }
+   if (shards && !sh_start(shards))      /* hash updates in threads  */
+   {
+      if (verbose)
+         fprintf(stderr,"Warning: Unable to start shard threads\n");
+      shards=0;
+   }
+#endif
+   while ( (rc=get_parsed(&rec_buf)) != PR_EOF )
    {
-      int len = strlen(buffer);
       total_rec++;
-      if (len == (BUFSIZE-1))
+      if (rc == PR_BIG)                   /* oversized, already skipped   */
       {
-         if (verbose)
-         {
-            fprintf(stderr,"%s",msg_big_rec);
-            if (debug_mode) fprintf(stderr,":\n%s",buffer);
-            else fprintf(stderr,"\n");
-         }
-
          total_bad++;                     /* bump bad record counter      */
-
-         /* get the rest of the record */
-         while ( ourget(buffer,BUFSIZE,our_fp) != NULL )
-         {
-		    len = strlen(buffer);
-            if (len < BUFSIZE-1)
-            {
-               if (debug_mode && verbose) fprintf(stderr,"%s\n",buffer);
-               break;
-            }
-            if (debug_mode && verbose) fprintf(stderr,"%s",buffer);
-         }
          continue;                        /* go get next record if any    */
       }
 
       /* got a record... */
-      strcpy(tmp_buf, buffer);            /* save buffer in case of error */
-      if (parse_record(buffer, len))      /* parse the record             */
+      if (rc != PR_BAD)                   /* parsed ok?                   */
       {
          /*********************************************/
          /* PASSED MINIMAL CHECKS, DO A LITTLE MORE   */
          /*********************************************/
 
-         /* convert month name to lowercase */
-         for (i=4;i<7;i++)
-            log_rec.datetime[i]=tolower(log_rec.datetime[i]);
-
-         /* lowercase sitename/IPv6 addresses */
-         cp1=log_rec.hostname;
-         while (*cp1++!='\0') *cp1=tolower(*cp1);
-
-         /* get year/month/day/hour/min/sec values    */
-         for (i=0;i<12;i++)
-         {
-            if (strncmp(log_month[i],&log_rec.datetime[4],3)==0)
-               { rec_month = i+1; break; }
-         }
-
-         rec_year=atoi(&log_rec.datetime[8]);    /* get year number (int)   */
-         rec_day =atoi(&log_rec.datetime[1]);    /* get day number          */
-         rec_hour=atoi(&log_rec.datetime[13]);   /* get hour number         */
-         rec_min =atoi(&log_rec.datetime[16]);   /* get minute number       */
-         rec_sec =atoi(&log_rec.datetime[19]);   /* get second number       */
-
-         /* Kludge for Netscape server time (0-24?) error                   */
-         if (rec_hour>23) rec_hour=0;
-
          /* minimal sanity check on date */
-         if ((i>=12)||(rec_min>59)||(rec_sec>60)||(rec_year<1990))
+         if (rc == PR_DATE)
          {
             total_bad++;                /* if a bad date, bump counter      */
             if (verbose)
@@ -760,6 +739,11 @@ int main(int argc, char *argv[])
             continue;                   /* and ignore this record           */
          }
 
+         /* get year/month/day/hour/min/sec values    */
+         rec_year =log_rec.year;   rec_month=log_rec.month;
+         rec_day  =log_rec.day;    rec_hour =log_rec.hour;
+         rec_min  =log_rec.min;    rec_sec  =log_rec.sec;
+
          /*********************************************/
          /* GOOD RECORD, CHECK INCREMENTAL/TIMESTAMPS */
          /*********************************************/
@@ -769,8 +753,12 @@ int main(int argc, char *argv[])
 
          /* get current records timestamp (seconds since epoch) */
          req_tstamp=cur_tstamp;
-         rec_tstamp=((jdate(rec_day,rec_month,rec_year)-epoch)*86400)+
-                     (rec_hour*3600)+(rec_min*60)+rec_sec;
+         if (rec_day!=j_day || rec_month!=j_month || rec_year!=j_year)
+         {
+            j_day=rec_day; j_month=rec_month; j_year=rec_year;
+            j_base=(jdate(rec_day,rec_month,rec_year)-epoch)*86400;
+         }
+         rec_tstamp=j_base+(rec_hour*3600)+(rec_min*60)+rec_sec;
 
          /* Do we need to check for duplicate records? (incremental mode)   */
          if (check_dup)
@@ -824,226 +812,8 @@ int main(int argc, char *argv[])
          /* DO SOME PRE-PROCESS FORMATTING            */
          /*********************************************/
 
-         /* un-escape URL */
-         log_rec.urllen = unescape(log_rec.url);
-
-         /* fix URL field */
-         cp1 = cp2 = log_rec.url;
-         /* handle null '-' case here... */
-         if (*++cp1 == '-')
-		 {
-		   strcpy(log_rec.url,"/INVALID-URL");
-		   log_rec.urllen=sizeof("/INVALID-URL")-1;
-		 }
-         else
-         {
-            /* strip actual URL out of request */
-            while  ( (*cp1 != ' ') && (*cp1 != '\0') ) cp1++;
-            if (*cp1 != '\0')
-            {
-               /* scan to begin of actual URL field */
-               while ((*cp1 == ' ') && (*cp1 != '\0')) cp1++;
-               /* remove duplicate / if needed */
-               while (( *cp1=='/') && (*(cp1+1)=='/')) cp1++;
-               while (( *cp1!='\0')&&(*cp1!='"')) *cp2++=*cp1++;
-               *cp2='\0';
-			   log_rec.urllen = cp2 - log_rec.url;
-            }
-         }
-
-         /* strip query portion of cgi scripts */
-         cp1 = log_rec.url;
-         while (*cp1 != '\0')
-           if (!isurlchar(*cp1, stripcgi)) { *cp1 = '\0'; log_rec.urllen = cp1 - log_rec.url; break; }
-           else cp1++;
-         if (log_rec.url[0]=='\0')
-           { log_rec.url[0]='/'; log_rec.url[1]='\0'; log_rec.urllen = 1; }
-
-         /* Normalize URL */
-         if (log_type==LOG_CLF && log_rec.resp_code!=RC_NOTFOUND && normalize)
-         {
-            if ( ((cp2=strstr(log_rec.url,"://"))!=NULL)&&(cp2<log_rec.url+6) )
-            {
-               cp1=cp2+3;
-               /* see if a '/' is present after it  */
-               if ( (cp2=strchr(cp1,(int)'/'))==NULL) cp1--;
-               else cp1=cp2;
-               /* Ok, now shift url string          */
-               cp2=log_rec.url; while (*cp1!='\0') *cp2++=*cp1++; *cp2='\0';
-			   log_rec.urllen = cp2 - log_rec.url;
-            }
-            /* extra sanity checks on URL string */
-            while ((cp2=strstr(log_rec.url,"/./")))
-               { cp1=cp2+2; while (*cp1!='\0') *cp2++=*cp1++; *cp2='\0';
-			     log_rec.urllen = cp2 - log_rec.url;}
-            if (log_rec.url[0]!='/')
-            {
-               if ( log_rec.resp_code==RC_OK             ||
-                    log_rec.resp_code==RC_PARTIALCONTENT ||
-                    log_rec.resp_code==RC_NOMOD)
-               {
-                  if (debug_mode)
-                     fprintf(stderr,"Converted URL '%s' to '/'\n",log_rec.url);
-                  log_rec.url[0]='/';
-                  log_rec.url[1]='\0';
-				  log_rec.urllen = 1;
-               }
-               else
-               {
-                  if (debug_mode)
-                     fprintf(stderr,"Invalid URL: '%s'\n",log_rec.url);
-                  strcpy(log_rec.url,"/INVALID-URL");
-				  log_rec.urllen = sizeof("/INVALID-URL")-1;
-               }
-            }
-            while ( log_rec.url[ (i=log_rec.urllen-1) ] == '?' ) {
-               log_rec.url[i]='\0';   /* drop trailing ?s if any */
-			   log_rec.urllen = i;
-			}
-         }
-         else
-         {
-            /* check for service (ie: http://) and lowercase if found */
-            if (((cp2=strstr(log_rec.url,"://"))!= NULL)&&(cp2<log_rec.url+6))
-            {
-               cp1=log_rec.url;
-               while (cp1!=cp2)
-               {
-                  if ( (*cp1>='A') && (*cp1<='Z')) *cp1 += 'a'-'A';
-                  cp1++;
-               }
-            }
-         }
-
-         /* strip off index.html (or any aliases) */
-         lptr=index_alias;
-         while (lptr!=NULL)
-         {
-            if ((cp1=strstr(log_rec.url,lptr->string))!=NULL)
-            {
-               if (*(cp1-1)=='/')
-               {
-                  if ( !stripcgi && (cp2=strchr(cp1,'?'))!=NULL )
-                  { while(*cp2) *cp1++=*cp2++; *cp1='\0'; }
-                  else *cp1='\0';
-				  log_rec.urllen = cp1 - log_rec.url;
-                  break;
-               }
-            }
-            lptr=lptr->next;
-         }
-
-         /* unescape referrer */
-         log_rec.referlen = unescape(log_rec.refer);
-
-         /* fix referrer field */
-         cp1 = log_rec.refer;
-         cp3 = cp2 = cp1++;
-         if ( (*cp2 != '\0') && (*cp2 == '"') )
-         {
-            while ( *cp1 != '\0' )
-            {
-               cp3=cp2;
-               if (((unsigned char)*cp1<32&&(unsigned char)*cp1>0) ||
-                    *cp1==127 || (unsigned char)*cp1=='<') *cp1=0;
-               else *cp2++=*cp1++;
-            }
-            *cp3 = '\0';
-			log_rec.referlen = cp3 - log_rec.refer;
-         }
-
-         /* get query portion of cgi referrals */
-         cp1 = log_rec.refer;
-         if (*cp1 != '\0')
-         {
-            while (*cp1 != '\0')
-            {
-               if (!isurlchar(*cp1, 1))
-               {
-                  /* Save query portion in log.rec.srchstr */
-                  strncpy(log_rec.srchstr,(char *)cp1,MAXSRCH);
-                  *cp1++='\0';
-				  log_rec.referlen = cp1 - log_rec.refer - 1;
-                  break;
-               }
-               else cp1++;
-            }
-            /* handle null referrer */
-            if (log_rec.refer[0]=='\0')
-              { log_rec.refer[0]='-'; log_rec.refer[1]='\0';
-			    log_rec.referlen = 1;}
-         }
-
-         /* if HTTP request, lowercase http://sitename/ portion */
-         cp1 = log_rec.refer;
-         if ( (*cp1=='h') || (*cp1=='H'))
-         {
-            while ( (*cp1!='/') && (*cp1!='\0'))
-            {
-               if ( (*cp1>='A') && (*cp1<='Z')) *cp1 += 'a'-'A';
-               cp1++;
-            }
-            /* now do hostname */
-            if ( (*cp1=='/') && ( *(cp1+1)=='/')) {cp1++; cp1++;}
-            while ( (*cp1!='/') && (*cp1!='\0'))
-            {
-               if ( (*cp1>='A') && (*cp1<='Z')) *cp1 += 'a'-'A';
-               cp1++;
-            }
-         }
-
-         /* Do we need to mangle? */
-         if (mangle_agent) agent_mangle(log_rec.agent);
-
-         /* if necessary, shrink referrer to fit storage */
-         if (log_rec.referlen>=MAXREFH)
-         {
-            if (verbose) fprintf(stderr,"%s [%llu]\n",
-                msg_big_ref,total_rec);
-            log_rec.refer[MAXREFH-1]='\0';
-			log_rec.referlen = MAXREFH-1;
-         }
-
-         /* if necessary, shrink URL to fit storage */
-         if (log_rec.urllen>=MAXURLH)
-         {
-            if (verbose) fprintf(stderr,"%s [%llu]\n",
-                msg_big_req,total_rec);
-            log_rec.url[MAXURLH-1]='\0';
-			log_rec.urllen = MAXURLH-1;
-         }
-
-         /* fix user agent field */
-         cp1 = log_rec.agent;
-         cp3 = cp2 = cp1++;
-         if ( (*cp2 != '\0') && ((*cp2 == '"')||(*cp2 == '(')) )
-         {
-            while (*cp1 != '\0') { cp3 = cp2; *cp2++ = *cp1++; }
-            *cp3 = '\0';
-			log_rec.agentlen = cp3 - log_rec.agent;
-         }
-         cp1 = log_rec.agent;    /* CHANGE !!! */
-         while (*cp1 != 0)       /* get rid of more common _bad_ chars ;)   */
-         {
-            if ( ((unsigned char)*cp1 < 32) ||
-                 ((unsigned char)*cp1==127) ||
-                 (*cp1=='<') || (*cp1=='>') )
-               { *cp1='\0'; log_rec.agentlen = cp1 - log_rec.agent; break; }
-            else cp1++;
-         }
-
-         /* fix username if needed */
-         if (log_rec.ident[0]==0)
-          {  log_rec.ident[0]='-'; log_rec.ident[1]='\0'; log_rec.identlen = 1; }
-         else
-         {
-            cp3=log_rec.ident;
-            while ((unsigned char)*cp3>=32 && *cp3!='"') cp3++;
-            *cp3='\0';
-			log_rec.identlen = cp3 - log_rec.ident;
-         }
-         /* unescape user name */
-         log_rec.identlen = unescape(log_rec.ident);
+         /* done by the parse thread if pipelined */
+         if (!pipeline) fix_record(&log_rec,total_rec);
 
          /********************************************/
          /* PROCESS RECORD                           */
@@ -1075,13 +845,19 @@ int main(int argc, char *argv[])
             cur_hour = rec_hour;
          }
 
+#ifdef USE_THREADS
+         /* shards must catch up before tables are used or cleared */
+         if (shards && ( (cur_day != rec_day) ||
+             (cur_month != rec_month) || (cur_year != rec_year) ) )
+            sh_sync();
+#endif
          /* check for day change   */
          if (cur_day != rec_day)
          {
             /* if yes, init daily stuff */
             tm_site[cur_day-1]=dt_site; dt_site=0;
-            tm_visit[cur_day-1]=tot_visit(sd_htab);
-            del_hlist(sd_htab);
+            tm_visit[cur_day-1]=tot_visit(&sd_htab);
+            del_hlist(&sd_htab);
             cur_day = rec_day;
          }
 
@@ -1089,8 +865,8 @@ int main(int argc, char *argv[])
          if ( (cur_month != rec_month) || (cur_year != rec_year) )
          {
             /* if yes, do monthly stuff */
-            t_visit=tot_visit(sm_htab);
-            month_update_exit(req_tstamp);    /* process exit pages      */
+            t_visit=tot_visit(&sm_htab);
+            month_update_exit(req_tstamp,1);  /* process exit pages      */
             update_history();
             write_month_html();               /* generate HTML for month */
             clear_month();
@@ -1099,8 +875,8 @@ int main(int argc, char *argv[])
             f_day=l_day=rec_day;
          }
 
-         /* save hostname for later */
-         strncpy(host_buf, log_rec.hostname, sizeof(log_rec.hostname));
+         /* save hostname for later (only the string, not the field) */
+         memcpy(host_buf, log_rec.hostname, log_rec.hnamelen+1);
 
 #ifdef USE_DNS
          /* Resolve IP address if needed */
@@ -1121,8 +897,8 @@ int main(int argc, char *argv[])
          /* lowercase hostname and validity check */
          cp1 = log_rec.hostname; i=0;
 
-         if ( (!isalnum((unsigned char)*cp1)) && (*cp1!=':') )
-            strncpy(log_rec.hostname, "Invalid", 8);
+         if ( !(cc_tab[(unsigned char)*cp1]&CC_ALNUM) && (*cp1!=':') )
+            { strncpy(log_rec.hostname, "Invalid", 8); log_rec.hnamelen=7; }
          else
          {
             while (*cp1 != '\0')  /* loop through string */
@@ -1130,45 +906,50 @@ int main(int argc, char *argv[])
                if ( (*cp1>='A') && (*cp1<='Z') )
                   { *cp1++ += 'a'-'A'; continue; }
                if ( *cp1=='.' ) i++;
-               if ( (isalnum((unsigned char)*cp1)) ||
-                    (*cp1=='.')||(*cp1=='-')       ||
-                    (*cp1==':')||((*cp1=='_')&&(i==0)) ) cp1++;
+               if ( (cc_tab[(unsigned char)*cp1]&CC_HOST) ||
+                    ((*cp1=='_')&&(i==0)) ) cp1++;
                else
                {
                   /* Invalid hostname found! */
                   if (strcmp(log_rec.hostname, host_buf))
-                     strcpy(log_rec.hostname, host_buf);
-                  else strncpy(log_rec.hostname,"Invalid",8);
+                     log_rec.hnamelen=strlen(strcpy(log_rec.hostname,host_buf));
+                  else
+                     { strncpy(log_rec.hostname,"Invalid",8); log_rec.hnamelen=7; }
                   break;
                }
             }
             if (*cp1 == '\0')   /* did we make it to the end? */
             {
-               if (!isalnum((unsigned char)*(cp1-1)))
-                  strncpy(log_rec.hostname,"Invalid",8);
+               if (!(cc_tab[(unsigned char)*(cp1-1)]&CC_ALNUM))
+                  { strncpy(log_rec.hostname,"Invalid",8); log_rec.hnamelen=7; }
             }
          }
 
          /* Catch blank hostnames here */
          if (log_rec.hostname[0]=='\0')
-            strncpy(log_rec.hostname,"Unknown",8);
-
-         /* Ignore/Include check */
-         if ( (isinlist(include_sites,log_rec.hostname,log_rec.hnamelen)==NULL) &&
-              (isinlist(include_urls,log_rec.url,log_rec.urllen)==NULL)       &&
-              (isinlist(include_refs,log_rec.refer,log_rec.referlen)==NULL)     &&
-              (isinlist(include_agents,log_rec.agent,log_rec.agentlen)==NULL)   &&
-              (isinlist(include_users,log_rec.ident,log_rec.identlen)==NULL)    )
+            { strncpy(log_rec.hostname,"Unknown",8); log_rec.hnamelen=7; }
+
+         /* keys are final now, hash them once for all the lookups */
+         log_rec.hnamehash=hash(log_rec.hostname,log_rec.hnamelen);
+         log_rec.urlhash  =hash(log_rec.url,log_rec.urllen);
+         log_rec.referhash=hash(log_rec.refer,log_rec.referlen);
+         log_rec.agenthash=hash(log_rec.agent,log_rec.agentlen);
+         log_rec.identhash=hash(log_rec.ident,log_rec.identlen);
+
+         /* Ignore/Include check (answers are cached for each string) */
+         i = dc_filter(&dc_host,log_rec.hostname,log_rec.hnamelen,
+                       log_rec.hnamehash,include_sites,ignored_sites)    |
+             dc_filter(&dc_url,log_rec.url,log_rec.urllen,
+                       log_rec.urlhash,include_urls,ignored_urls)        |
+             dc_filter(&dc_ref,log_rec.refer,log_rec.referlen,
+                       log_rec.referhash,include_refs,ignored_refs)      |
+             dc_filter(&dc_agent,log_rec.agent,log_rec.agentlen,
+                       log_rec.agenthash,include_agents,ignored_agents)  |
+             dc_filter(&dc_user,log_rec.ident,log_rec.identlen,
+                       log_rec.identhash,include_users,ignored_users);
+         if ( !(i&DC_INC) && !ips_find(include_siteset,log_rec.hostname,host_buf) )
          {
-            if (isinlist(ignored_sites,log_rec.hostname,log_rec.hnamelen)!=NULL)
-              { total_ignore++; continue; }
-            if (isinlist(ignored_urls,log_rec.url,log_rec.urllen)!=NULL)
-              { total_ignore++; continue; }
-            if (isinlist(ignored_agents,log_rec.agent,log_rec.agentlen)!=NULL)
-              { total_ignore++; continue; }
-            if (isinlist(ignored_refs,log_rec.refer,log_rec.referlen)!=NULL)
-              { total_ignore++; continue; }
-            if (isinlist(ignored_users,log_rec.ident,log_rec.identlen)!=NULL)
+            if ( (i&DC_IGN) || ips_find(ignored_siteset,log_rec.hostname,host_buf) )
               { total_ignore++; continue; }
          }
 
@@ -1221,72 +1002,13 @@ int main(int argc, char *argv[])
          /* now save in the various hash tables... */
          if (log_rec.resp_code==RC_OK || log_rec.resp_code==RC_PARTIALCONTENT)
             i=1; else i=0;
-         
-         /* URL/ident hash table (only if valid response code) */
-         if ((log_rec.resp_code==RC_OK)||(log_rec.resp_code==RC_NOMOD)||
-             (log_rec.resp_code==RC_PARTIALCONTENT))
-         {
-            /* URL hash table */
-            if (put_unode(log_rec.url,log_rec.urllen,OBJ_REG,(u_int64_t)1,
-                log_rec.xfer_size,&t_url,(u_int64_t)0,(u_int64_t)0,um_htab))
-            {
-               if (verbose)
-               /* Error adding URL node, skipping ... */
-               fprintf(stderr,"%s %s\n", msg_nomem_u, log_rec.url);
-            }
+         page=ispage(log_rec.url,log_rec.urllen);
 
-            /* ident (username) hash table */
-            if (put_inode(log_rec.ident,log_rec.identlen,OBJ_REG,
-                1,(u_int64_t)i,log_rec.xfer_size,&t_user,
-                0,rec_tstamp,im_htab))
-            {
-               if (verbose)
-               /* Error adding ident node, skipping .... */
-               fprintf(stderr,"%s %s\n", msg_nomem_i, log_rec.ident);
-            }
-         }
-
-         /* referrer hash table */
-         if (ntop_refs)
-         {
-            if (log_rec.refer[0]!='\0')
-             if (put_rnode(log_rec.refer,log_rec.referlen,OBJ_REG,(u_int64_t)1,&t_ref,rm_htab))
-             {
-              if (verbose)
-              fprintf(stderr,"%s %s\n", msg_nomem_r, log_rec.refer);
-             }
-         }
-
-         /* hostname (site) hash table - daily */
-         if (put_hnode(log_rec.hostname,log_rec.hnamelen,OBJ_REG,
-             1,(u_int64_t)i,log_rec.xfer_size,&dt_site,
-             0,rec_tstamp,"",0,sd_htab))
-         {
-            if (verbose)
-            /* Error adding host node (daily), skipping .... */
-            fprintf(stderr,"%s %s\n",msg_nomem_dh, log_rec.hostname);
-         }
-
-         /* hostname (site) hash table - monthly */
-         if (put_hnode(log_rec.hostname,log_rec.hnamelen,OBJ_REG,
-             1,(u_int64_t)i,log_rec.xfer_size,&t_site,
-             0,rec_tstamp,"",0,sm_htab))
-         {
-            if (verbose)
-            /* Error adding host node (monthly), skipping .... */
-            fprintf(stderr,"%s %s\n", msg_nomem_mh, log_rec.hostname);
-         }
-
-         /* user agent hash table */
-         if (ntop_agents)
-         {
-            if (log_rec.agent[0]!='\0')
-             if (put_anode(log_rec.agent,log_rec.agentlen,OBJ_REG,(u_int64_t)1,&t_agent,am_htab))
-             {
-              if (verbose)
-              fprintf(stderr,"%s %s\n", msg_nomem_a, log_rec.agent);
-             }
-         }
+#ifdef USE_THREADS
+         if (shards) sh_add(i,page,rec_tstamp);  /* let shard threads do it */
+         else
+#endif
+         put_record(i,page,rec_tstamp);        /* update hash tables      */
 
          /* bump monthly/daily/hourly totals        */
          t_hit++; ht_hit++;                         /* daily/hourly hits    */
@@ -1305,233 +1027,785 @@ int main(int argc, char *argv[])
          }
 
          /* Pages (pageview) calculation */
-         if (ispage(log_rec.url,log_rec.urllen))
+         if (page)
          {
             t_page++;
             tm_page[rec_day-1]++;
             th_page[rec_hour]++;
+         }
+      }
+
+      /*********************************************/
+      /* BAD RECORD                                */
+      /*********************************************/
+
+      else
+      {
+         /* If first record, check if stupid Netscape header stuff      */
+         if ( (total_rec==1) && (strncmp(rec_buf,"format=",7)==0) )
+         {
+            /* Skipping Netscape header record */
+            if (verbose>1) printf("%s\n",msg_ign_nscp);
+            /* count it as ignored... */
+            total_ignore++;
+         }
+         else
+         {
+            /* Check if it's a W3C header or IIS Null-Character line */
+            if ((rec_buf[0]=='\0') || (rec_buf[0]=='#'))
+            {
+               total_ignore++;
+            }
+            else
+            {
+               /* really bad record... */
+               total_bad++;
+               if (verbose)
+               {
+                  fprintf(stderr,"%s (%llu)",msg_bad_rec,total_rec);
+                  if (debug_mode) fprintf(stderr,":\n%s\n",tmp_buf);
+                  else fprintf(stderr,"\n");
+               }
+            }
+         }
+      }
+   }
 
-            /* do search string stuff if needed     */
-            if (ntop_search) srch_string(log_rec.srchstr);
+   /*********************************************/
+   /* DONE READING LOG FILE - final processing  */
+   /*********************************************/
+
+#ifdef USE_THREADS
+   if (pipeline) pl_stop();              /* wait for pipeline threads */
+   if (shards) sh_stop();                /* finish queued hash updates*/
+#endif
+
+   /* close log file(s) */
+   for (i=0;i<log_nfiles;i++) { lf_close(log_files[i]); log_files[i]=NULL; }
+
+   if (good_rec)                             /* were any good records?   */
+   {
+      tm_site[cur_day-1]=dt_site;            /* If yes, clean up a bit   */
+      tm_visit[cur_day-1]=tot_visit(&sd_htab);
+      t_visit=tot_visit(&sm_htab);
+      if (ht_hit > mh_hit) mh_hit = ht_hit;
+
+      if (total_rec > (total_ignore+total_bad)) /* did we process any?   */
+      {
+         if (incremental)
+         {
+            if (save_state())                /* incremental stuff        */
+            {
+               /* Error: Unable to save current run data */
+               if (verbose) fprintf(stderr,"%s\n",msg_data_err);
+               unlink(state_fname);
+            }
+         }
+         month_update_exit(rec_tstamp,1);    /* calculate exit pages     */
+         update_history();
+         write_month_html();                 /* write monthly HTML file  */
+         put_history();                      /* write history            */
+      }
+      if (hist[0].month!=0) write_main_index(); /* write main HTML file  */
+
+      /* get processing end time */
+      end_time = time(NULL);
+
+      /* display end of processing statistics */
+      if (time_me || (verbose>1))
+      {
+         printf("%llu %s ",total_rec, msg_records);
+         if (total_ignore)
+         {
+            printf("(%llu %s",total_ignore,msg_ignored);
+            if (total_bad) printf(", %llu %s) ",total_bad,msg_bad);
+               else        printf(") ");
+         }
+         else if (total_bad) printf("(%llu %s) ",total_bad,msg_bad);
+
+         /* totoal processing time in seconds */
+         temp_time = difftime(end_time, start_time);
+         if (temp_time==0) temp_time=1;
+         printf("%s %.0f %s", msg_in, temp_time, msg_seconds);
+
+         /* calculate records per second */
+         if (temp_time)
+           i=( (int)( (float)total_rec/temp_time ) );
+         else i=0;
+
+         if ( (i>0) && (i<=total_rec) ) printf(", %d/sec\n", i);
+            else  printf("\n");
+      }
+
+#ifdef USE_DNS
+      /* Close DNS cache file */
+      if (dns_db) close_cache();
+      /* Close GeoDB database */
+      if (geo_db) geodb_close(geo_db);
+#endif
+
+#ifdef USE_GEOIP
+      /* Close GeoIP database */
+      if (geo_fp) GeoIP_delete(geo_fp);
+#endif
+
+      /* Whew, all done! Exit with completion status (0) */
+      exit(0);
+   }
+   else
+   {
+      /* No valid records found... exit with error (1) */
+      if (verbose) printf("%s\n",msg_no_vrec);
+      if (hist[0].month!=0) write_main_index(); /* write main HTML file     */
+      exit(1);
+   }
+}
+
+/*********************************************/
+/* GET_PARSED - get next record and parse it */
+/*********************************************/
+
+static int get_parsed(char **rec)
+{
+   char *rec_buf;
+   int  len;
+
+#ifdef USE_THREADS
+   if (pipeline) return pl_get(rec);       /* from the parse thread    */
+#endif
+
+   if ( (rec_buf=get_record(&len)) == NULL) return PR_EOF;
+   *rec=rec_buf;
+
+   if (len == (BUFSIZE-1))
+   {
+      if (verbose)
+      {
+         fprintf(stderr,"%s",msg_big_rec);
+         if (debug_mode) fprintf(stderr,":\n%s",rec_buf);
+         else fprintf(stderr,"\n");
+      }
+
+      /* get the rest of the record */
+      while ( (rec_buf=get_record(&len)) != NULL )
+      {
+         if (len < BUFSIZE-1)
+         {
+            if (debug_mode && verbose) fprintf(stderr,"%s\n",rec_buf);
+            break;
+         }
+         if (debug_mode && verbose) fprintf(stderr,"%s",rec_buf);
+      }
+      return PR_BIG;
+   }
+
+   if (debug_mode) strcpy(tmp_buf, rec_buf); /* save in case of error    */
+   if (!parse_record(rec_buf,len,&log_rec)) return PR_BAD;
+   return (fix_date(&log_rec))?PR_OK:PR_DATE;
+}
+
+/*********************************************/
+/* FIX_DATE - get record date/time values    */
+/*********************************************/
+
+int fix_date(struct log_struct *lr)
+{
+   int  i;
+   char *cp1;
+   unsigned char *dt=(unsigned char *)lr->datetime;
+   unsigned int  d[12], bad;
+
+   /* month names used for parsing logfile (shouldn't be lang specific) */
+   static char *log_month[12]={ "jan", "feb", "mar",
+                                "apr", "may", "jun",
+                                "jul", "aug", "sep",
+                                "oct", "nov", "dec"};
+
+   /* digit offsets in "[dd/mon/yyyy:hh:mm:ss" */
+   static const int dpos[12]={ 1,2, 8,9,10,11, 13,14, 16,17, 19,20 };
+
+   /* last day seen ('dd/mon/yyyy' part), only redone when it changes */
+   static char fd_key[11];
+   static int  fd_mon=0, fd_day, fd_year;
+
+   /* convert month name to lowercase */
+   for (i=4;i<7;i++)
+      lr->datetime[i]=tolower(lr->datetime[i]);
+
+   /* lowercase sitename/IPv6 addresses */
+   cp1=lr->hostname;
+   while (*cp1++!='\0') *cp1=tolower(*cp1);
+
+   /* fixed layout? (always is for CLF, and squid/w3c build it so)   */
+   for (i=0,bad=0;i<12;i++) { d[i]=dt[dpos[i]]-'0'; bad|=(d[i]>9); }
+   bad|=(dt[3]!='/')|(dt[7]!='/')|(dt[12]!=':')|(dt[15]!=':')|
+        (dt[18]!=':')|((unsigned int)(dt[21]-'0')<10);
+
+   if (!bad)
+   {
+      if (fd_mon==0 || memcmp(fd_key,&lr->datetime[1],11)!=0)
+      {
+         for (i=0;i<12;i++)
+            if (strncmp(log_month[i],&lr->datetime[4],3)==0) break;
+         fd_mon =(i<12)?i+1:0;
+         fd_day =d[0]*10+d[1];
+         fd_year=d[2]*1000+d[3]*100+d[4]*10+d[5];
+         memcpy(fd_key,&lr->datetime[1],11);
+      }
+      if (fd_mon)
+      {
+         lr->year =fd_year; lr->month=fd_mon; lr->day=fd_day;
+         lr->hour =d[6]*10+d[7];
+         lr->min  =d[8]*10+d[9];
+         lr->sec  =d[10]*10+d[11];
+         if (lr->hour>23) lr->hour=0;  /* Netscape kludge (see below) */
+         return !((lr->min>59)||(lr->sec>60)||(lr->year<1990));
+      }
+   }
+
+   /* get year/month/day/hour/min/sec values    */
+   for (i=0;i<12;i++)
+   {
+      if (strncmp(log_month[i],&lr->datetime[4],3)==0)
+         { lr->month = i+1; break; }
+   }
+
+   lr->year=atoi(&lr->datetime[8]);      /* get year number (int)   */
+   lr->day =atoi(&lr->datetime[1]);      /* get day number          */
+   lr->hour=atoi(&lr->datetime[13]);     /* get hour number         */
+   lr->min =atoi(&lr->datetime[16]);     /* get minute number       */
+   lr->sec =atoi(&lr->datetime[19]);     /* get second number       */
+
+   /* Kludge for Netscape server time (0-24?) error                   */
+   if (lr->hour>23) lr->hour=0;
+
+   /* minimal sanity check on date */
+   if ((i>=12)||(lr->min>59)||(lr->sec>60)||(lr->year<1990)) return 0;
+   return 1;
+}
+
+/*********************************************/
+/* URL_PUT - add char to canonical URL       */
+/*********************************************/
+
+struct url_st { unsigned char *base;       /* start of URL (output)      */
+                unsigned char *op;         /* output pointer             */
+                unsigned int  reg;         /* last 3 chars, finds "://"  */
+                int           k;           /* chars seen looking for it  */
+                int           sch;         /* 0=look, 1=in host, 2=done  */
+                int           stop;        /* hit a non-URL char         */
+                int           norm;        /* normalizing this URL       */
+                int           cls;         /* CC_CGI or CC_URL chars     */
+                u_int64_t     seen; };     /* mask of chars (mod 64)     */
+
+static void url_put(struct url_st *u, unsigned char c)
+{
+   unsigned char *cp;
+
+   if (u->stop) return;
+   if (!(cc_tab[c]&u->cls)) { u->stop=1; return; }
+   u->seen|=1ULL<<(c&63);
+
+   if (u->sch==0)                          /* service (ie: http://) must */
+   {                                       /* start in the first 6 chars */
+      if (++u->k>8) u->sch=2;
+      else if ((u->reg=((u->reg<<8)|c)&0xffffff)==(':'<<16|'/'<<8|'/'))
+      {
+         u->sch=2;
+         if (u->norm)                      /* drop service and host...   */
+            { u->op=u->base; *u->op++='/'; u->sch=1; return; }
+         for (cp=u->base;cp<u->op-2;cp++)  /* ...or just lowercase it    */
+            if ( (*cp>='A') && (*cp<='Z'))
+               { *cp += 'a'-'A'; u->seen|=1ULL<<(*cp&63); }
+      }
+   }
+   else if (u->sch==1)                     /* host part, up to next '/'  */
+   {
+      if (c=='/') { u->op=u->base+1; u->sch=2; }
+      else *u->op++=c;
+      return;
+   }
+
+   *u->op++=c;
+   if (u->norm && c=='/' && u->op-u->base>=3 &&      /* '/./' -> '/'     */
+       u->op[-2]=='.' && u->op[-3]=='/') u->op-=2;
+}
+
+/*********************************************/
+/* FIX_URL - canonicalize request URL        */
+/*********************************************/
+
+/* One forward pass over the raw request field.  Escapes are decoded,
+   the URL is pulled out of the request line, cut at the first char
+   not in the CC_CGI (or CC_URL) class and, if normalizing, the service part
+   and any '/./' segments are removed, all written back over the raw
+   field as it goes.  The result is the same as doing each of those
+   steps over the whole string in turn.  Returns the mask of chars in
+   the URL, so index alias lookups can skip a useless strstr().      */
+
+static u_int64_t fix_url(struct log_struct *lr)
+{
+   unsigned char *rp=(unsigned char *)lr->url;
+   unsigned char c;
+   int    i, dn=0, phase=0, pend=0;   /* phase: 0=method (or whole    */
+   struct url_st u;                   /* field if no space) 1=spaces  */
+                                      /* 2=leading '/'s 3=URL         */
+   memset(&u,0,sizeof(u));
+   u.base=u.op=rp;
+   u.norm=((log_type==LOG_CLF || log_type==LOG_JSON) &&
+           lr->resp_code!=RC_NOTFOUND && normalize);
+   u.cls=(stripcgi)?CC_CGI:CC_URL;
+
+   /* unescape() leaves an empty field alone, so this is what it sees */
+   if (rp[0]=='\0' && rp[1]=='-') goto invalid;
+
+   while ((c=*rp++)!='\0')
+   {
+      if (c=='%' && isxdigit(*rp))         /* unescape as we go          */
+      {
+         c=from_hex(*rp++)*16;
+         if (*rp=='\0') break;             /* lone digit at end dropped  */
+         c+=from_hex(*rp++);
+         if ((c<32)||(c==127)) c='_';      /* make '_' if its bad        */
+      }
+      if ((i=dn++)==1 && c=='-') goto invalid;      /* null '-' case     */
+
+      switch (phase)
+      {
+         case 0:
+            if (c==' ' && i>0)             /* found URL, start again     */
+            {
+               u.op=u.base; u.reg=0; u.k=u.sch=u.stop=0; u.seen=0;
+               phase=1;
+            }
+            else url_put(&u,c);
+            if (u.stop && i>0)             /* nothing kept, just look    */
+               while (*rp!=' ' && *rp!='%' && *rp!='\0') rp++;
+            continue;
+         case 1:
+            if (c==' ') continue;
+            phase=2;
+            /* fall through */
+         case 2:
+            if (c=='/') { pend=1; continue; }
+            if (pend) url_put(&u,'/');
+            phase=3;
+            /* fall through */
+         default:
+            if (c=='"') break;
+            url_put(&u,c);
+            if (u.stop) break;
+            if (u.sch==2)                  /* copy plain chars quickly   */
+               while ((cc_tab[*rp]&u.cls) && *rp!='/')
+                  { u.seen|=1ULL<<(*rp&63); *u.op++=*rp++; }
+            continue;
+      }
+      break;
+   }
+   if (pend && phase==2) url_put(&u,'/');
+
+   *u.op='\0';
+   lr->urllen = u.op - u.base;
+   if (lr->url[0]=='\0')
+     { lr->url[0]='/'; lr->url[1]='\0'; lr->urllen = 1; u.seen|=1ULL<<('/'&63); }
+
+   if (u.norm)
+   {
+      if (lr->url[0]!='/')
+      {
+         if ( lr->resp_code==RC_OK             ||
+              lr->resp_code==RC_PARTIALCONTENT ||
+              lr->resp_code==RC_NOMOD)
+         {
+            if (debug_mode)
+               fprintf(stderr,"Converted URL '%s' to '/'\n",lr->url);
+            lr->url[0]='/';
+            lr->url[1]='\0';
+            lr->urllen = 1;
+            u.seen|=1ULL<<('/'&63);
+         }
+         else
+         {
+            if (debug_mode)
+               fprintf(stderr,"Invalid URL: '%s'\n",lr->url);
+            goto invalid;
          }
+      }
+      while ( lr->url[ (i=lr->urllen-1) ] == '?' ) {
+         lr->url[i]='\0';   /* drop trailing ?s if any */
+         lr->urllen = i;
+      }
+   }
+   return u.seen;
+
+invalid:
+   strcpy(lr->url,"/INVALID-URL");
+   lr->urllen = sizeof("/INVALID-URL")-1;
+   return ~(u_int64_t)0;
+}
+
+/*********************************************/
+/* FIX_RECORD - clean up parsed record       */
+/*********************************************/
+
+void fix_record(struct log_struct *lr, u_int64_t recno)
+{
+   char      *cp1, *cp2, *cp3;
+   u_int64_t seen, mask;
+   NLISTPTR  lptr;
+
+   /* un-escape and clean up URL */
+   seen = fix_url(lr);
+
+   /* strip off index.html (or any aliases) */
+   lptr=index_alias;
+   while (lptr!=NULL)
+   {
+      for (cp1=lptr->string,mask=0;*cp1;cp1++) mask|=1ULL<<(*cp1&63);
+      if ((mask&~seen)==0 && (cp1=strstr(lr->url,lptr->string))!=NULL)
+      {
+         if (*(cp1-1)=='/')
+         {
+            if ( !stripcgi && (cp2=strchr(cp1,'?'))!=NULL )
+            { while(*cp2) *cp1++=*cp2++; *cp1='\0'; }
+            else *cp1='\0';
+            lr->urllen = cp1 - lr->url;
+            break;
+         }
+      }
+      lptr=lptr->next;
+   }
+
+   /* unescape referrer */
+   lr->referlen = unescape(lr->refer);
+
+   /* fix referrer field (strip quotes, cut at any control chars or '<') */
+   cp3 = lr->refer + lr->referlen;
+   if (lr->refer[0] == '"')
+   {
+      cp1 = lr->refer + 1;
+      cp2 = cc_find(cp1, cp3, CC_RBAD);
+      if (cp2 == cp3 && cp2 > cp1) cp2--;     /* closing quote */
+      lr->referlen = cp2 - cp1;
+      memmove(lr->refer, cp1, lr->referlen);
+      lr->refer[lr->referlen] = '\0';
+      cp3 = lr->refer + lr->referlen;
+   }
+
+   /* get query portion of cgi referrals */
+   if (lr->refer[0] != '\0')
+   {
+      if ((cp1=cc_span(lr->refer, cp3, CC_CGI)) != cp3)
+      {
+         /* Save query portion in log.rec.srchstr */
+         lr->srchlen = (cp3-cp1 < MAXSRCH-1)? cp3-cp1 : MAXSRCH-1;
+         memcpy(lr->srchstr, cp1, lr->srchlen);
+         lr->srchstr[lr->srchlen] = '\0';
+         *cp1 = '\0';
+         lr->referlen = cp1 - lr->refer;
+      }
+      /* handle null referrer */
+      if (lr->refer[0]=='\0')
+        { lr->refer[0]='-'; lr->refer[1]='\0';
+          lr->referlen = 1;}
+   }
+
+   /* if HTTP request, lowercase http://sitename/ portion */
+   cp1 = lr->refer;
+   if ( (*cp1=='h') || (*cp1=='H'))
+   {
+      while ( (*cp1!='/') && (*cp1!='\0'))
+      {
+         if ( (*cp1>='A') && (*cp1<='Z')) *cp1 += 'a'-'A';
+         cp1++;
+      }
+      /* now do hostname */
+      if ( (*cp1=='/') && ( *(cp1+1)=='/')) {cp1++; cp1++;}
+      while ( (*cp1!='/') && (*cp1!='\0'))
+      {
+         if ( (*cp1>='A') && (*cp1<='Z')) *cp1 += 'a'-'A';
+         cp1++;
+      }
+   }
+
+   /* Do we need to mangle? */
+   if (mangle_agent) lr->agentlen = dc_mangle(lr->agent, lr->agentlen);
+
+   /* if necessary, shrink referrer to fit storage */
+   if (lr->referlen>=MAXREFH)
+   {
+      if (verbose) fprintf(stderr,"%s [%llu]\n",
+          msg_big_ref,recno);
+      lr->refer[MAXREFH-1]='\0';
+      lr->referlen = MAXREFH-1;
+   }
+
+   /* if necessary, shrink URL to fit storage */
+   if (lr->urllen>=MAXURLH)
+   {
+      if (verbose) fprintf(stderr,"%s [%llu]\n",
+          msg_big_req,recno);
+      lr->url[MAXURLH-1]='\0';
+      lr->urllen = MAXURLH-1;
+   }
+
+   /* fix user agent field */
+   cp1 = lr->agent;
+   cp3 = cp2 = cp1++;
+   if ( (*cp2 != '\0') && ((*cp2 == '"')||(*cp2 == '(')) )
+   {
+      while (*cp1 != '\0') { cp3 = cp2; *cp2++ = *cp1++; }
+      *cp3 = '\0';
+      lr->agentlen = cp3 - lr->agent;
+   }
+   /* get rid of more common _bad_ chars ;)   */
+   cp1 = cc_find(lr->agent, lr->agent+lr->agentlen, CC_ABAD);
+   *cp1 = '\0'; lr->agentlen = cp1 - lr->agent;
+
+   /* fix username if needed */
+   if (lr->ident[0]==0)
+    {  lr->ident[0]='-'; lr->ident[1]='\0'; lr->identlen = 1; }
+   else
+   {
+      cp3=cc_find(lr->ident, lr->ident+lr->identlen, CC_IBAD);
+      *cp3='\0';
+      lr->identlen = cp3 - lr->ident;
+   }
+   /* unescape user name */
+   lr->identlen = unescape(lr->ident);
+}
+
+/*********************************************/
+/* PUT_RECORD - add record to hash tables    */
+/*********************************************/
+
+void put_record(int file, int page, u_int64_t tstamp)
+{
+   char *cp1;
+   int  len;
+   char buf[BUFSIZE];                    /* search string buffer    */
 
-         /*********************************************/
-         /* RECORD PROCESSED - DO GROUPS HERE         */ 
-         /*********************************************/
+   log_page = page;                      /* for the hash table code */
 
-         /* URL Grouping */
-		 len = log_rec.urllen;
-         if ( (cp1=isinglist(group_urls,log_rec.url,&len))!=NULL)
-         {
-            if (put_unode(cp1,len,OBJ_GRP,(u_int64_t)1,log_rec.xfer_size,
-                &ul_bogus,(u_int64_t)0,(u_int64_t)0,um_htab))
-            {
-               if (verbose)
-               /* Error adding URL node, skipping ... */
-               fprintf(stderr,"%s %s\n", msg_nomem_u, cp1);
-            }
-         }
+   /* URL/ident hash table (only if valid response code) */
+   if ((log_rec.resp_code==RC_OK)||(log_rec.resp_code==RC_NOMOD)||
+       (log_rec.resp_code==RC_PARTIALCONTENT))
+   {
+      /* URL hash table */
+      if (put_unode(log_rec.url,log_rec.urllen,log_rec.urlhash,OBJ_REG,
+          (u_int64_t)1,log_rec.xfer_size,&t_url,(u_int64_t)0,(u_int64_t)0,
+          &um_htab))
+      {
+         if (verbose)
+         /* Error adding URL node, skipping ... */
+         fprintf(stderr,"%s %s\n", msg_nomem_u, log_rec.url);
+      }
 
-         /* Site Grouping */
-		 len = log_rec.hnamelen;
-         if ( (cp1=isinglist(group_sites,log_rec.hostname,&len))!=NULL)
-         {
-            if (put_hnode(cp1,len,OBJ_GRP,1,
-                          (u_int64_t)(log_rec.resp_code==RC_OK)?1:0,
-                          log_rec.xfer_size,&ul_bogus,
-                          0,rec_tstamp,"",0,sm_htab))
-            {
-               if (verbose)
-               /* Error adding Site node, skipping ... */
-               fprintf(stderr,"%s %s\n", msg_nomem_mh, cp1);
-            }
-         }
-         else
-         {
-            /* Domain Grouping */
-            if (group_domains)
-            {
-			   len = log_rec.hnamelen;
-               cp1 = get_domain(log_rec.hostname,&len);
-               if (cp1 != NULL)
-               {
-                  if (put_hnode(cp1,len,OBJ_GRP,1,
-                      (u_int64_t)(log_rec.resp_code==RC_OK)?1:0,
-                      log_rec.xfer_size,&ul_bogus,
-                      0,rec_tstamp,"",0,sm_htab))
-                  {
-                     if (verbose)
-                     /* Error adding Site node, skipping ... */
-                     fprintf(stderr,"%s %s\n", msg_nomem_mh, cp1);
-                  }
-               }
-            }
-         }
+      /* ident (username) hash table */
+      if (put_inode(log_rec.ident,log_rec.identlen,log_rec.identhash,OBJ_REG,
+          1,(u_int64_t)file,log_rec.xfer_size,&t_user,
+          0,tstamp,&im_htab))
+      {
+         if (verbose)
+         /* Error adding ident node, skipping .... */
+         fprintf(stderr,"%s %s\n", msg_nomem_i, log_rec.ident);
+      }
+   }
 
-         /* Referrer Grouping */
-		 len = log_rec.referlen;
-         if ( (cp1=isinglist(group_refs,log_rec.refer,&len))!=NULL)
-         {
-            if (put_rnode(cp1,len,OBJ_GRP,(u_int64_t)1,&ul_bogus,rm_htab))
-            {
-               if (verbose)
-               /* Error adding Referrer node, skipping ... */
-               fprintf(stderr,"%s %s\n", msg_nomem_r, cp1);
-            }
-         }
+   /* referrer hash table */
+   if (ntop_refs)
+   {
+      if (log_rec.refer[0]!='\0')
+       if (put_rnode(log_rec.refer,log_rec.referlen,log_rec.referhash,OBJ_REG,
+                     (u_int64_t)1,&t_ref,&rm_htab))
+       {
+        if (verbose)
+        fprintf(stderr,"%s %s\n", msg_nomem_r, log_rec.refer);
+       }
+   }
 
-         /* User Agent Grouping */
-		 len = log_rec.agentlen;
-         if ( (cp1=isinglist(group_agents,log_rec.agent,&len))!=NULL)
-         {
-            if (put_anode(cp1,len,OBJ_GRP,(u_int64_t)1,&ul_bogus,am_htab))
-            {
-               if (verbose)
-               /* Error adding User Agent node, skipping ... */
-               fprintf(stderr,"%s %s\n", msg_nomem_a, cp1);
-            }
-         }
+   /* hostname (site) hash table - monthly, before daily */
+   if (put_hnode(log_rec.hostname,log_rec.hnamelen,log_rec.hnamehash,OBJ_REG,
+       1,(u_int64_t)file,log_rec.xfer_size,&t_site,
+       0,tstamp,"",0,&sm_htab))
+   {
+      if (verbose)
+      /* Error adding host node (monthly), skipping .... */
+      fprintf(stderr,"%s %s\n", msg_nomem_mh, log_rec.hostname);
+   }
 
-         /* Ident (username) Grouping */
-		 len = log_rec.identlen;
-         if ( (cp1=isinglist(group_users,log_rec.ident,&len))!=NULL)
-         {
-            if (put_inode(cp1,len,OBJ_GRP,1,
-                          (u_int64_t)(log_rec.resp_code==RC_OK)?1:0,
-                          log_rec.xfer_size,&ul_bogus,
-                          0,rec_tstamp,im_htab))
-            {
-               if (verbose)
-               /* Error adding Username node, skipping ... */
-               fprintf(stderr,"%s %s\n", msg_nomem_i, cp1);
-            }
-         }
-      }
+   /* hostname (site) hash table - daily */
+   if (put_hnode(log_rec.hostname,log_rec.hnamelen,log_rec.hnamehash,OBJ_REG,
+       1,(u_int64_t)file,log_rec.xfer_size,&dt_site,
+       0,tstamp,"",0,&sd_htab))
+   {
+      if (verbose)
+      /* Error adding host node (daily), skipping .... */
+      fprintf(stderr,"%s %s\n",msg_nomem_dh, log_rec.hostname);
+   }
 
-      /*********************************************/
-      /* BAD RECORD                                */
-      /*********************************************/
+   /* user agent hash table */
+   if (ntop_agents)
+   {
+      if (log_rec.agent[0]!='\0')
+       if (put_anode(log_rec.agent,log_rec.agentlen,log_rec.agenthash,OBJ_REG,
+                     (u_int64_t)1,&t_agent,&am_htab))
+       {
+        if (verbose)
+        fprintf(stderr,"%s %s\n", msg_nomem_a, log_rec.agent);
+       }
+   }
 
-      else
+   /* do search string stuff if needed     */
+   if (page && ntop_search)
+   {
+      if ( (cp1=srch_string(log_rec.srchstr,buf,&len))!=NULL )
       {
-         /* If first record, check if stupid Netscape header stuff      */
-         if ( (total_rec==1) && (strncmp(buffer,"format=",7)==0) )
-         {
-            /* Skipping Netscape header record */
-            if (verbose>1) printf("%s\n",msg_ign_nscp);
-            /* count it as ignored... */
-            total_ignore++;
-         }
-         else
+         if (put_snode(cp1,len,hash(cp1,len),(u_int64_t)1,&sr_htab))
          {
-            /* Check if it's a W3C header or IIS Null-Character line */
-            if ((buffer[0]=='\0') || (buffer[0]=='#'))
-            {
-               total_ignore++;
-            }
-            else
-            {
-               /* really bad record... */
-               total_bad++;
-               if (verbose)
-               {
-                  fprintf(stderr,"%s (%llu)",msg_bad_rec,total_rec);
-                  if (debug_mode) fprintf(stderr,":\n%s\n",tmp_buf);
-                  else fprintf(stderr,"\n");
-               }
-            }
+            if (verbose)
+            /* Error adding search string node, skipping .... */
+            fprintf(stderr,"%s %s\n", msg_nomem_sc, buf);
          }
       }
    }
 
    /*********************************************/
-   /* DONE READING LOG FILE - final processing  */
+   /* RECORD PROCESSED - DO GROUPS HERE         */
    /*********************************************/
 
-   /* close log file if needed */
-#ifdef USE_BZIP
-   if (gz_log) (gz_log==COMP_BZIP)?BZ2_bzclose(zlog_fp):gzclose(zlog_fp);
-#else
-   if (gz_log) gzclose(zlog_fp);
-#endif
-   else if (log_fname) fclose(log_fp);
-
-   if (good_rec)                             /* were any good records?   */
+   /* URL Grouping */
+   len = log_rec.urllen;
+   if ( (cp1=dc_group(&dc_url,DC_GROUP,group_urls,
+                       log_rec.url,&len,log_rec.urlhash))!=NULL)
    {
-      tm_site[cur_day-1]=dt_site;            /* If yes, clean up a bit   */
-      tm_visit[cur_day-1]=tot_visit(sd_htab);
-      t_visit=tot_visit(sm_htab);
-      if (ht_hit > mh_hit) mh_hit = ht_hit;
+      if (put_unode(cp1,len,hash(cp1,len),OBJ_GRP,(u_int64_t)1,
+          log_rec.xfer_size,&ul_bogus,(u_int64_t)0,(u_int64_t)0,&um_htab))
+      {
+         if (verbose)
+         /* Error adding URL node, skipping ... */
+         fprintf(stderr,"%s %s\n", msg_nomem_u, cp1);
+      }
+   }
 
-      if (total_rec > (total_ignore+total_bad)) /* did we process any?   */
+   /* Site Grouping */
+   len = log_rec.hnamelen;
+   if ( (cp1=dc_group(&dc_host,DC_GROUP,group_sites,
+                       log_rec.hostname,&len,log_rec.hnamehash))!=NULL)
+   {
+      if (put_hnode(cp1,len,hash(cp1,len),OBJ_GRP,1,
+                    (u_int64_t)(log_rec.resp_code==RC_OK)?1:0,
+                    log_rec.xfer_size,&ul_bogus,
+                    0,tstamp,"",0,&sm_htab))
       {
-         if (incremental)
+         if (verbose)
+         /* Error adding Site node, skipping ... */
+         fprintf(stderr,"%s %s\n", msg_nomem_mh, cp1);
+      }
+   }
+   else
+   {
+      /* Domain Grouping */
+      if (group_domains)
+      {
+         len = log_rec.hnamelen;
+         cp1 = get_domain(log_rec.hostname,&len);
+         if (cp1 != NULL)
          {
-            if (save_state())                /* incremental stuff        */
+            if (put_hnode(cp1,len,hash(cp1,len),OBJ_GRP,1,
+                (u_int64_t)(log_rec.resp_code==RC_OK)?1:0,
+                log_rec.xfer_size,&ul_bogus,
+                0,tstamp,"",0,&sm_htab))
             {
-               /* Error: Unable to save current run data */
-               if (verbose) fprintf(stderr,"%s\n",msg_data_err);
-               unlink(state_fname);
+               if (verbose)
+               /* Error adding Site node, skipping ... */
+               fprintf(stderr,"%s %s\n", msg_nomem_mh, cp1);
             }
          }
-         month_update_exit(rec_tstamp);      /* calculate exit pages     */
-         update_history();
-         write_month_html();                 /* write monthly HTML file  */
-         put_history();                      /* write history            */
       }
-      if (hist[0].month!=0) write_main_index(); /* write main HTML file  */
+   }
 
-      /* get processing end time */
-      end_time = time(NULL);
+   /* Referrer Grouping */
+   len = log_rec.referlen;
+   if ( (cp1=dc_group(&dc_ref,DC_GROUP,group_refs,
+                       log_rec.refer,&len,log_rec.referhash))!=NULL)
+   {
+      if (put_rnode(cp1,len,hash(cp1,len),OBJ_GRP,(u_int64_t)1,&ul_bogus,
+                    &rm_htab))
+      {
+         if (verbose)
+         /* Error adding Referrer node, skipping ... */
+         fprintf(stderr,"%s %s\n", msg_nomem_r, cp1);
+      }
+   }
 
-      /* display end of processing statistics */
-      if (time_me || (verbose>1))
+   /* User Agent Grouping */
+   len = log_rec.agentlen;
+   if ( (cp1=dc_group(&dc_agent,DC_GROUP,group_agents,
+                       log_rec.agent,&len,log_rec.agenthash))!=NULL)
+   {
+      if (put_anode(cp1,len,hash(cp1,len),OBJ_GRP,(u_int64_t)1,&ul_bogus,
+                    &am_htab))
       {
-         printf("%llu %s ",total_rec, msg_records);
-         if (total_ignore)
-         {
-            printf("(%llu %s",total_ignore,msg_ignored);
-            if (total_bad) printf(", %llu %s) ",total_bad,msg_bad);
-               else        printf(") ");
-         }
-         else if (total_bad) printf("(%llu %s) ",total_bad,msg_bad);
+         if (verbose)
+         /* Error adding User Agent node, skipping ... */
+         fprintf(stderr,"%s %s\n", msg_nomem_a, cp1);
+      }
+   }
 
-         /* totoal processing time in seconds */
-         temp_time = difftime(end_time, start_time);
-         if (temp_time==0) temp_time=1;
-         printf("%s %.0f %s", msg_in, temp_time, msg_seconds);
+   /* Ident (username) Grouping */
+   len = log_rec.identlen;
+   if ( (cp1=dc_group(&dc_user,DC_GROUP,group_users,
+                       log_rec.ident,&len,log_rec.identhash))!=NULL)
+   {
+      if (put_inode(cp1,len,hash(cp1,len),OBJ_GRP,1,
+                    (u_int64_t)(log_rec.resp_code==RC_OK)?1:0,
+                    log_rec.xfer_size,&ul_bogus,
+                    0,tstamp,&im_htab))
+      {
+         if (verbose)
+         /* Error adding Username node, skipping ... */
+         fprintf(stderr,"%s %s\n", msg_nomem_i, cp1);
+      }
+   }
+}
 
-         /* calculate records per second */
-         if (temp_time)
-           i=( (int)( (float)total_rec/temp_time ) );
-         else i=0;
+/*********************************************/
+/* FOLLOW_UPDATE - refresh reports (follow)  */
+/*********************************************/
 
-         if ( (i>0) && (i<=total_rec) ) printf(", %d/sec\n", i);
-            else  printf("\n");
-      }
+void follow_update()
+{
+   time_t now;
 
-#ifdef USE_DNS
-      /* Close DNS cache file */
-      if (dns_db) close_cache();
-      /* Close GeoDB database */
-      if (geo_db) geodb_close(geo_db);
-#endif
+   if (!good_rec || total_rec<=(total_ignore+total_bad)) return;
 
-#ifdef USE_GEOIP
-      /* Close GeoIP database */
-      if (geo_fp) GeoIP_delete(geo_fp);
-#endif
+   /* same clean up as the end of a normal run */
+   tm_site[cur_day-1]=dt_site;
+   tm_visit[cur_day-1]=tot_visit(&sd_htab);
+   t_visit=tot_visit(&sm_htab);
+   if (ht_hit > mh_hit) mh_hit = ht_hit;
 
-      /* Whew, all done! Exit with completion status (0) */
-      exit(0);
-   }
-   else
+   /* only checkpoint state every so often */
+   now=time(NULL);
+   if (incremental && (now-ckpt_time>=follow_ckpt))
    {
-      /* No valid records found... exit with error (1) */
-      if (verbose) printf("%s\n",msg_no_vrec);
-      if (hist[0].month!=0) write_main_index(); /* write main HTML file     */
-      exit(1);
+      if (save_state())
+      {
+         /* Error: Unable to save current run data */
+         if (verbose) fprintf(stderr,"%s\n",msg_data_err);
+         unlink(state_fname);
+      }
+      ckpt_time=now;
    }
+
+   /* exit pages are only for the reports, back them out after */
+   month_update_exit(rec_tstamp,1);
+   update_history();
+   write_month_html();
+   put_history();
+   month_update_exit(rec_tstamp,-1);
+   if (hist[0].month!=0) write_main_index();
 }
 
 /*********************************************/
@@ -1660,14 +1934,25 @@ void get_config(char *fname)
                      "YearTotals",        /* show year subtotals (0=no) 117 */
                      "CountryFlags",      /* show country flags? (0-no) 118 */
                      "FlagDir",           /* directory w/flag images    119 */
-                     "SearchCaseI"        /* srch str case insensitive  120 */
+                     "SearchCaseI",       /* srch str case insensitive  120 */
+                     "DecompThreads",     /* # decompression threads    121 */
+                     "Follow",            /* follow log file (0=no)     122 */
+                     "FollowInterval",    /* report update (seconds)    123 */
+                     "FollowRecords",     /* report update (records)    124 */
+                     "FollowCheckpoint",  /* state checkpoint (seconds) 125 */
+                     "Pipeline",          /* threaded read/parse (0=no) 126 */
+                     "ShardThreads",      /* hash update threads (0=no) 127 */
+                     "LogFormat",         /* custom log layout (CLF)    128 */
+                     "JSONKey",           /* JSON key for a field       129 */
+                     "IgnoreSiteFile",    /* file of sites to ignore    130 */
+                     "IncludeSiteFile"    /* file of sites to include   131 */
                    };
 
    FILE *fp;
 
    char buffer[BUFSIZE];
    char keyword[MAXKWORD];
-   char value[MAXKVAL];
+   char value[MAXLFMT];                   /* (MAXKVAL for all but LogFormat) */
    char *cp1, *cp2;
    int  i,key,count;
    int	num_kwords=sizeof(kwords)/sizeof(char *);
@@ -1691,7 +1976,7 @@ void get_config(char *fname)
       *cp2='\0';
 
       /* Get value */
-      cp2=value; count=MAXKVAL-1;
+      cp2=value; count=MAXLFMT-1;
       while ((*cp1!='\n')&&(*cp1!='\0')&&(isspace((unsigned char)*cp1))) cp1++;
       while ((*cp1!='\n')&&(*cp1!='\0')&&count ) { *cp2++ = *cp1++; count--; }
       *cp2--='\0';
@@ -1709,6 +1994,13 @@ void get_config(char *fname)
                     continue;
                   }
 
+      /* only a LogFormat value may be longer than MAXKVAL-1 */
+      if (key!=128 && strlen(value)>=MAXKVAL)
+      {
+         cp2=&value[MAXKVAL-1]; *cp2--='\0';
+         while ((isspace((unsigned char)*cp2)) && (cp2 != value) ) *cp2--='\0';
+      }
+
       switch (key)
       {
         case 1:  out_dir=save_opt(value);          break; /* OutputDir      */
@@ -1788,7 +2080,8 @@ void get_config(char *fname)
         case 60: log_type=(tolower(value[0])=='f')?
                  LOG_FTP:((tolower(value[0])=='s')?
                  LOG_SQUID:((tolower(value[0])=='w')?
-                 LOG_W3C:LOG_CLF));                break; /* LogType        */
+                 LOG_W3C:((tolower(value[0])=='j')?
+                 LOG_JSON:LOG_CLF)));               break; /* LogType        */
         case 61: add_glist(value,&search_list);    break; /* SearchEngine   */
         case 62: group_domains=atoi(value);        break; /* GroupDomains   */
         case 63: hide_sites=
@@ -1895,6 +2188,36 @@ void get_config(char *fname)
         case 119: use_flags=1; flag_dir=save_opt(value); break; /* FlagDir  */
         case 120: searchcasei=
                     (tolower(value[0])=='n')?0:1;  break; /* SearchCaseI    */
+#ifdef USE_THREADS
+        case 121: dz_threads=atoi(value);          break; /* DecompThreads  */
+#else
+        case 121: printf("%s '%s' (%s)\n",msg_bad_key,keyword,fname); break;
+#endif  /* USE_THREADS */
+        case 122: follow=(tolower(value[0])=='y')?1:0; break; /* Follow     */
+        case 123: follow_int=atoi(value);          break; /* FollowInterval */
+        case 124: follow_recs=atoi(value);         break; /* FollowRecords  */
+        case 125: follow_ckpt=atoi(value);         break; /* FollowCheckpoint*/
+#ifdef USE_THREADS
+        case 126: pipeline=
+                    (tolower(value[0])=='y')?1:0;  break; /* Pipeline       */
+#else
+        case 126: printf("%s '%s' (%s)\n",msg_bad_key,keyword,fname); break;
+#endif  /* USE_THREADS */
+#ifdef USE_THREADS
+        case 127: shards=atoi(value);              break; /* ShardThreads   */
+#else
+        case 127: printf("%s '%s' (%s)\n",msg_bad_key,keyword,fname); break;
+#endif  /* USE_THREADS */
+        case 128: log_format=save_opt(value);       break; /* LogFormat      */
+        case 129: if (!json_key(value))                    /* JSONKey        */
+                     fprintf(stderr,"Warning: Invalid JSONKey '%s' (%s)\n",
+                             value,fname);         break;
+        case 130: if (ips_load(value,&ignored_siteset)<0)  /* IgnoreSiteFile */
+                     fprintf(stderr,"Warning: Can't read IgnoreSiteFile '%s' (%s)\n",
+                             value,fname);         break;
+        case 131: if (ips_load(value,&include_siteset)<0)  /* IncludeSiteFile*/
+                     fprintf(stderr,"Warning: Can't read IncludeSiteFile '%s' (%s)\n",
+                             value,fname);         break;
       }
    }
    fclose(fp);
@@ -1993,6 +2316,15 @@ void print_version()
 #ifdef USE_GEOIP
    strncpy(&buf[strlen(buf)],"GeoIP ",7);
 #endif
+#ifdef USE_XZ
+   strncpy(&buf[strlen(buf)],"XZ ",4);
+#endif
+#ifdef USE_ZSTD
+   strncpy(&buf[strlen(buf)],"Zstd ",6);
+#endif
+#ifdef USE_THREADS
+   strncpy(&buf[strlen(buf)],"Threads ",9);
+#endif
 
    if (debug_mode)
    {
@@ -2039,13 +2371,12 @@ char *cur_time()
 int ispage(char *str,int len)
 {
    NLISTPTR t;
-   char *cp1, *cp2;
+   char *cp2;
 
    if (isinlist(omit_page,str,len)!=NULL) return 0;
 
-   cp1=cp2=str;
-   while (*cp1!='\0') { if (*cp1=='.') cp2=cp1; cp1++; }
-   if ((cp2++==str)||(*(--cp1)=='/')) return 1;
+   for (cp2=str+len-1;cp2>str && *cp2!='.';cp2--);  /* last '.' */
+   if ((cp2++<=str)||(str[len-1]=='/')) return 1;
    t=page_prefix;
    while(t!=NULL)
    {
@@ -2054,21 +2385,117 @@ int ispage(char *str,int len)
       t=t->next;
    }
    len -= cp2-str;
-   return (isinlist(page_type,cp2,len)!=NULL);
+   return ptype_match(cp2,len);
 }
 
 /*********************************************/
-/* ISURLCHAR - checks for valid URL chars    */
+/* COMP_PTYPE - PageType perfect hash setup  */
 /*********************************************/
 
-int isurlchar(unsigned char ch, int flag)
+/* The page types are few and fixed once the config is read, so look
+   for a hash seed that gives each one its own slot.  Plain types
+   ('cgi') match anywhere in the extension and 'htm*' types match its
+   start, the same as isinstr().  If any type uses a leading wildcard
+   the list is scanned as before.                                     */
+
+#define PT_MAXSLOT 256                 /* max perfect hash size            */
+#define PT_MAXEXT  31                  /* longer extensions use the list   */
+#define PT_SUB     0                   /* plain type, substring            */
+#define PT_PRE     1                   /* 'abc*' type, prefix              */
+
+struct pt_slot { char *str;            /* page type (NULL=empty)           */
+                 int  len;             /* length (up to any '*')           */
+                 int  kind; };         /* PT_SUB or PT_PRE                 */
+
+static struct pt_slot *pt_tab=NULL;    /* perfect hash (NULL=use list)     */
+static unsigned int   pt_mask=0;       /* slots-1                          */
+static unsigned int   pt_seed=0;       /* seed with no collisions          */
+static unsigned int   pt_lens[2];      /* type lengths used, bit per len   */
+
+static unsigned int pt_hash(char *str, int len, int kind, unsigned int seed)
 {
-   if (isalnum(ch)) return 1;                /* allow letters, numbers...    */
-   if (ch > 127)    return 1;                /* allow extended chars...      */
-   if (flag)                                 /* and filter some others       */
-      return (strchr(":/\\.,' *!-+_@~()[]!",ch)!=NULL);    /* strip cgi vars */
-   else
-      return (strchr(":/\\.,' *!-+_@~()[]!;?&=",ch)!=NULL); /* keep cgi vars */
+   unsigned int h=seed^(kind?0x9e3779b9:0);
+
+   while (len--) h=(h^(unsigned char)*str++)*16777619;
+   return (h^(h>>15))&pt_mask;
+}
+
+static void comp_ptype()
+{
+   NLISTPTR       lptr;
+   struct pt_slot *tab, *sp;
+   unsigned int   size, seed;
+   int            n=0, len, kind;
+
+   for (lptr=page_type;lptr!=NULL;lptr=lptr->next)
+   {
+      if (lptr->string[0]=='*') return;          /* suffix, use the list */
+      n++;
+   }
+   if (n==0) return;
+
+   for (size=8;size<(unsigned int)n*2;size*=2);
+   for (;size<=PT_MAXSLOT;size*=2)
+   {
+      if ((tab=calloc(size,sizeof(struct pt_slot)))==NULL) return;
+      pt_mask=size-1;
+      for (seed=1;seed<=64;seed++)
+      {
+         pt_lens[PT_SUB]=pt_lens[PT_PRE]=0;
+         for (lptr=page_type;lptr!=NULL;lptr=lptr->next)
+         {
+            len=lptr->len; kind=PT_SUB;
+            if (lptr->string[len-1]=='*')        /* prefix to first '*'  */
+               { kind=PT_PRE; len=strchr(lptr->string,'*')-lptr->string; }
+            if (len>PT_MAXEXT) continue;         /* can't match short ext*/
+            sp=&tab[pt_hash(lptr->string,len,kind,seed)];
+            if (sp->str!=NULL)
+            {
+               if (sp->len==len && sp->kind==kind &&
+                   !memcmp(sp->str,lptr->string,len)) continue; /* dup   */
+               break;                            /* collision, next seed */
+            }
+            sp->str=lptr->string; sp->len=len; sp->kind=kind;
+            pt_lens[kind]|=1U<<len;
+         }
+         if (lptr==NULL) { pt_tab=tab; pt_seed=seed; return; }
+         memset(tab,0,size*sizeof(struct pt_slot));
+      }
+      free(tab);                                 /* no luck, next size   */
+   }
+}
+
+/*********************************************/
+/* PTYPE_MATCH - is extension a PageType?    */
+/*********************************************/
+
+static int ptype_match(char *ext, int len)
+{
+   struct pt_slot *sp;
+   int            l, i;
+
+   if (pt_tab==NULL || len>PT_MAXEXT)
+      return (isinlist(page_type,ext,len)!=NULL);
+
+   for (l=1;l<=len;l++)
+   {
+      if (pt_lens[PT_PRE]&(1U<<l))
+      {
+         sp=&pt_tab[pt_hash(ext,l,PT_PRE,pt_seed)];
+         if (sp->len==l && sp->kind==PT_PRE && sp->str &&
+             !memcmp(sp->str,ext,l)) return 1;
+      }
+      if (pt_lens[PT_SUB]&(1U<<l))
+      {
+         for (i=0;i+l<=len;i++)
+         {
+            sp=&pt_tab[pt_hash(ext+i,l,PT_SUB,pt_seed)];
+            if (sp->len==l && sp->kind==PT_SUB && sp->str &&
+                !memcmp(sp->str,ext+i,l)) return 1;
+         }
+      }
+   }
+   return 0;
 }
 
 /*********************************************/
@@ -2164,18 +2591,19 @@ int ouricmp(char *str1, char *str2)
 /* SRCH_STRING - get search strings from ref */
 /*********************************************/
 
-void srch_string(char *ptr)
+char *srch_string(char *ptr, char *tmpbuf, int *slen)
 {
-   /* ptr should point to unescaped query string */
-   char tmpbuf[BUFSIZE];
+   /* ptr should point to unescaped query string, tmpbuf is BUFSIZE */
    char srch[80]="";
    unsigned char *cp1, *cp2, *cps;
    int  sp_flg=0, len;
 
    /* Check if search engine referrer or return  */
    len = log_rec.referlen;
-   if ( (cps=(unsigned char *)isinglist(search_list,log_rec.refer,&len))==NULL)
-      return; 
+   if ( (cps=(unsigned char *)dc_group(&dc_ref,DC_SEARCH,search_list,
+                                       log_rec.refer,&len,
+                                       log_rec.referhash))==NULL)
+      return NULL;
 
    /* Try to find query variable */
    srch[0]='?'; srch[sizeof(srch)-1] = '\0';
@@ -2183,7 +2611,7 @@ void srch_string(char *ptr)
    if ((cp1=(unsigned char *)strstr(ptr,srch))==NULL)
    {
       srch[0]='&';                                 /* Next, try "&..."       */
-      if ((cp1=(unsigned char *)strstr(ptr,srch))==NULL) return;
+      if ((cp1=(unsigned char *)strstr(ptr,srch))==NULL) return NULL;
    }
    cp2=(unsigned char *)tmpbuf;
    while (*cp1!='=' && *cp1!=0) cp1++; if (*cp1!=0) cp1++;
@@ -2204,7 +2632,7 @@ void srch_string(char *ptr)
    *cp2=0; cp2=(unsigned char *)tmpbuf;
    if (tmpbuf[0]=='?') tmpbuf[0]=' ';                  /* format fix ?       */
    while( *cp2!=0 && isspace((unsigned char)*cp2) ) cp2++;     /* skip sps.  */
-   if (*cp2==0) return;
+   if (*cp2==0) return NULL;
 
    /* any trailing spaces? */
    cp1=cp2+strlen((char *)cp2)-1;
@@ -2213,15 +2641,8 @@ void srch_string(char *ptr)
    /* strip invalid chars */
    cp1=cp2;
    while (*cp1!=0) { if ((*cp1<32)||(*cp1==127)) *cp1='_'; cp1++; }
-   len = cp1 - cp2;
-
-   if (put_snode((char *)cp2,len,(u_int64_t)1,sr_htab))
-   {
-      if (verbose)
-      /* Error adding search string node, skipping .... */
-      fprintf(stderr,"%s %s\n", msg_nomem_sc, tmpbuf);
-   }
-   return;
+   *slen = cp1 - cp2;
+   return (char *)cp2;
 }
 
 /*********************************************/
@@ -2239,7 +2660,7 @@ char *get_domain(char *str, int *len)
    while (cp!=str)
    {
       if (*cp=='.')
-         if (!(--i)) return ++cp;
+         if (!(--i)) { cp++; *len -= cp - str; return cp; }
       cp--;
    }
    *len -= cp - str;
@@ -2254,7 +2675,7 @@ void agent_mangle(char *str)
 {
    char *cp1, *cp2, *cp3;
 
-   str=cp2=log_rec.agent;
+   cp2=str;
    cp1=strstr(str,"ompatible"); /* check known fakers */
    if (cp1!=NULL)
    {
@@ -2384,53 +2805,6 @@ void agent_mangle(char *str)
    }
 }
 
-/*********************************************/
-/* OUR_GZGETS - enhanced gzgets for log only */
-/*********************************************/
-
-char *our_gzgets(char *buf, int size, void *fp)
-{
-   char *out_cp=buf;      /* point to output */
-   while (1)
-   {
-      if (f_cp>(f_buf+f_end-1))     /* load? */
-      {
-#ifdef USE_BZIP
-         f_end=(gz_log==COMP_BZIP)?
-            BZ2_bzread(fp, f_buf, GZ_BUFSIZE):
-            gzread(fp, f_buf, GZ_BUFSIZE);
-#else
-         f_end=gzread(fp, f_buf, GZ_BUFSIZE);
-#endif
-         if (f_end<=0) return Z_NULL;
-         f_cp=f_buf;
-      }
-
-      if (--size)                   /* more? */
-      {
-         *out_cp++ = *f_cp;
-         if (*f_cp++ == '\n') { *out_cp='\0'; return buf; }
-      }
-      else { *out_cp='\0'; return buf; }
-   }
-}
-
-#ifdef USE_BZIP
-/*********************************************/
-/* bz2_rewind - our 'rewind' for bz2 files   */
-/*********************************************/
-
-int bz2_rewind( void **fp, char *fname, char *mode )
-{
-   BZ2_bzclose( *fp );
-   *fp = BZ2_bzopen( fname, "rb");
-   f_cp=f_buf+GZ_BUFSIZE; f_end=0;   /* reset buffer counters */
-   memset(f_buf, 0, sizeof(f_buf));
-   if (*fp == Z_NULL) return -1;
-   else return 0;
-}
-#endif /* USE_BZIP */
-
 /*********************************************/
 /* ISIPADDR - Determine if str is IP address */
 /*********************************************/
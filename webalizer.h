@@ -12,7 +12,7 @@
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #endif
 
-#define MAXHASH  4096                  /* Size of our hash tables          */
+#define MAXHASH  4096                  /* Size of DNS hash table           */
 #define BUFSIZE  4096                  /* Max buffer size for log record   */
 #define MAXHOST  256                   /* Max hostname buffer size         */
 #define MAXURL   4096                  /* Max HTTP request/URL field size  */
@@ -26,6 +26,7 @@
 #define MAXIDENT 64                    /* Max size of ident string (user)  */
 #define MAXKWORD 32                    /* Max size of config keyword       */
 #define MAXKVAL  132                   /* Max size of config value         */
+#define MAXLFMT  512                   /* Max size of LogFormat value      */
 #define HISTSIZE 120                   /* Size of history in months        */
 #define GRAPHMAX 72                    /* Max months in index graph        */
 
@@ -36,11 +37,14 @@
 #define LOG_FTP   1                    /* wu-ftpd xferlog type             */
 #define LOG_SQUID 2                    /* squid proxy log                  */
 #define LOG_W3C   3                    /* W3C extended log format          */
+#define LOG_JSON  4                    /* JSON lines (one object per line) */
 
 /* compression */
 #define COMP_NONE 0
 #define COMP_GZIP 1
 #define COMP_BZIP 2
+#define COMP_XZ   3
+#define COMP_ZSTD 4
 
 /* Response code defines as per draft ietf HTTP/1.1 rev 6 */
 #define RC_CONTINUE           100
@@ -169,9 +173,24 @@ struct  log_struct  {
 					   int referlen;
 					   int agentlen;
 					   int srchlen;
-					   int identlen; };
+					   int identlen;
+                  u_int64_t   hnamehash;          /* hash() of hostname,  */
+                  u_int64_t   urlhash;            /* url, refer, agent    */
+                  u_int64_t   referhash;          /* and ident, set once  */
+                  u_int64_t   agenthash;          /* filtered and used by */
+                  u_int64_t   identhash;          /* every table/cache    */
+                        int   year, month, day;   /* record date/time     */
+                        int   hour, min, sec; };  /* (see fix_date)       */
+
+/* parsed record status (get_parsed) */
+#define PR_EOF   0                     /* no more records                  */
+#define PR_OK    1                     /* good record in log_rec           */
+#define PR_BIG   2                     /* oversized record, skipped        */
+#define PR_DATE  3                     /* bad date in log_rec.datetime     */
+#define PR_BAD   4                     /* unparsable record                */
 
 extern struct log_struct log_rec;
+extern int     log_page;                      /* log_rec is a page        */
 
 extern char    *version     ;                 /* program version          */
 extern char    *editlvl     ;                 /* edit level               */
@@ -194,13 +213,17 @@ extern int     shade_groups ;                 /* Group shading 0=no 1=yes */
 extern int     hlite_groups ;                 /* Group hlite 0=no 1=yes   */
 extern int     mangle_agent ;                 /* mangle user agents       */
 extern int     incremental  ;                 /* incremental mode 1=yes   */
+extern int     follow       ;                 /* follow log file (0=no)   */
+extern int     follow_int   ;                 /* report update (seconds)  */
+extern int     follow_recs  ;                 /* report update (records)  */
+extern int     follow_ckpt  ;                 /* state checkpoint (secs)  */
 extern int     use_https    ;                 /* use 'https://' on URLs   */
 extern int     htaccess     ;                 /* create .htaccess? (0=no) */
 extern int     visit_timeout;                 /* visit timeout (30 min)   */
 extern int     graph_legend ;                 /* graph legend (1=yes)     */
 extern int     graph_lines  ;                 /* graph lines (0=none)     */
 extern int     fold_seq_err ;                 /* fold seq err (0=no)      */
-extern int     log_type     ;                 /* (0=clf, 1=ftp, 2=squid)  */
+extern int     log_type     ;                 /* (0=clf, 1=ftp, 2=squid..)*/
 extern int     group_domains;                 /* Group domains 0=none     */
 extern int     hide_sites   ;                 /* Hide ind. sites (0=no)   */
 extern int     graph_mths   ;                 /* # months in index graph  */
@@ -216,6 +239,7 @@ extern char    *html_ext    ;                 /* HTML file prefix         */
 extern char    *dump_ext    ;                 /* Dump file prefix         */
 extern char    *conf_fname  ;                 /* name of config file      */
 extern char    *log_fname   ;                 /* log file pointer         */
+extern char    *log_format  ;                 /* custom LogFormat string  */
 extern char    *out_dir     ;                 /* output directory         */
 extern char    *blank_str   ;                 /* blank string             */
 extern char    *dns_cache   ;                 /* DNS cache file name      */
@@ -223,6 +247,9 @@ extern int     geodb        ;                 /* Use GeoDB flag (0=no)    */
 extern int     dns_children ;                 /* # of DNS children        */
 extern int     cache_ips    ;                 /* Cache IP addrs (0=no)    */
 extern int     cache_ttl    ;                 /* Cache entry TTL (days)   */
+extern int     dz_threads   ;                 /* decompress threads       */
+extern int     pipeline     ;                 /* threaded pipeline (0=no) */
+extern int     shards       ;                 /* shard threads (0=no)     */
 extern int     link_referrer;                 /* link referrer (0=no)     */
 extern int     trimsquid    ;                 /* trim squid URLs (0=none) */
 extern int     searchcasei  ;                 /* case insensitive search  */
@@ -284,7 +311,6 @@ extern u_int64_t th_hit[24], th_file[24],     /* hourly total arrays      */
 extern double    th_xfer[24];                 /* hourly xfer array        */
 
 extern int       f_day,l_day;                 /* first/last day vars      */
-extern int       gz_log;                      /* flag for zipped log      */
 
 extern CLISTPTR  *top_ctrys;                  /* Top countries table      */
 
@@ -306,12 +332,16 @@ extern char      *cur_time();
 extern u_int64_t ctry_idx(char *);
 extern char      *un_idx(u_int64_t);
 extern void      init_counters();
+extern void      follow_update();
+extern int       fix_date(struct log_struct *);
+extern void      fix_record(struct log_struct *, u_int64_t);
+extern void      put_record(int, int, u_int64_t);
+extern char      *srch_string(char *, char *, int *);
+extern void      agent_mangle(char *);
+extern char      *get_domain(char *, int *);
 extern int       ispage(char *,int);
 extern u_int64_t jdate(int,int,int);
 extern char      from_hex(char);
 extern int       isipaddr(char *);
 
-typedef char *(fgets_func)(char *, int, void *);
-extern fgets_func *ourget;
-
 #endif  /* _WEBALIZER_H */
@@ -0,0 +1,615 @@
+/*
+    webalizer - a web server log analysis program
+
+    Copyright (C) 1997-2013  Bradford L. Barrett
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version, and provided that the above
+    copyright and permission notice is included with all distributed
+    copies of this or derived software.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+
+*/
+
+/*********************************************/
+/* STANDARD INCLUDES                         */
+/*********************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>                           /* normal stuff             */
+#include <fcntl.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* ensure sys/types */
+#ifndef _SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#include "webalizer.h"                        /* main header              */
+#include "zthread.h"                          /* our header               */
+
+#ifdef USE_THREADS    /* skip whole file if not using threads...          */
+
+#include <pthread.h>
+
+#ifdef USE_BZIP
+#include <bzlib.h>
+#endif
+
+#define DZ_QUEUED   0                         /* job states               */
+#define DZ_DONE     1
+#define DZ_ERROR   -1
+
+#define BZ_MASK     0xffffffffffffULL         /* 48 bit bzip2 magic nums  */
+#define BZ_BLKMAGIC 0x314159265359ULL         /* block header (pi)        */
+#define BZ_EOSMAGIC 0x177245385090ULL         /* end of stream (sqrt pi)  */
+
+struct dzjob   { int state;                   /* DZ_QUEUED/DONE/ERROR     */
+                 unsigned char *in;           /* gzip: compressed data    */
+                 size_t inlen;                /*       and its length     */
+                 u_int64_t sbit;              /* bzip2: block start bit   */
+                 u_int64_t ebit;              /*        and end bit       */
+                 int   level;                 /*        block size (1-9)  */
+                 unsigned char *zbuf;         /* rebuilt bzip2 stream     */
+                 size_t zsize;
+                 char  *out;                  /* decompressed data        */
+                 size_t olen;                 /* length of data           */
+                 size_t osize; };             /* size of output buffer    */
+
+struct dzstream{ int comp;                    /* COMP_GZIP or COMP_BZIP   */
+                 int fd;                      /* compressed file & its    */
+                 unsigned char *map;          /* mapping (read only)      */
+                 size_t msize;
+                 void  (*split)(DZPTR);       /* splitter function        */
+                 int   nthr;                  /* number of workers (0 =   */
+                 pthread_t splitter;          /* splitter does it all)    */
+                 pthread_t worker[DZ_MAXTHREADS];
+                 pthread_mutex_t lock;        /* protects everything below*/
+                 pthread_cond_t  work;        /* job queued for workers   */
+                 pthread_cond_t  done;        /* job done, for consumer   */
+                 pthread_cond_t  space;       /* free slot, for splitter  */
+                 struct dzjob *ring;          /* job ring (in file order) */
+                 int   depth;                 /* size of ring             */
+                 u_int64_t head;              /* next job to consume      */
+                 u_int64_t next;              /* next job for a worker    */
+                 u_int64_t tail;              /* next job to queue        */
+                 int   eof;                   /* splitter done            */
+                 int   stop;                  /* shutting down            */
+                 int   err;                   /* decompress error seen    */
+                 struct dzjob *cur; };        /* job being consumed       */
+
+/* internal function prototypes */
+
+static void *dz_splitter(void *);             /* splitter thread          */
+static void *dz_worker(void *);               /* worker thread            */
+static struct dzjob *dz_slot(DZPTR);          /* get free job slot        */
+static void dz_post(DZPTR, struct dzjob *, int); /* make job visible      */
+static int  dz_grow(struct dzjob *, size_t);  /* grow output buffer       */
+static size_t bgzf_size(unsigned char *, size_t);
+static void dz_gzsplit(DZPTR);                /* split BGZF on members    */
+static void dz_gzsingle(DZPTR);               /* plain gzip, one thread   */
+static int  dz_gunzip(struct dzjob *);        /* inflate one job          */
+#ifdef USE_BZIP
+static int  bz_find(DZPTR, u_int64_t *);      /* find next bzip2 magic    */
+static void dz_bzsplit(DZPTR);                /* split bzip2 on blocks    */
+static int  dz_bunzip(DZPTR, struct dzjob *); /* bunzip one block         */
+#endif
+
+/*********************************************/
+/* DZ_OPEN - start threaded decompression    */
+/*********************************************/
+
+DZPTR dz_open(char *fname, int comp)
+{
+   DZPTR       dz;
+   struct stat dz_stat;
+   int         i, n;
+
+   /* number of workers, default is one per cpu */
+   if ( (n=dz_threads) < 0) n=sysconf(_SC_NPROCESSORS_ONLN);
+   if (n<1) n=1;
+   if (n>DZ_MAXTHREADS) n=DZ_MAXTHREADS;
+
+   if ( (dz=calloc(1,sizeof(struct dzstream))) == NULL) return NULL;
+   dz->comp=comp;
+
+   /* map the whole compressed file, workers read it directly */
+   if ( (dz->fd=open(fname,O_RDONLY)) < 0) { free(dz); return NULL; }
+   if ( fstat(dz->fd,&dz_stat) || !S_ISREG(dz_stat.st_mode) ||
+        dz_stat.st_size<4 ) { close(dz->fd); free(dz); return NULL; }
+   dz->msize=dz_stat.st_size;
+   dz->map=mmap(NULL,dz->msize,PROT_READ,MAP_PRIVATE,dz->fd,0);
+   if (dz->map==MAP_FAILED) { close(dz->fd); free(dz); return NULL; }
+   madvise(dz->map,dz->msize,MADV_SEQUENTIAL);
+
+   /* how can it be split up? */
+   switch (comp)
+   {
+#ifdef USE_BZIP
+      case COMP_BZIP:
+         if (!memcmp(dz->map,"BZh",3)) dz->split=dz_bzsplit;
+         break;
+#endif
+      case COMP_GZIP:
+         if (dz->map[0]!=0x1f || dz->map[1]!=0x8b) break;
+         if (bgzf_size(dz->map,dz->msize)) dz->split=dz_gzsplit;
+         else { dz->split=dz_gzsingle; n=0; }  /* can't split, one thread */
+         break;
+   }
+
+   dz->depth=(n)?(n*2)+2:4;
+   if ( (dz->split==NULL) ||
+        ((dz->ring=calloc(dz->depth,sizeof(struct dzjob)))==NULL) )
+   {
+      /* not for us, let caller read it the normal way */
+      munmap(dz->map,dz->msize); close(dz->fd); free(dz);
+      return NULL;
+   }
+
+   pthread_mutex_init(&dz->lock,NULL);
+   pthread_cond_init(&dz->work,NULL);
+   pthread_cond_init(&dz->done,NULL);
+   pthread_cond_init(&dz->space,NULL);
+
+   /* start the workers, then the splitter to feed them */
+   for (i=0;i<n;i++)
+      if (pthread_create(&dz->worker[i],NULL,dz_worker,dz)) break;
+   dz->nthr=i;
+   if ( (n && !i) || pthread_create(&dz->splitter,NULL,dz_splitter,dz) )
+   {
+      pthread_mutex_lock(&dz->lock);
+      dz->stop=1;
+      pthread_cond_broadcast(&dz->work);
+      pthread_mutex_unlock(&dz->lock);
+      for (i=0;i<dz->nthr;i++) pthread_join(dz->worker[i],NULL);
+      pthread_mutex_destroy(&dz->lock);
+      pthread_cond_destroy(&dz->work);
+      pthread_cond_destroy(&dz->done);
+      pthread_cond_destroy(&dz->space);
+      free(dz->ring); munmap(dz->map,dz->msize); close(dz->fd); free(dz);
+      return NULL;
+   }
+   return dz;
+}
+
+/*********************************************/
+/* DZ_READ - get next block of output        */
+/*********************************************/
+
+int dz_read(DZPTR dz, char **data)
+{
+   struct dzjob *job;
+
+   pthread_mutex_lock(&dz->lock);
+   while (1)
+   {
+      /* done with the previous block, free its slot */
+      if (dz->cur!=NULL)
+      {
+         dz->cur=NULL; dz->head++;
+         pthread_cond_signal(&dz->space);
+      }
+      if (dz->err) break;                     /* stop at first error      */
+
+      /* wait for next job (in file order) to finish */
+      while ( !(dz->head<dz->tail &&
+                dz->ring[dz->head%dz->depth].state!=DZ_QUEUED) &&
+              !(dz->eof && dz->head==dz->tail) )
+         pthread_cond_wait(&dz->done,&dz->lock);
+      if (dz->head==dz->tail) break;          /* all done                 */
+
+      job=dz->cur=&dz->ring[dz->head%dz->depth];
+      if (job->state==DZ_ERROR) dz->err=1;    /* return what we got first */
+      if (job->olen==0) continue;
+
+      pthread_mutex_unlock(&dz->lock);
+      *data=job->out;
+      return job->olen;
+   }
+   pthread_mutex_unlock(&dz->lock);
+   return 0;
+}
+
+/*********************************************/
+/* DZ_CLOSE - stop threads and clean up      */
+/*********************************************/
+
+void dz_close(DZPTR dz)
+{
+   int i;
+
+   pthread_mutex_lock(&dz->lock);
+   dz->stop=1;
+   pthread_cond_broadcast(&dz->work);
+   pthread_cond_broadcast(&dz->space);
+   pthread_mutex_unlock(&dz->lock);
+
+   pthread_join(dz->splitter,NULL);
+   for (i=0;i<dz->nthr;i++) pthread_join(dz->worker[i],NULL);
+
+   for (i=0;i<dz->depth;i++)
+   {
+      if (dz->ring[i].out)  free(dz->ring[i].out);
+      if (dz->ring[i].zbuf) free(dz->ring[i].zbuf);
+   }
+   pthread_mutex_destroy(&dz->lock);
+   pthread_cond_destroy(&dz->work);
+   pthread_cond_destroy(&dz->done);
+   pthread_cond_destroy(&dz->space);
+   free(dz->ring);
+   munmap(dz->map,dz->msize);
+   close(dz->fd);
+   free(dz);
+}
+
+/*********************************************/
+/* DZ_SPLITTER - split input into jobs       */
+/*********************************************/
+
+static void *dz_splitter(void *arg)
+{
+   DZPTR dz=(DZPTR)arg;
+
+   dz->split(dz);
+
+   pthread_mutex_lock(&dz->lock);
+   dz->eof=1;
+   pthread_cond_broadcast(&dz->work);
+   pthread_cond_broadcast(&dz->done);
+   pthread_mutex_unlock(&dz->lock);
+   return NULL;
+}
+
+/*********************************************/
+/* DZ_WORKER - decompress queued jobs        */
+/*********************************************/
+
+static void *dz_worker(void *arg)
+{
+   DZPTR        dz=(DZPTR)arg;
+   struct dzjob *job;
+   int          ok;
+
+   pthread_mutex_lock(&dz->lock);
+   while (1)
+   {
+      while (dz->next==dz->tail && !dz->eof && !dz->stop)
+         pthread_cond_wait(&dz->work,&dz->lock);
+      if (dz->stop || dz->next==dz->tail) break;
+      job=&dz->ring[dz->next++%dz->depth];
+      pthread_mutex_unlock(&dz->lock);
+
+#ifdef USE_BZIP
+      if (dz->comp==COMP_BZIP) ok=dz_bunzip(dz,job);
+      else
+#endif
+      ok=dz_gunzip(job);
+
+      pthread_mutex_lock(&dz->lock);
+      job->state=(ok)?DZ_DONE:DZ_ERROR;
+      pthread_cond_broadcast(&dz->done);
+   }
+   pthread_mutex_unlock(&dz->lock);
+   return NULL;
+}
+
+/*********************************************/
+/* DZ_SLOT - wait for a free job slot        */
+/*********************************************/
+
+static struct dzjob *dz_slot(DZPTR dz)
+{
+   struct dzjob *job=NULL;
+
+   pthread_mutex_lock(&dz->lock);
+   while (dz->tail-dz->head>=(u_int64_t)dz->depth && !dz->stop)
+      pthread_cond_wait(&dz->space,&dz->lock);
+   if (!dz->stop) job=&dz->ring[dz->tail%dz->depth];
+   pthread_mutex_unlock(&dz->lock);
+   if (job) job->olen=0;
+   return job;
+}
+
+/*********************************************/
+/* DZ_POST - add filled in job to the queue  */
+/*********************************************/
+
+static void dz_post(DZPTR dz, struct dzjob *job, int state)
+{
+   pthread_mutex_lock(&dz->lock);
+   job->state=state;
+   dz->tail++;
+   if (state==DZ_QUEUED) pthread_cond_signal(&dz->work);
+   else                  pthread_cond_broadcast(&dz->done);
+   pthread_mutex_unlock(&dz->lock);
+}
+
+/*********************************************/
+/* DZ_GROW - make room in output buffer      */
+/*********************************************/
+
+static int dz_grow(struct dzjob *job, size_t need)
+{
+   size_t size=(job->osize)?job->osize:DZ_OUTCHUNK;
+   char   *cp;
+
+   if (need<=job->osize) return 1;
+   while (size<need) size*=2;
+   if ( (cp=realloc(job->out,size)) == NULL) return 0;
+   job->out=cp; job->osize=size;
+   return 1;
+}
+
+/*********************************************/
+/* BGZF_SIZE - size of BGZF member (0=not)   */
+/*********************************************/
+
+static size_t bgzf_size(unsigned char *p, size_t avail)
+{
+   size_t xlen, i, n;
+
+   /* gzip header with FEXTRA flag set? */
+   if (avail<18 || p[0]!=0x1f || p[1]!=0x8b || p[2]!=8 || !(p[3]&4))
+      return 0;
+   xlen=p[10]|(p[11]<<8);
+
+   /* look for 'BC' subfield, holds member size-1 */
+   for (i=12; (i+4<=12+xlen) && (i+6<=avail); i+=4+(p[i+2]|(p[i+3]<<8)))
+   {
+      if (p[i]=='B' && p[i+1]=='C' && p[i+2]==2 && p[i+3]==0)
+      {
+         n=(p[i+4]|(p[i+5]<<8))+1;
+         return (n<=avail)?n:0;
+      }
+   }
+   return 0;
+}
+
+/*********************************************/
+/* DZ_GZSPLIT - split BGZF file into jobs    */
+/*********************************************/
+
+static void dz_gzsplit(DZPTR dz)
+{
+   struct dzjob *job;
+   size_t       pos=0, start, n;
+
+   while (pos<dz->msize)
+   {
+      /* group members into reasonable sized jobs */
+      start=pos;
+      while ( (pos<dz->msize) && (pos-start<DZ_GZCHUNK) &&
+              (n=bgzf_size(dz->map+pos,dz->msize-pos)) ) pos+=n;
+      if (pos==start) pos=dz->msize;          /* not BGZF, rest as one    */
+
+      if ( (job=dz_slot(dz)) == NULL) return;
+      job->in=dz->map+start; job->inlen=pos-start;
+      dz_post(dz,job,DZ_QUEUED);
+   }
+}
+
+/*********************************************/
+/* DZ_GZSINGLE - plain gzip, just this thread*/
+/*********************************************/
+
+static void dz_gzsingle(DZPTR dz)
+{
+   struct dzjob *job;
+   z_stream     zs;
+   size_t       pos=0, n;
+   int          ret=Z_OK, state=DZ_DONE, end=0;
+
+   memset(&zs,0,sizeof(zs));
+   if (inflateInit2(&zs,15+16)!=Z_OK) return;
+
+   while (!end && state==DZ_DONE)
+   {
+      if ( (job=dz_slot(dz)) == NULL) break;
+      if (!dz_grow(job,DZ_OUTCHUNK)) state=DZ_ERROR;
+
+      zs.next_out=(unsigned char *)job->out;
+      zs.avail_out=(state==DZ_DONE)?DZ_OUTCHUNK:0;
+      while (zs.avail_out && state==DZ_DONE)
+      {
+         if (zs.avail_in==0)
+         {
+            n=dz->msize-pos;
+            if (n>(1<<30)) n=(1<<30);
+            zs.next_in=dz->map+pos; zs.avail_in=n; pos+=n;
+         }
+         ret=inflate(&zs,Z_NO_FLUSH);
+         if (ret==Z_STREAM_END)
+         {
+            /* another member? (gzread ignores trailing junk) */
+            n=zs.next_in-dz->map;
+            if (n+2<=dz->msize && zs.next_in[0]==0x1f && zs.next_in[1]==0x8b)
+               inflateReset(&zs);
+            else { end=1; break; }
+         }
+         else if (ret!=Z_OK) state=DZ_ERROR;  /* bad or truncated data    */
+      }
+      job->olen=(char *)zs.next_out-job->out;
+      dz_post(dz,job,state);
+   }
+   inflateEnd(&zs);
+}
+
+/*********************************************/
+/* DZ_GUNZIP - inflate gzip member(s) of job */
+/*********************************************/
+
+static int dz_gunzip(struct dzjob *job)
+{
+   z_stream zs;
+   int      ret;
+
+   memset(&zs,0,sizeof(zs));
+   if (inflateInit2(&zs,15+16)!=Z_OK) return 0;
+   zs.next_in=job->in; zs.avail_in=job->inlen;
+
+   while (1)
+   {
+      if (!dz_grow(job,job->olen+65536)) break;
+      zs.next_out=(unsigned char *)job->out+job->olen;
+      zs.avail_out=job->osize-job->olen;
+      ret=inflate(&zs,Z_NO_FLUSH);
+      job->olen=(char *)zs.next_out-job->out;
+
+      if (ret==Z_STREAM_END)
+      {
+         if (zs.avail_in<2 || zs.next_in[0]!=0x1f || zs.next_in[1]!=0x8b)
+            { inflateEnd(&zs); return 1; }
+         inflateReset(&zs);                   /* next member              */
+      }
+      else if (ret!=Z_OK) break;              /* bad or truncated data    */
+   }
+   inflateEnd(&zs);
+   return 0;
+}
+
+#ifdef USE_BZIP
+
+/*********************************************/
+/* BZ_FIND - find next bzip2 magic number    */
+/*********************************************/
+
+static int bz_find(DZPTR dz, u_int64_t *bit)
+{
+   u_int64_t b=*bit, end=(u_int64_t)dz->msize*8, w=0;
+   int       n=0;
+
+   /* magic numbers aren't byte aligned, so go bit by bit */
+   while (b<end)
+   {
+      w=((w<<1)|((dz->map[b>>3]>>(7-(b&7)))&1))&BZ_MASK;
+      b++;
+      if (++n<48) continue;
+      if (w==BZ_BLKMAGIC) { *bit=b-48; return 1; }
+      if (w==BZ_EOSMAGIC) { *bit=b-48; return 2; }
+   }
+   return 0;
+}
+
+/*********************************************/
+/* DZ_BZSPLIT - split bzip2 file on blocks   */
+/*********************************************/
+
+static void dz_bzsplit(DZPTR dz)
+{
+   struct dzjob *job;
+   size_t       pos=0;
+   u_int64_t    bit, prev=0;
+   int          level, m=0, have;
+
+   /* each stream: 'BZh' + level, blocks, end of stream + crc */
+   while ( (pos+4<=dz->msize) && !memcmp(dz->map+pos,"BZh",3) &&
+           (dz->map[pos+3]>='1') && (dz->map[pos+3]<='9') )
+   {
+      level=dz->map[pos+3]-'0';
+      bit=(u_int64_t)(pos+4)*8; have=0;
+      while ( (m=bz_find(dz,&bit)) != 0)
+      {
+         if (have)
+         {
+            /* block ends where the next magic starts */
+            if ( (job=dz_slot(dz)) == NULL) return;
+            job->sbit=prev; job->ebit=bit; job->level=level;
+            dz_post(dz,job,DZ_QUEUED);
+         }
+         if (m==2) break;                     /* end of stream            */
+         prev=bit; have=1; bit+=48;
+      }
+      if (m==0)
+      {
+         /* truncated, let the worker complain */
+         if (have && (job=dz_slot(dz))!=NULL)
+         {
+            job->sbit=prev; job->ebit=(u_int64_t)dz->msize*8;
+            job->level=level;
+            dz_post(dz,job,DZ_QUEUED);
+         }
+         return;
+      }
+      pos=(size_t)((bit+48+32+7)/8);          /* skip magic, stream crc   */
+   }
+}
+
+/* bit writer for rebuilding a block as a stream */
+#define BW_PUT(v,n) { acc=(acc<<(n))|(v); cnt+=(n); \
+                      while (cnt>=8) { cnt-=8; zp[len++]=(acc>>cnt)&0xff; } }
+
+/*********************************************/
+/* DZ_BUNZIP - decompress one bzip2 block    */
+/*********************************************/
+
+static int dz_bunzip(DZPTR dz, struct dzjob *job)
+{
+   bz_stream     bs;
+   unsigned char *zp, *src=dz->map;
+   u_int64_t     acc=0, b, crc=0;
+   size_t        len=0, need;
+   int           cnt=0, ret;
+
+   /* need: header, block bits, end of stream magic and crc */
+   need=4+(size_t)((job->ebit-job->sbit)/8)+12;
+   if (need>job->zsize)
+   {
+      if ( (zp=realloc(job->zbuf,need)) == NULL) return 0;
+      job->zbuf=zp; job->zsize=need;
+   }
+   zp=job->zbuf;
+
+   /* rebuild block as a single block stream, so the stream crc */
+   /* is just the block crc (the 32 bits after the block magic) */
+   for (b=job->sbit+48; b<job->sbit+80 && b<job->ebit; b++)
+      crc=(crc<<1)|((src[b>>3]>>(7-(b&7)))&1);
+
+   BW_PUT('B',8); BW_PUT('Z',8); BW_PUT('h',8); BW_PUT('0'+job->level,8);
+   b=job->sbit;
+   while (b<job->ebit && (b&7))
+      { BW_PUT((src[b>>3]>>(7-(b&7)))&1,1); b++; }
+   while (b+8<=job->ebit)
+      { BW_PUT(src[b>>3],8); b+=8; }
+   while (b<job->ebit)
+      { BW_PUT((src[b>>3]>>(7-(b&7)))&1,1); b++; }
+   BW_PUT((BZ_EOSMAGIC>>24)&0xffffff,24);
+   BW_PUT(BZ_EOSMAGIC&0xffffff,24);
+   BW_PUT((crc>>16)&0xffff,16);
+   BW_PUT(crc&0xffff,16);
+   if (cnt) zp[len++]=(acc<<(8-cnt))&0xff;
+
+   /* now decompress it */
+   memset(&bs,0,sizeof(bs));
+   if (BZ2_bzDecompressInit(&bs,0,0)!=BZ_OK) return 0;
+   bs.next_in=(char *)zp; bs.avail_in=len;
+
+   while (1)
+   {
+      if (!dz_grow(job,job->olen+(1024*1024))) { ret=BZ_MEM_ERROR; break; }
+      bs.next_out=job->out+job->olen;
+      bs.avail_out=job->osize-job->olen;
+      ret=BZ2_bzDecompress(&bs);
+      job->olen=bs.next_out-job->out;
+      if (ret!=BZ_OK) break;
+      if (bs.avail_in==0 && bs.avail_out!=0) { ret=BZ_UNEXPECTED_EOF; break; }
+   }
+   BZ2_bzDecompressEnd(&bs);
+   return (ret==BZ_STREAM_END);
+}
+
+#endif  /* USE_BZIP */
+#endif  /* USE_THREADS */
@@ -0,0 +1,17 @@
+#ifndef _ZTHREAD_H
+#define _ZTHREAD_H
+
+#ifdef USE_THREADS  /* skip whole file if not using threads...             */
+
+#define DZ_MAXTHREADS 64                   /* max decompression workers    */
+#define DZ_GZCHUNK    (256*1024)           /* BGZF input per job           */
+#define DZ_OUTCHUNK   (1024*1024)          /* single thread output block   */
+
+typedef struct dzstream *DZPTR;            /* decompression stream pointer */
+
+extern DZPTR dz_open(char *, int);         /* start decompression threads  */
+extern int   dz_read(DZPTR, char **);      /* get next decompressed block  */
+extern void  dz_close(DZPTR);              /* stop threads and clean up    */
+
+#endif  /* USE_THREADS */
+#endif  /* _ZTHREAD_H */